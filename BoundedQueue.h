@@ -0,0 +1,93 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+// fixed size queue any number of threads can push to and pop from without a lock. it's a ring of slots, each with a
+// sequence number saying whose turn it is: a pusher claims a slot by bumping tail, writes it, then bumps the slot's
+// sequence so the popper that claims it next knows it's ready. nothing ever gets allocated after construction, and
+// nobody ever waits on anybody else inside a push or pop, they just fail when the queue is full or empty and the
+// caller decides what to do about it.
+template <typename T>
+class BoundedQueue {
+public:
+
+    // capacity gets rounded up to a power of two
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask = size - 1;
+        slots = std::make_unique<Slot[]>(size);
+        for (size_t i = 0; i < size; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    // false (and value is left alone) if the queue is full
+    bool tryPush(T &value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[position & mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const long long diff = (long long) sequence - (long long) position;
+            if (diff == 0) {
+                // the slot is free, try to claim it. on failure position gets the new tail and we go again.
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0)
+                return false; // a lap behind: nobody has popped this slot yet
+            else
+                position = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    // false if the queue is empty
+    bool tryPop(T &value) {
+        size_t position = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[position & mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const long long diff = (long long) sequence - (long long) (position + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(slot.value);
+                    // free for the push a whole lap from now
+                    slot.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0)
+                return false; // nothing has been pushed here yet
+            else
+                position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // on cache lines of their own, so pushers and poppers don't slow each other down
+    alignas(64) std::atomic<size_t> head {0};
+    alignas(64) std::atomic<size_t> tail {0};
+    alignas(64) size_t mask;
+    std::unique_ptr<Slot[]> slots;
+};
+
+#endif //BOUNDEDQUEUE_H
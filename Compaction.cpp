@@ -0,0 +1,97 @@
+#include "Compaction.h"
+#include "Coverage.h"
+#include "HyperCircleModel.h"
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+// classifies test one row at a time like a server would, and fills in everything but the budget
+static Compaction::Step measure(const vector<HyperCircle> &circles, Dataset &train, Dataset &test, const Compaction::Settings &settings) {
+    const HyperCircleModel model(circles, train.numAttributes, train.numClasses());
+
+    Compaction::Step step {};
+    step.circles = model.size();
+
+    vector<double> micros(test.size());
+    vector<float> scores(model.numClasses);
+    int correct = 0, fellBack = 0;
+    for (size_t p = 0; p < test.size(); ++p) {
+        int label;
+        const auto start = Clock::now();
+        model.classifyRows(test[p].location, 1, &label, settings.subMode, settings.fallback, settings.k, scores.data());
+        micros[p] = chrono::duration<double, micro>(Clock::now() - start).count();
+
+        correct += label == test[p].classification;
+        // rows no circle covered come back with all zero scores
+        fellBack += all_of(scores.begin(), scores.end(), [](float s) { return s == 0.0f; });
+    }
+
+    if (!test.empty()) {
+        step.accuracy = (float) correct / (float) test.size();
+        step.fallbackShare = (float) fellBack / (float) test.size();
+
+        double total = 0.0;
+        for (double m : micros)
+            total += m;
+        step.meanMicros = total / (double) micros.size();
+
+        const size_t rank = min(micros.size() - 1, (size_t) ceil(0.99 * (double) micros.size()) - 1);
+        nth_element(micros.begin(), micros.begin() + rank, micros.end());
+        step.p99Micros = micros[rank];
+    }
+    return step;
+}
+
+vector<Compaction::Step> Compaction::curve(const vector<HyperCircle> &circles, Dataset &train, Dataset &test, const Settings &settings) {
+    vector<Step> steps;
+
+    // the model as it is, for comparison
+    steps.push_back(measure(circles, train, test, settings));
+    steps.back().budget = -1;
+
+    // the same pruning and coverage matrix coverCircles would make, once for all the budgets
+    vector<HyperCircle> pruned = circles;
+    HyperCircle::pruneDominatedCircles(pruned, train);
+    const CoverageMatrix coverage(pruned, train);
+
+    int budget = numeric_limits<int>::max();
+    while (budget >= 1) {
+        vector<HyperCircle> kept = pruned;
+        HyperCircle::coverCircles(kept, train, coverage, budget);
+        steps.push_back(measure(kept, train, test, settings));
+        steps.back().budget = budget == numeric_limits<int>::max() ? (int) kept.size() : budget;
+
+        // the next budget is a bit smaller than what we actually kept, and always at least one smaller
+        const int next = (int) floor((float) kept.size() * settings.shrink);
+        budget = min(next, (int) kept.size() - 1);
+    }
+    return steps;
+}
+
+int Compaction::fitLatency(const vector<Step> &steps, double p99Micros) {
+    int best = -1;
+    for (int s = 0; s < steps.size(); ++s) {
+        if (steps[s].p99Micros > p99Micros)
+            continue;
+        if (best == -1 || steps[s].accuracy > steps[best].accuracy
+            || (steps[s].accuracy == steps[best].accuracy && steps[s].circles < steps[best].circles))
+            best = s;
+    }
+    return best;
+}
+
+void Compaction::printCurve(const vector<Step> &steps, ostream &out) {
+    out << "=== ACCURACY VS LATENCY (one row per request) ===" << endl;
+    out << left << setw(10) << "budget" << setw(10) << "circles" << setw(11) << "accuracy" << setw(12) << "fallback %"
+        << setw(11) << "mean us" << "p99 us" << endl;
+    for (const Step &s : steps) {
+        out << left << setw(10) << (s.budget < 0 ? string("none") : to_string(s.budget)) << setw(10) << s.circles
+            << setw(11) << fixed << setprecision(4) << s.accuracy << setw(12) << setprecision(1) << s.fallbackShare * 100
+            << setw(11) << setprecision(2) << s.meanMicros << setprecision(2) << s.p99Micros << defaultfloat << endl;
+    }
+}
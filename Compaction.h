@@ -0,0 +1,61 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include <vector>
+#include <cstddef>
+#include <iostream>
+
+#include "Dataset.h"
+#include "HyperCircle.h"
+
+// what it costs in accuracy to cap how many circles a model has. classifying a row measures it against every circle,
+// so the circle count is the latency. HyperCircle::coverCircles with a budget keeps the circles covering the most points
+// nothing kept before them covers, and the rest of the points go to the fallback. this runs that at a range of budgets,
+// from the circles as they are down to one, and measures each model the way a server would run it: one row per request
+// through classifyRows, with a circle based fallback since a server has no training data.
+// one coverage matrix does for every budget, so it's a handful of greedy passes and the classifying, on top of one
+// coverCircles.
+class Compaction {
+public:
+
+    struct Settings {
+        int subMode = HyperCircle::SIMPLE_MAJORITY;
+        int fallback = HyperCircle::K_NEAREST_CIRCLES;
+        int k = 3;
+
+        // each budget is this much of the one before it, starting from a full cover
+        float shrink = 0.75f;
+    };
+
+    struct Step {
+        // the budget, and how many circles the model ended up with (greedy can use fewer)
+        int budget;
+        size_t circles;
+
+        // on the points we measured with
+        float accuracy;
+
+        // how many of those points no circle covered, so the fallback classified them
+        float fallbackShare;
+
+        // microseconds per single row request
+        double meanMicros;
+        double p99Micros;
+    };
+
+    // the curve for circles (made from train) measured on test, most circles first. the first step is circles as they
+    // are, with a budget of -1. the second is a full cover (coverCircles with no budget), and the rest shrink from there.
+    static std::vector<Step> curve(const std::vector<HyperCircle> &circles, Dataset &train, Dataset &test, const Settings &settings);
+
+    // the step to take for a p99 latency budget: the most accurate one which fits, the fewer circles on ties. -1 if
+    // none of them do.
+    static int fitLatency(const std::vector<Step> &steps, double p99Micros);
+
+    static void printCurve(const std::vector<Step> &steps, std::ostream &out);
+};
+
+#endif //COMPACTION_H
@@ -0,0 +1,136 @@
+#include "Coverage.h"
+#include "Utils.h"
+#include "Parallelism.h"
+#include <queue>
+#include <bit>
+#include <algorithm>
+using namespace std;
+
+// how many circles share a pass over each 64 point word
+#define COVERAGE_TILE 16
+
+CoverageMatrix::CoverageMatrix(const vector<HyperCircle> &circles, Dataset &dataSet) {
+    points = dataSet.size();
+    Utils::withDimension(dataSet.numAttributes, [&](auto dim) { build<decltype(dim)::value>(circles, dataSet); });
+}
+
+template <int DIM>
+void CoverageMatrix::build(const vector<HyperCircle> &circles, Dataset &dataSet) {
+
+    const int n = dataSet.numAttributes;
+    const int numTiles = (int) (circles.size() + COVERAGE_TILE - 1) / COVERAGE_TILE;
+    const size_t words = numWords();
+
+    // each tile fills in its own circles' words, then we stitch them together in circle order
+    vector<vector<uint32_t>> tileIndex(circles.size());
+    vector<vector<uint64_t>> tileBits(circles.size());
+
+    #pragma omp parallel for schedule(dynamic, 1) if(Parallelism::choose(circles.size(), dataSet.size(), n) != Parallelism::SERIAL)
+    for (int tile = 0; tile < numTiles; ++tile) {
+        const int first = tile * COVERAGE_TILE;
+        const int last = min<int>(first + COVERAGE_TILE, (int) circles.size());
+
+        for (size_t w = 0; w < words; ++w) {
+            const size_t from = w * 64;
+            const size_t to = min(points, from + 64);
+
+            for (int c = first; c < last; ++c) {
+                uint64_t bits = 0;
+                for (size_t p = from; p < to; ++p)
+                    bits |= (uint64_t) circles[c].insideCircle<DIM>(dataSet[p].location, n) << (p - from);
+
+                if (bits) {
+                    tileIndex[c].push_back((uint32_t) w);
+                    tileBits[c].push_back(bits);
+                }
+            }
+        }
+    }
+
+    wordStart.assign(circles.size() + 1, 0);
+    for (size_t c = 0; c < circles.size(); ++c)
+        wordStart[c + 1] = wordStart[c] + tileIndex[c].size();
+
+    wordIndex.resize(wordStart.back());
+    wordBits.resize(wordStart.back());
+    for (size_t c = 0; c < circles.size(); ++c) {
+        copy(tileIndex[c].begin(), tileIndex[c].end(), wordIndex.begin() + wordStart[c]);
+        copy(tileBits[c].begin(), tileBits[c].end(), wordBits.begin() + wordStart[c]);
+    }
+}
+
+int CoverageMatrix::count(int circle) const {
+    int total = 0;
+    for (size_t i = wordStart[circle]; i < wordStart[circle + 1]; ++i)
+        total += popcount(wordBits[i]);
+    return total;
+}
+
+int CoverageMatrix::uncoveredCount(int circle, const vector<uint64_t> &covered) const {
+    int total = 0;
+    for (size_t i = wordStart[circle]; i < wordStart[circle + 1]; ++i)
+        total += popcount(wordBits[i] & ~covered[wordIndex[i]]);
+    return total;
+}
+
+void CoverageMatrix::addTo(int circle, vector<uint64_t> &covered) const {
+    for (size_t i = wordStart[circle]; i < wordStart[circle + 1]; ++i)
+        covered[wordIndex[i]] |= wordBits[i];
+}
+
+vector<uint64_t> CoverageMatrix::coveredByAny() const {
+    vector<uint64_t> covered(numWords(), 0);
+    for (int c = 0; c < numCircles(); ++c)
+        addTo(c, covered);
+    return covered;
+}
+
+vector<int> CoverageMatrix::greedyCover(int maxCircles) const {
+
+    // pair is (gain, -circle), so the biggest gain comes out first, and the lowest id on ties
+    priority_queue<pair<int, int>> queue;
+    for (int c = 0; c < numCircles(); ++c) {
+        const int gain = count(c);
+        if (gain > 0)
+            queue.push({gain, -c});
+    }
+
+    vector<uint64_t> covered(numWords(), 0);
+    vector<int> taken;
+    while (!queue.empty() && taken.size() < maxCircles) {
+        const int circle = -queue.top().second;
+        queue.pop();
+
+        // the gain we had queued may be stale. if the real one still beats everything else queued, it's the best.
+        const int gain = uncoveredCount(circle, covered);
+        if (gain == 0)
+            continue;
+        if (!queue.empty() && make_pair(gain, -circle) < queue.top()) {
+            queue.push({gain, -circle});
+            continue;
+        }
+
+        addTo(circle, covered);
+        taken.push_back(circle);
+    }
+
+    // greedy can leave an early pick fully covered by later ones. go back through newest first, and drop any circle
+    // every one of whose points is covered by some other circle we kept.
+    vector<int> timesCovered(points, 0);
+    for (int circle : taken)
+        forEachPoint(circle, [&](size_t p) { timesCovered[p]++; });
+
+    vector<int> kept;
+    kept.reserve(taken.size());
+    for (int t = (int) taken.size() - 1; t >= 0; --t) {
+        bool redundant = true;
+        forEachPoint(taken[t], [&](size_t p) { redundant = redundant && timesCovered[p] > 1; });
+
+        if (redundant)
+            forEachPoint(taken[t], [&](size_t p) { timesCovered[p]--; });
+        else
+            kept.push_back(taken[t]);
+    }
+    reverse(kept.begin(), kept.end());
+    return kept;
+}
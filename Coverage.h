@@ -0,0 +1,75 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <bit>
+#include <limits>
+
+#include "Dataset.h"
+#include "HyperCircle.h"
+
+// which training points each circle covers, worked out once. each circle gets a bitset over the points of the dataset,
+// 64 points to a word. a circle only covers points around its center, so most of its words are zero, and we only keep
+// the nonzero ones (which word it is, and its bits), back to back for all the circles like a sparse matrix.
+// after that, questions like "how many points does this circle cover that nothing picked so far does" are a few
+// popcounts instead of distance computations.
+class CoverageMatrix {
+public:
+
+    // circles and points are worked through in tiles (a handful of circles against 64 points at a time), so the points
+    // stay in cache while every circle in the tile checks them.
+    CoverageMatrix(const std::vector<HyperCircle> &circles, Dataset &dataSet);
+
+    int numCircles() const { return (int) wordStart.size() - 1; }
+    size_t numPoints() const { return points; }
+
+    // how many words a bitset over every point needs
+    size_t numWords() const { return (points + 63) / 64; }
+
+    // how many points circle covers
+    int count(int circle) const;
+
+    // how many points circle covers which aren't set in covered (numWords() words)
+    int uncoveredCount(int circle, const std::vector<uint64_t> &covered) const;
+
+    // sets circle's points in covered
+    void addTo(int circle, std::vector<uint64_t> &covered) const;
+
+    // calls visit(point) for every point circle covers, in order
+    template <typename Visit>
+    void forEachPoint(int circle, Visit &&visit) const {
+        for (size_t i = wordStart[circle]; i < wordStart[circle + 1]; ++i)
+            for (uint64_t bits = wordBits[i]; bits; bits &= bits - 1)
+                visit((size_t) wordIndex[i] * 64 + std::countr_zero(bits));
+    }
+
+    // every point at least one circle covers
+    std::vector<uint64_t> coveredByAny() const;
+
+    // greedy set cover: keep taking the circle covering the most points nothing taken so far covers, until every point
+    // any circle covers is covered. returns the circles taken, in the order they were taken. a circle's gain only ever
+    // goes down as we take others, so old gains in the queue are upper bounds, and we only recount the one on top.
+    // ties go to the lower circle id. afterwards any circle the later picks made redundant gets dropped.
+    // with maxCircles, we stop after that many picks. greedy is about as good as it gets at covering the most points
+    // with that many circles, and the points it leaves out are the ones the fewest circles were worth keeping for.
+    std::vector<int> greedyCover(int maxCircles = std::numeric_limits<int>::max()) const;
+
+private:
+
+    size_t points;
+
+    // circle c's nonzero words are wordIndex / wordBits [wordStart[c], wordStart[c + 1])
+    std::vector<size_t> wordStart;
+    std::vector<uint32_t> wordIndex;
+    std::vector<uint64_t> wordBits;
+
+    template <int DIM> void build(const std::vector<HyperCircle> &circles, Dataset &dataSet);
+};
+
+#endif //COVERAGE_H
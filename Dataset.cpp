@@ -0,0 +1,250 @@
+#include "Dataset.h"
+#include "Numa.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <bit>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+int ClassMap::idFor(const string &label) {
+    lock_guard<mutex> guard(lock);
+
+    auto it = ids.find(label);
+    if (it != ids.end())
+        return it->second;
+
+    const int id = (int) ids.size();
+    ids[label] = id;
+    names[id] = label;
+    return id;
+}
+
+string ClassMap::nameOf(int id) const {
+    lock_guard<mutex> guard(lock);
+    auto it = names.find(id);
+    return it == names.end() ? to_string(id) : it->second;
+}
+
+int ClassMap::size() const {
+    lock_guard<mutex> guard(lock);
+    return (int) ids.size();
+}
+
+vector<string> ClassMap::labels() const {
+    lock_guard<mutex> guard(lock);
+    vector<string> all;
+    for (const auto &[id, name] : names)
+        all.push_back(name);
+    return all;
+}
+
+shared_ptr<ClassMap> ClassMap::withLabels(const vector<string> &labels) {
+    auto classes = make_shared<ClassMap>();
+    for (const string &label : labels)
+        classes->idFor(label);
+    return classes;
+}
+
+Dataset::Dataset() {
+    numAttributes = 0;
+    classes = make_shared<ClassMap>();
+}
+
+Dataset Dataset::emptyLike() const {
+    Dataset d;
+    d.numAttributes = numAttributes;
+    d.classes = classes;
+    d.storage = storage;
+    d.numa = numa;
+    return d;
+}
+
+Dataset Dataset::readFile(const string &fileName, shared_ptr<ClassMap> classes, const Numa::Config &numa) {
+
+    Reader reader(fileName, classes);
+    Dataset data = reader.next(numeric_limits<size_t>::max());
+
+    if (numa.placement != Numa::OFF)
+        return data.placed(numa);
+    return data;
+}
+
+Dataset::Reader::Reader(const string &fileName, shared_ptr<ClassMap> classes) : classes(classes ? classes : make_shared<ClassMap>()) {
+
+#ifdef _WIN32
+    const string realName = "datasets\\" + fileName;
+#else
+    const string realName = "datasets/" + fileName;
+#endif
+
+    file.open(realName);
+    if (!file.is_open()) {
+        cerr << "Failed to open file: " << fileName << endl;
+        return;
+    }
+
+    string line;
+
+    // Read header to determine number of attributes
+    if (!getline(file, line))
+        return;
+
+    stringstream headerSS(line);
+    string headerToken;
+    while (getline(headerSS, headerToken, ',')) {
+        ++columnCount;
+    }
+
+    numAttributes = columnCount - 1;
+}
+
+Dataset Dataset::Reader::next(size_t maxRows) {
+
+    Dataset data;
+    data.classes = classes;
+    data.numAttributes = numAttributes;
+    if (!good())
+        return data;
+
+    // we parse everything into one block first, and only make the points once it is done growing
+    auto rows = make_shared<vector<float>>();
+    vector<int> labels;
+    vector<float> attrs(numAttributes);
+
+    // Parse each data line
+    string line;
+    while (labels.size() < maxRows && getline(file, line)) {
+        stringstream ss(line);
+        vector<string> tokens;
+        string token;
+
+        while (getline(ss, token, ',')) {
+            tokens.push_back(token);
+        }
+
+        if (tokens.size() != columnCount) {
+            cerr << "Skipping malformed row: " << line << endl;
+            continue; // malformed row
+        }
+
+        try {
+            for (int i = 0; i < numAttributes; ++i) {
+                attrs[i] = stof(tokens[i]);
+            }
+        } catch (...) {
+            cerr << "Failed to parse floats on line: " << line << endl;
+            continue; // skip row with invalid numeric data
+        }
+
+        // Handle class label (strip any '\r')
+        string label = tokens.back();
+        if (!label.empty() && label.back() == '\r')
+            label.pop_back();
+
+        // throw our data into the block
+        rows->insert(rows->end(), attrs.begin(), attrs.end());
+        labels.push_back(classes->idFor(label));
+    }
+
+    // now that the block won't move, point each point at its row
+    data.points.reserve(labels.size());
+    for (size_t i = 0; i < labels.size(); ++i)
+        data.points.emplace_back(rows->data() + i * numAttributes, labels[i]);
+    data.storage.push_back(rows);
+    return data;
+}
+
+Dataset Dataset::placed(const Numa::Config &numa) const {
+    Dataset copy;
+    copy.numAttributes = numAttributes;
+    copy.classes = classes;
+    copy.numa = numa;
+
+    auto rows = make_shared<Numa::Buffer<float>>(points.size() * (size_t) numAttributes, numa);
+    copy.points.reserve(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        float *row = rows->data() + i * numAttributes;
+        copy_n(points[i].location, numAttributes, row);
+        copy.points.emplace_back(row, points[i].classification, points[i].weight);
+    }
+    copy.storage.push_back(rows);
+    return copy;
+}
+
+Dataset Dataset::collapsed(int *conflicts) const {
+
+    Dataset unique = emptyLike();
+    unique.points.reserve(points.size());
+
+    auto sameRow = [&](const float *a, const float *b) {
+        for (int i = 0; i < numAttributes; ++i)
+            if (a[i] != b[i])
+                return false;
+        return true;
+    };
+
+    // row hash -> the unique points with that hash. -0 and 0 compare equal, so they have to hash the same too.
+    unordered_map<uint64_t, vector<int>> seen;
+    seen.reserve(points.size());
+    vector<char> conflicted;
+    int conflictCount = 0;
+
+    for (const Point &p : points) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (int i = 0; i < numAttributes; ++i) {
+            const float value = p.location[i] == 0.0f ? 0.0f : p.location[i];
+            hash = (hash ^ bit_cast<uint32_t>(value)) * 0x100000001b3ull;
+        }
+
+        auto &bucket = seen[hash];
+        int sameClass = -1, otherClass = -1;
+        for (int u : bucket) {
+            if (!sameRow(unique.points[u].location, p.location))
+                continue;
+            if (unique.points[u].classification == p.classification)
+                sameClass = u;
+            else if (otherClass == -1)
+                otherClass = u;
+        }
+
+        if (sameClass != -1) {
+            unique.points[sameClass].weight += p.weight;
+            continue;
+        }
+
+        // first time this row shows up with a second class. flag it on the point that had it first, so it counts once.
+        if (otherClass != -1 && !conflicted[otherClass]) {
+            conflicted[otherClass] = 1;
+            conflictCount++;
+        }
+        bucket.push_back((int) unique.points.size());
+        unique.points.push_back(p);
+        conflicted.push_back(0);
+    }
+
+    if (conflicts)
+        *conflicts = conflictCount;
+    return unique;
+}
+
+void Dataset::append(const Dataset &more) {
+    points.insert(points.end(), more.points.begin(), more.points.end());
+    storage.insert(storage.end(), more.storage.begin(), more.storage.end());
+    index.reset();
+}
+
+void Dataset::buildIndex(int numTables, int hashesPerTable, float widthFactor) {
+
+    // our points might be spread across a few blocks (folds, subsets), so gather them up for the index
+    vector<float> rows;
+    rows.reserve(points.size() * numAttributes);
+    for (const Point &p : points)
+        rows.insert(rows.end(), p.location, p.location + numAttributes);
+
+    const float width = widthFactor * LSHIndex::typicalSpacing(rows.data(), points.size(), numAttributes);
+    index = make_shared<LSHIndex>(rows.data(), points.size(), numAttributes, numTables, hashesPerTable, width);
+}
@@ -0,0 +1,140 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <cstddef>
+
+#include "Point.h"
+#include "LSHIndex.h"
+#include "Numa.h"
+
+// label names <-> class ids. a training set and every test set read against it share one of these, so the ids line up.
+// very similar to github.com/austinsnyd3r/hyperblocks
+class ClassMap {
+public:
+
+    // gets the id for a label, giving it the next free id if we have never seen it.
+    int idFor(const std::string &label);
+
+    std::string nameOf(int id) const;
+
+    int size() const;
+
+    // every label, in id order
+    std::vector<std::string> labels() const;
+
+    // a map with these labels as ids 0, 1, ... in order, like one a training set would have read them into
+    static std::shared_ptr<ClassMap> withLabels(const std::vector<std::string> &labels);
+
+private:
+    // locked so test sets read on different threads against the same training set don't trip over each other
+    mutable std::mutex lock;
+    std::map<std::string, int> ids;
+    std::map<int, std::string> names;
+};
+
+// everything we know about one dataset. this used to be globals (numAttributes, the class maps), which meant only one
+// dataset could be loaded at a time, and reading a test file could overwrite the training file's width. now each
+// dataset carries its own, and gets passed through generation and classification.
+class Dataset {
+public:
+
+    // amount of attributes in dataset.
+    int numAttributes;
+
+    std::vector<Point> points;
+
+    // label names for our class ids. shared with any dataset read against us, or split off of us.
+    std::shared_ptr<ClassMap> classes;
+
+    // optional LSH index over our points, used by APPROX_KNN. ids are positions in points, so rebuild it if they change.
+    std::shared_ptr<const LSHIndex> index;
+
+    // how our rows were placed, if they were. anything big made to go with us (a sweep's distance tiles) goes the same way.
+    Numa::Config numa;
+
+    Dataset();
+
+    // a dataset with our width and labels but no points. used for folds and subsets, which keep pointing at our rows.
+    Dataset emptyLike() const;
+
+    // reads a csv from the datasets folder. last column is the class label. pass in another dataset's classes to read
+    // a test set whose labels match up with a training set. with a numa placement the rows get placed by it.
+    static Dataset readFile(const std::string &fileName, std::shared_ptr<ClassMap> classes = nullptr,
+                            const Numa::Config &numa = {});
+
+    // reads a csv the way readFile does, but a chunk of rows at a time, so files bigger than memory can go through.
+    // each chunk is a dataset of its own with its own rows, which go away with it.
+    class Reader {
+    public:
+
+        // opens fileName from the datasets folder and reads the header. labels go into classes (a fresh set if null).
+        Reader(const std::string &fileName, std::shared_ptr<ClassMap> classes = nullptr);
+
+        // false if the file didn't open or had no header
+        bool good() const { return numAttributes > 0; }
+
+        // the next maxRows good rows (fewer at the end of the file). empty once there are none left.
+        Dataset next(size_t maxRows);
+
+        int numAttributes = 0;
+
+        std::shared_ptr<ClassMap> classes;
+
+    private:
+        std::ifstream file;
+        int columnCount = 0;
+    };
+
+    // a copy of our points with their rows copied into one new block, placed the way numa says. the points keep their
+    // classes and weights. readFile hands back one of these when placement is on, since parsing touched every row from
+    // one thread.
+    Dataset placed(const Numa::Config &numa) const;
+
+    // a copy with every group of identical rows of the same class turned into one point, whose weight is how many rows
+    // it stands for. the points keep pointing at our rows. rows which show up under more than one class keep a point
+    // per class, and if conflicts isn't null it gets how many distinct rows that happened to.
+    Dataset collapsed(int *conflicts = nullptr) const;
+
+    // builds index. bucket width is widthFactor times the typical distance between neighboring points.
+    void buildIndex(int numTables, int hashesPerTable, float widthFactor);
+
+    int numClasses() const {
+        return classes->size();
+    }
+
+    size_t size() const { return points.size(); }
+    bool empty() const { return points.empty(); }
+
+    Point &operator[](size_t i) { return points[i]; }
+    const Point &operator[](size_t i) const { return points[i]; }
+
+    std::vector<Point>::iterator begin() { return points.begin(); }
+    std::vector<Point>::iterator end() { return points.end(); }
+    std::vector<Point>::const_iterator begin() const { return points.begin(); }
+    std::vector<Point>::const_iterator end() const { return points.end(); }
+
+    void push_back(const Point &p) { points.push_back(p); }
+
+    // adds more's points to the end of ours. their rows stay where they are (we just hold on to them too), so anything
+    // pointing at our rows or theirs stays good. more needs our width and labels, so read it against our classes.
+    // drops index, since it wouldn't know about the new points.
+    void append(const Dataset &more);
+
+private:
+
+    // the actual rows our points point into, all in one block (a vector, or a Numa::Buffer once placed). shared, so
+    // folds and subsets keep them alive.
+    std::vector<std::shared_ptr<const void>> storage;
+};
+
+#endif //DATASET_H
@@ -1,18 +1,27 @@
 #include "HyperCircle.h"
 #include "Utils.h"
+#include "Parallelism.h"
+#include "TopK.h"
+#include "Coverage.h"
+#include "NeighborGraph.h"
+#include "SparseDataset.h"
+#include <unordered_map>
+#include <numeric>
+#include <fstream>
+#include <chrono>
+#include <bit>
+#include <cstdio>
 using namespace std;
 
 // parameters we can play with.
 #define MIN_RADIUS 0.0f
 
-// tracks how many circles we have in each class.
-vector<int> HyperCircle::numCirclesPerClass;
-
 HyperCircle::HyperCircle() {
     radius = 0.0f;
     centerPoint = nullptr;
     classification = -1;
     numPoints = -1;
+    nearestEnemy = -1.0f;
 }
 
 HyperCircle::HyperCircle(float rad, float *center, int cls) {
@@ -20,15 +29,36 @@ HyperCircle::HyperCircle(float rad, float *center, int cls) {
     centerPoint = center;
     classification = cls;
     numPoints = 1;
+    nearestEnemy = -1.0f;
 }
 
 // finds the nearest neighbor to each HC
 // this is useful, so that we can get the distance to each nearest neighbor and update the radius.
-void HyperCircle::findNearestNeighbor(vector<Point> &dataSet) {
+void HyperCircle::findNearestNeighbor(Dataset &dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return findNearestNeighbor<decltype(dim)::value>(dataSet); });
+}
+
+template <int DIM>
+void HyperCircle::findNearestNeighbor(Dataset &dataSet) {
 
     // find our nearest guy of our own class, and set our radius to that value
     float minDist = numeric_limits<float>::max();
     int minClass = -1;
+    findNearestNeighbor<DIM>(dataSet, minDist, minClass);
+
+    // if our nearest point was this class, we use the distance to it as our radius. if not, we need to leave radius as 0.0. if 0.0 we kill the circle later.
+    if (minClass == this->classification) {
+        this->radius = minDist;
+    }
+}
+
+void HyperCircle::findNearestNeighbor(Dataset &dataSet, float &minDist, int &minClass) const {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return findNearestNeighbor<decltype(dim)::value>(dataSet, minDist, minClass); });
+}
+
+template <int DIM>
+void HyperCircle::findNearestNeighbor(Dataset &dataSet, float &minDist, int &minClass) const {
+
     for (auto &p : dataSet) {
 
         // if this point is the one which made our HC, continue.
@@ -36,8 +66,8 @@ void HyperCircle::findNearestNeighbor(vector<Point> &dataSet) {
             continue;
         }
 
-        // take the distance
-        float newDist = Utils::distance(p.location, centerPoint, Point::numAttributes);
+        // take the distance. anything past our current nearest can't change the answer, so we let it stop early.
+        float newDist = Utils::boundedDistance<DIM>(p.location, centerPoint, dataSet.numAttributes, minDist);
 
         if (newDist < minDist) {
             minDist = newDist;
@@ -52,23 +82,36 @@ void HyperCircle::findNearestNeighbor(vector<Point> &dataSet) {
             }
         }
     }
+}
 
-    // if our nearest point was this class, we use the distance to it as our radius. if not, we need to leave radius as 0.0. if 0.0 we kill the circle later.
-    if (minClass == this->classification) {
-        this->radius = minDist;
-    }
+void HyperCircle::findNearestEnemy(Dataset &dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return findNearestEnemy<decltype(dim)::value>(dataSet); });
+}
+
+template <int DIM>
+void HyperCircle::findNearestEnemy(Dataset &dataSet) {
+    if (nearestEnemy < 0.0f)
+        nearestEnemy = numeric_limits<float>::max();
+    for (auto &p : dataSet)
+        if (p.classification != classification)
+            nearestEnemy = min(nearestEnemy, Utils::boundedDistance<DIM>(p.location, centerPoint, dataSet.numAttributes, nearestEnemy));
 }
 
 // similar to findNearestNeighbor. but this version finds the largest pure distance. this way we know exactly how big each circle can be.
 // then we can set all the radiuses to said distance, and just remove useless circles. no merging needed.
-void HyperCircle::findMaxDistance(vector<Point> &dataSet) {
+void HyperCircle::findMaxDistance(Dataset &dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return findMaxDistance<decltype(dim)::value>(dataSet); });
+}
+
+template <int DIM>
+void HyperCircle::findMaxDistance(Dataset &dataSet) {
 
     // store distance to all training points
     vector<pair<float, int>> distances(dataSet.size());
 
     // compute all those distances
     for (int dp = 0; dp < dataSet.size(); ++dp) {
-        distances[dp] = {Utils::distance(dataSet[dp].location, this->centerPoint, Point::numAttributes), dataSet[dp].classification};
+        distances[dp] = {Utils::distance<DIM>(dataSet[dp].location, this->centerPoint, dataSet.numAttributes), dataSet[dp].classification};
     }
 
     // sort all those distances.
@@ -83,7 +126,7 @@ void HyperCircle::findMaxDistance(vector<Point> &dataSet) {
 }
 
 // takes in the entire dataset
-vector<HyperCircle> HyperCircle::createCircles(vector<Point> &dataset) {
+vector<HyperCircle> HyperCircle::createCircles(Dataset &dataset) {
 
     vector<HyperCircle> circles(dataset.size());
 
@@ -94,11 +137,13 @@ vector<HyperCircle> HyperCircle::createCircles(vector<Point> &dataset) {
         circles[i] = HyperCircle(0.0f, p.location, p.classification);
     }
 
-    // update each circle's radius to our nearest neighbor.
-    #pragma omp parallel for
-    for (int i = 0; i < circles.size(); i++) {
-        circles[i].findNearestNeighbor(dataset);
-    }
+    // update each circle's radius to our nearest neighbor. we pick our dimension kernel once for the whole pass.
+    Utils::withDimension(dataset.numAttributes, [&](auto dim) {
+        #pragma omp parallel for if(Parallelism::choose(circles.size(), dataset.size(), dataset.numAttributes) != Parallelism::SERIAL)
+        for (int i = 0; i < circles.size(); i++) {
+            circles[i].findNearestNeighbor<decltype(dim)::value>(dataset);
+        }
+    });
 
     // delete entirely all those circles which had a radius of 0.0f. meaning their nearest neighbor is wrong class. 
     circles.erase(remove_if(circles.begin(), circles.end(),[](const HyperCircle& c) { return c.radius == 0.0f; }),circles.end());
@@ -107,7 +152,40 @@ vector<HyperCircle> HyperCircle::createCircles(vector<Point> &dataset) {
 }
 
 // function which takes all our built circles, and starts deleting them as possible.
-void HyperCircle::mergeCircles(vector<HyperCircle>& circles, vector<Point>& dataSet) {
+void HyperCircle::mergeCircles(vector<HyperCircle>& circles, Dataset& dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return mergeCircles<decltype(dim)::value>(circles, dataSet); });
+}
+
+// whether c could grow to radius r and still not have any point of another class inside it
+template <int DIM>
+static bool noEnemyWithin(const HyperCircle &c, Dataset &dataSet, float r) {
+
+    atomic_int canMerge{1}; // shared flag
+    #pragma omp parallel for schedule(static) shared(canMerge) if(Parallelism::intraQuery(dataSet.size(), dataSet.numAttributes))
+    for (auto & pt : dataSet) {
+
+        if (!canMerge)
+            continue;   // early-out after failure
+
+        if (pt.classification == c.classification)
+            continue;
+
+        if (Utils::withinRadius<DIM>(pt.location, c.centerPoint, dataSet.numAttributes, r)) {
+            canMerge.store(0, memory_order_relaxed);
+            #ifdef _OPENMP
+            #pragma omp cancel for
+            #else
+            break;
+            #endif
+        }
+        #pragma omp cancellation point for
+    }
+
+    return canMerge != 0;
+}
+
+template <int DIM>
+void HyperCircle::mergeCircles(vector<HyperCircle>& circles, Dataset& dataSet) {
 
     for (int idx = 0; idx < circles.size(); ++idx) {
 
@@ -122,11 +200,11 @@ void HyperCircle::mergeCircles(vector<HyperCircle>& circles, vector<Point>& data
         // pre allocate the vector as the right size so we can save the copies
         dists.reserve(circles.size());
 
-        #pragma omp parallel
+        #pragma omp parallel if(Parallelism::intraQuery(circles.size() - idx, dataSet.numAttributes))
         {
             // our own local copy of the circles pairs
             vector<pair<float,int>> local;
-            local.reserve(circles.size() / omp_get_num_threads());
+            local.reserve(circles.size() / Parallelism::numThreads());
 
             #pragma omp for
             for (int j = idx + 1; j < circles.size(); ++j) {
@@ -136,7 +214,7 @@ void HyperCircle::mergeCircles(vector<HyperCircle>& circles, vector<Point>& data
                     continue;
 
                 // get our distance between our two circles. push that plus smaller guy radius.
-                local.emplace_back(Utils::distance(c.centerPoint,circles[j].centerPoint, Point::numAttributes) + circles[j].radius, j);
+                local.emplace_back(Utils::distance<DIM>(c.centerPoint,circles[j].centerPoint, dataSet.numAttributes) + circles[j].radius, j);
             }
 
             // add all our distances
@@ -164,29 +242,8 @@ void HyperCircle::mergeCircles(vector<HyperCircle>& circles, vector<Point>& data
                 continue;
             }
 
-            atomic_int canMerge{1}; // shared flag
-            #pragma omp parallel for schedule(static) shared(canMerge)
-            for (auto & pt : dataSet) {
-
-                if (!canMerge)
-                    continue;   // early-out after failure
-
-                if (pt.classification == c.classification)
-                    continue;
-
-                if (Utils::distance(pt.location,c.centerPoint, Point::numAttributes) <= newR2) {
-                    canMerge.store(0, memory_order_relaxed);
-                    #ifdef _OPENMP
-                    #pragma omp cancel for
-                    #else
-                    break;
-                    #endif
-                }
-                #pragma omp cancellation point for
-            }
-
             // if we can merge, update radius, and mark that this circle is toast.
-            if (canMerge != 0) {
+            if (noEnemyWithin<DIM>(c, dataSet, newR2)) {
                 c.radius = newR2;
                 mergable.push_back(circleID);   // remember the real ID
             } else
@@ -203,115 +260,761 @@ void HyperCircle::mergeCircles(vector<HyperCircle>& circles, vector<Point>& data
     circles.erase(remove_if(circles.begin(), circles.end(),[](const HyperCircle& hc){return hc.centerPoint == nullptr; }), circles.end());
 }
 
-bool HyperCircle::insideCircle(float *dataToCheck) {
-    return (Utils::distance(centerPoint, dataToCheck, Point::numAttributes) <= radius);
+bool HyperCircle::mergeCircles(vector<HyperCircle>& circles, Dataset& dataSet, const NeighborGraph& graph, const function<bool(int, long long)> &keepGoing) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return mergeCircles<decltype(dim)::value>(circles, dataSet, graph, keepGoing); });
+}
+
+template <int DIM>
+bool HyperCircle::mergeCircles(vector<HyperCircle>& circles, Dataset& dataSet, const NeighborGraph& graph, const function<bool(int, long long)> &keepGoing) {
+
+    long long distances = 0;
+    bool finished = true;
+
+    for (int idx = 0; idx < circles.size(); ++idx) {
+
+        // skip circles we've already eaten
+        if (circles[idx].centerPoint == nullptr)
+            continue;
+
+        if (keepGoing && !keepGoing(idx, distances)) {
+            finished = false;
+            break;
+        }
+
+        auto& c = circles[idx];
+        const auto list = graph.of(idx);
+        size_t next = 0;
+
+        // every later circle of our class, cheapest first, like mergeCircles sorts them. only if our list runs out.
+        vector<pair<float,int>> rest;
+        size_t restNext = 0;
+        bool expanded = false;
+
+        while (true) {
+
+            pair<float,int> cheapest;
+            if (!expanded) {
+
+                // skip the ones somebody before us already ate
+                while (next < list.size() && circles[list[next].circle].centerPoint == nullptr)
+                    ++next;
+
+                if (next < list.size()) {
+                    cheapest = {list[next].cost, list[next].circle};
+                    ++next;
+                } else if (graph.complete(idx)) {
+                    break;
+                } else {
+                    // we got through our whole list, and there are more circles of our class after us than it holds.
+                    // anything cheaper than the end of an exact list was on it, so what's left is dead or further away.
+                    // measure every later circle of our class that's still around, the slow way.
+                    expanded = true;
+                    for (int j = idx + 1; j < circles.size(); ++j)
+                        if (circles[j].centerPoint != nullptr && circles[j].classification == c.classification)
+                            rest.emplace_back(Utils::distance<DIM>(c.centerPoint, circles[j].centerPoint, dataSet.numAttributes) + circles[j].radius, j);
+                    sort(rest.begin(), rest.end());
+                    distances += rest.size();
+                    continue;
+                }
+            } else {
+                if (restNext == rest.size())
+                    break;
+                cheapest = rest[restNext++];
+            }
+
+            // from here it's the same as mergeCircles. anything already inside us is free, otherwise check the data.
+            const float newR2 = cheapest.first;
+            const int circleID = cheapest.second;
+            if (newR2 <= c.radius) {
+                circles[circleID].centerPoint = nullptr;
+                continue;
+            }
+
+            // a nearest enemy somebody worked out ahead of time (sharded generation does) settles it without the scan,
+            // unless we're too close to it to trust the rounding. then the scan gives the same answer it always has.
+            bool pure;
+            if (c.nearestEnemy >= 0.0f && newR2 < c.nearestEnemy * (1.0f - Utils::ABANDON_SLACK))
+                pure = true;
+            else if (c.nearestEnemy >= 0.0f && newR2 > c.nearestEnemy * (1.0f + Utils::ABANDON_SLACK))
+                pure = false;
+            else {
+                distances += dataSet.size();
+                pure = noEnemyWithin<DIM>(c, dataSet, newR2);
+            }
+
+            if (pure) {
+                c.radius = newR2;
+                circles[circleID].centerPoint = nullptr;
+            } else
+                break;
+        }
+    }
+
+    // single compaction pass. remove all null centerpoints HC's
+    circles.erase(remove_if(circles.begin(), circles.end(),[](const HyperCircle& hc){return hc.centerPoint == nullptr; }), circles.end());
+    return finished;
+}
+
+// generation works on one weighted point per distinct row. every duplicate would otherwise cost a full scan in each
+// pass, and get a circle with a radius of 0, since its nearest neighbor is sitting right on top of it.
+static Dataset collapseDuplicates(Dataset &dataSet) {
+    int conflicts = 0;
+    Dataset unique = dataSet.collapsed(&conflicts);
+
+    if (unique.size() < dataSet.size())
+        cout << "Collapsed " << dataSet.size() - unique.size() << " duplicate rows." << endl;
+    if (conflicts > 0)
+        cout << conflicts << " rows show up with more than one class. No circle can cover those." << endl;
+    return unique;
 }
 
 // function which makes us a list of circles given some pre processed dataSet
-vector<HyperCircle> HyperCircle::generateHyperCircles(vector<Point> &dataSet, int numClasses) {
+vector<HyperCircle> HyperCircle::generateHyperCircles(Dataset &dataSet) {
+    return generateHyperCircles(dataSet, Budget());
+}
+
+// a checkpoint is where generation got to, over the collapsed training set: which step we're on, the next row that step
+// gets to, and one radius per row. a row's radius is its circle's (as far as it has grown), or 0 if it has no circle,
+// either because its nearest neighbor is another class, or it got eaten, or it hasn't gotten to make one yet. the live
+// circles are always the rows with a radius, in row order, which is the order they'd be in anyway.
+static const int32_t CHECKPOINT_MAGIC = 0x4B434348;
+
+enum {
+    CREATING = 0,   // next is the first row that hasn't made its circle yet
+    MERGING = 1,    // next is the row of the first circle that hasn't had its turn to eat yet
+    MERGED = 2
+};
+
+// rows the nearest neighbor pass does between checking the budget
+#define CREATE_CHUNK 256
+
+// FNV-1a over the training set, so a checkpoint doesn't get resumed against different data
+static uint64_t fingerprintOf(const Dataset &dataSet) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&](uint32_t word) { hash = (hash ^ word) * 0x100000001b3ull; };
+
+    mix((uint32_t) dataSet.numAttributes);
+    mix((uint32_t) dataSet.size());
+    for (const Point &p : dataSet) {
+        for (int a = 0; a < dataSet.numAttributes; ++a)
+            mix(bit_cast<uint32_t>(p.location[a]));
+        mix((uint32_t) p.classification);
+        mix((uint32_t) p.weight);
+    }
+    return hash;
+}
+
+// written to fileName.tmp, then renamed over fileName, so getting killed halfway through never leaves a broken checkpoint
+static void saveCheckpoint(const string &fileName, uint64_t fingerprint, int32_t phase, int32_t next, const vector<float> &radii) {
+    const string temp = fileName + ".tmp";
+    {
+        ofstream out(temp, ios::binary);
+        const int32_t header[4] = {CHECKPOINT_MAGIC, phase, next, (int32_t) radii.size()};
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+        out.write(reinterpret_cast<const char*>(radii.data()), radii.size() * sizeof(float));
+        if (!out) {
+            cerr << "Failed to write checkpoint: " << temp << endl;
+            return;
+        }
+    }
+
+#ifdef _WIN32
+    // windows won't rename over a file that's already there
+    remove(fileName.c_str());
+#endif
+    if (rename(temp.c_str(), fileName.c_str()) != 0)
+        cerr << "Failed to write checkpoint: " << fileName << endl;
+}
+
+// false if there's no checkpoint, or it's from some other training set
+static bool loadCheckpoint(const string &fileName, uint64_t fingerprint, int32_t &phase, int32_t &next, vector<float> &radii) {
+    ifstream in(fileName, ios::binary);
+    if (!in.is_open())
+        return false;
+
+    int32_t header[4];
+    uint64_t theirs;
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    in.read(reinterpret_cast<char*>(&theirs), sizeof(theirs));
+    if (!in || header[0] != CHECKPOINT_MAGIC || header[3] != (int32_t) radii.size() || theirs != fingerprint) {
+        cout << "Checkpoint " << fileName << " is from a different training set, starting over." << endl;
+        return false;
+    }
+
+    vector<float> saved(radii.size());
+    in.read(reinterpret_cast<char*>(saved.data()), saved.size() * sizeof(float));
+    if (!in) {
+        cout << "Checkpoint " << fileName << " is truncated, starting over." << endl;
+        return false;
+    }
+
+    phase = header[1];
+    next = header[2];
+    radii = std::move(saved);
+    return true;
+}
+
+vector<HyperCircle> HyperCircle::generateHyperCircles(Dataset &dataSet, const Budget &budget) {
+
+    const auto began = chrono::steady_clock::now();
+    auto elapsed = [&]() { return chrono::duration<double>(chrono::steady_clock::now() - began).count(); };
+
+    Dataset unique = collapseDuplicates(dataSet);
+    const size_t n = unique.size();
+    const bool limited = budget.seconds > 0 || budget.distances > 0;
+    const bool checkpointing = !budget.checkpointFile.empty();
+
+    // distances worked out so far, counted the same way the budget is
+    long long spent = 0;
+
+    // whether we can work out more distances, and still have enough left to finish with numCircles circles. counting
+    // the points and dropping useless circles each measure every circle against every point. time goes by how fast
+    // the distances have been going so far.
+    auto affordable = [&](long long more, size_t numCircles) {
+        const long long needed = more + 2LL * (long long) numCircles * (long long) n;
+        if (budget.distances > 0 && spent + needed > budget.distances)
+            return false;
+        if (budget.seconds > 0) {
+            const double now = elapsed();
+            const double perDistance = spent > 0 ? now / spent : 0.0;
+            if (now + needed * perDistance > budget.seconds)
+                return false;
+        }
+        return true;
+    };
+
+    // which row each center is, for keeping track of where we are
+    unordered_map<const float*, int> rowOf;
+    if (limited || checkpointing)
+        for (int row = 0; row < n; ++row)
+            rowOf[unique[row].location] = row;
+
+    vector<float> radii(n, 0.0f);
+    int32_t phase = CREATING, next = 0;
+    const uint64_t fingerprint = checkpointing ? fingerprintOf(unique) : 0;
+    if (checkpointing && loadCheckpoint(budget.checkpointFile, fingerprint, phase, next, radii))
+        cout << "Resuming from checkpoint " << budget.checkpointFile << "." << endl;
+
+    // saves where we are. circles (if any) are the live circles from fromRow on, which have moved on from radii.
+    double lastSave = elapsed();
+    auto save = [&](const vector<HyperCircle> &circles, int fromRow) {
+        if (!checkpointing)
+            return;
+        if (!circles.empty()) {
+            fill(radii.begin() + fromRow, radii.end(), 0.0f);
+            for (const HyperCircle &c : circles)
+                if (c.centerPoint != nullptr)
+                    radii[rowOf[c.centerPoint]] = c.radius;
+        }
+        saveCheckpoint(budget.checkpointFile, fingerprint, phase, next, radii);
+        lastSave = elapsed();
+    };
+
+    // the circles of rows [from, to) which have a radius
+    auto circlesFrom = [&](int from, int to) {
+        vector<HyperCircle> circles;
+        for (int row = from; row < to; ++row)
+            if (radii[row] > 0.0f)
+                circles.emplace_back(radii[row], unique[row].location, unique[row].classification);
+        return circles;
+    };
+
+    // generate our initial list of circles. same as createCircles, but a chunk of rows at a time when there's a budget
+    // to keep an eye on, or checkpoints to save. no limits means one chunk.
+    const size_t chunk = limited || checkpointing ? CREATE_CHUNK : max<size_t>(n, 1);
+    size_t made = count_if(radii.begin(), radii.begin() + (phase == CREATING ? next : 0), [](float r) { return r > 0.0f; });
+    bool outOfBudget = false;
+
+    while (phase == CREATING && next < n) {
+        const size_t last = min(n, next + chunk);
+        if (limited && !affordable((long long) (last - next) * n, made + (last - next))) {
+            outOfBudget = true;
+            break;
+        }
+
+        Utils::withDimension(unique.numAttributes, [&](auto dim) {
+            #pragma omp parallel for if(Parallelism::choose(last - next, unique.size(), unique.numAttributes) != Parallelism::SERIAL)
+            for (int row = next; row < last; ++row) {
+                HyperCircle c(0.0f, unique[row].location, unique[row].classification);
+                c.findNearestNeighbor<decltype(dim)::value>(unique);
+                radii[row] = c.radius;
+            }
+        });
+
+        made += count_if(radii.begin() + next, radii.begin() + last, [](float r) { return r > 0.0f; });
+        spent += (long long) (last - next) * n;
+        next = (int32_t) last;
+
+        if (checkpointing && elapsed() - lastSave >= budget.checkpointEvery)
+            save({}, next);
+    }
+
+    if (phase == CREATING && !outOfBudget) {
+        phase = MERGING;
+        next = 0;
+    }
+    save({}, next);
+
+    vector<HyperCircle> circles;
+
+    if (phase == CREATING) {
+        // what we made so far stays as it is. the rest of the rows just go without circles.
+        circles = circlesFrom(0, next);
+        cout << "Out of budget after making circles for " << next << " of " << n << " rows." << endl;
+    } else if (phase == MERGING) {
+        cout << "Circles created...\nBeginning Merging." << endl;
+
+        // the circles before next already had their turn, and only ever eat circles after them, so they're done. the
+        // rest merge exactly like they would have if we never stopped.
+        const int mergeFrom = next;
+        circles = circlesFrom(0, mergeFrom);
+        vector<HyperCircle> rest = circlesFrom(mergeFrom, n);
+
+        // what building the graph costs: each circle against every later one of its class
+        long long graphCost = 0;
+        if (limited) {
+            vector<long long> perClass(unique.numClasses() + 1, 0);
+            for (const HyperCircle &c : rest)
+                graphCost += perClass[c.classification]++;
+        }
+
+        // merge our circles so that we can get larger circles. the graph hands each circle its cheapest candidates, so most
+        // of them never measure every other circle of their class.
+        bool finished = false;
+        if (!limited || affordable(graphCost, circles.size() + rest.size())) {
+            const NeighborGraph graph = NeighborGraph::exact(rest, unique.numAttributes, MERGE_NEIGHBORS);
+            spent += graphCost;
+            const long long before = spent;
+
+            function<bool(int, long long)> keepGoing = nullptr;
+            if (limited || checkpointing)
+                keepGoing = [&](int idx, long long distances) {
+                    spent = before + distances;
+                    next = rowOf[rest[idx].centerPoint];
+                    if (limited && !affordable(0, circles.size() + rest.size() - idx)) {
+                        save(rest, mergeFrom);
+                        return false;
+                    }
+                    if (checkpointing && elapsed() - lastSave >= budget.checkpointEvery)
+                        save(rest, mergeFrom);
+                    return true;
+                };
+
+            finished = mergeCircles(rest, unique, graph, keepGoing);
+        }
+
+        circles.insert(circles.end(), rest.begin(), rest.end());
+
+        if (finished) {
+            phase = MERGED;
+            save(circles, 0);
+            cout << "Circles merged...\nRemoving Circles" << endl;
+        } else
+            cout << "Out of budget while merging, at row " << next << " of " << n << "." << endl;
+    } else {
+        circles = circlesFrom(0, n);
+        cout << "Circles merged...\nRemoving Circles" << endl;
+    }
+
+    // circles inside other circles would get removed below anyway. this finds them without looking at any points.
+    pruneDominatedCircles(circles, unique);
+
+    // count how many points are in each circle.
+    countPointsInCircles(circles, unique);
+
+    // remove circles which don't uniquely classify any points
+    removeUselessCircles(circles, unique);
+
+    cout << "Useless Circles Removed...\nWe generated:\t" << circles.size() << " circles." << endl;
+
+    return circles;
+}
+
+// the same steps as generateHyperCircles, with row ids standing in for circles until the very end. only the survivors
+// get dense centers (out of dataSet.denseCopy), so nothing dense the size of the whole dataset ever gets made.
+// whenever one row gets measured against a lot of others, it gets scattered into a dense scratch row first, so each
+// distance only walks the other row's nonzeros (see SparseDataset::distanceTo).
+vector<HyperCircle> HyperCircle::generateHyperCircles(SparseDataset &dataSet) {
+
+    // one row per distinct row, like collapseDuplicates. everything below goes by position in rowOf.
+    vector<int> weights;
+    const vector<int> rowOf = dataSet.distinctRows(weights);
+    const int numRows = (int) rowOf.size();
+    if (numRows < dataSet.size())
+        cout << "Collapsed " << dataSet.size() - numRows << " duplicate rows." << endl;
+
+    vector<int> labels(numRows);
+    vector<float> norms(numRows);
+    vector<double> powerNorms(numRows);
+    for (int row = 0; row < numRows; ++row) {
+        labels[row] = dataSet.labels[rowOf[row]];
+        norms[row] = dataSet.norms[rowOf[row]];
+        powerNorms[row] = dataSet.powerNorms[rowOf[row]];
+    }
+
+    // what a distance costs here is how many nonzeros we walk, not how wide the rows are
+    const int width = max(1, (int) (dataSet.columns.size() / max(numRows, 1)));
 
-    numCirclesPerClass.clear();
-    numCirclesPerClass.resize(numClasses);
+    // each row's nearest neighbor. same ties as findNearestNeighbor: a tie with another class counts as another class.
+    vector<float> radius(numRows, 0.0f);
+    #pragma omp parallel if(Parallelism::choose(numRows, numRows, width) != Parallelism::SERIAL)
+    {
+        vector<float> dense(dataSet.numAttributes, 0.0f);
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int row = 0; row < numRows; ++row) {
+            dataSet.scatter(rowOf[row], dense.data());
+
+            float minDist = numeric_limits<float>::max();
+            int minClass = -1;
+            for (int p = 0; p < numRows; ++p) {
+                if (p == row || !dataSet.mightBeWithin(rowOf[p], norms[row], minDist))
+                    continue;
+
+                const float newDist = dataSet.distanceTo(rowOf[p], dense.data(), powerNorms[row]);
+                if (newDist < minDist) {
+                    minDist = newDist;
+                    minClass = labels[p];
+                } else if (newDist == minDist && minClass == labels[row])
+                    minClass = labels[p];
+            }
+
+            // the same row under another class is a distance of 0 away, which gives us no circle, same as the dense version
+            if (minClass == labels[row])
+                radius[row] = minDist;
+
+            dataSet.unscatter(rowOf[row], dense.data());
+        }
+    }
 
-    // generate our initial list of circles
-    vector<HyperCircle> circles = createCircles(dataSet);
+    vector<int> centers;
+    for (int row = 0; row < numRows; ++row)
+        if (radius[row] > 0.0f)
+            centers.push_back(row);
 
     cout << "Circles created...\nBeginning Merging." << endl;
 
-    // merge our circles so that we can get larger circles
-    mergeCircles(circles, dataSet);
+    // mergeCircles: each circle in turn eats the later circles of its class, cheapest first, until one would let a row of
+    // another class in
+    vector<float> dense(dataSet.numAttributes, 0.0f);
+    vector<char> eaten(centers.size(), 0);
+    for (int idx = 0; idx < centers.size(); ++idx) {
+        if (eaten[idx])
+            continue;
+
+        const int c = centers[idx];
+        dataSet.scatter(rowOf[c], dense.data());
+
+        vector<pair<float, int>> dists;
+        #pragma omp parallel if(Parallelism::intraQuery(centers.size() - idx, width))
+        {
+            vector<pair<float, int>> local;
+
+            #pragma omp for
+            for (int j = idx + 1; j < centers.size(); ++j)
+                if (!eaten[j] && labels[centers[j]] == labels[c])
+                    local.emplace_back(dataSet.distanceTo(rowOf[centers[j]], dense.data(), powerNorms[c]) + radius[centers[j]], j);
+
+            #pragma omp critical
+            dists.insert(dists.end(), local.begin(), local.end());
+        }
+        sort(dists.begin(), dists.end());
+
+        for (const auto &[newR2, j] : dists) {
+            if (newR2 > radius[c]) {
+                bool canMerge = true;
+                for (int p = 0; p < numRows && canMerge; ++p)
+                    canMerge = labels[p] == labels[c] || !dataSet.mightBeWithin(rowOf[p], norms[c], newR2) ||
+                               dataSet.distanceTo(rowOf[p], dense.data(), powerNorms[c]) > newR2;
+                if (!canMerge)
+                    break;
+                radius[c] = newR2;
+            }
+            eaten[j] = 1;
+        }
+
+        dataSet.unscatter(rowOf[c], dense.data());
+    }
+
+    vector<int> merged;
+    for (int idx = 0; idx < centers.size(); ++idx)
+        if (!eaten[idx])
+            merged.push_back(centers[idx]);
 
     cout << "Circles merged...\nRemoving Circles" << endl;
 
-    for (auto &circle : circles) {
+    // countPointsInCircles and removeUselessCircles together, a circle at a time: every row counts toward each circle it
+    // is in, and uniquely toward the biggest one of its own class (the first one, on ties, like removeUselessCircles).
+    vector<int> numPoints(merged.size(), 0);
+    vector<pair<float, int>> best(numRows, {0.0f, -1});
+    auto better = [](const pair<float, int> &a, const pair<float, int> &b) {
+        return a.second != -1 && (b.second == -1 || a.first > b.first || (a.first == b.first && a.second < b.second));
+    };
 
-        int insideCount = 0;
+    #pragma omp parallel if(Parallelism::choose(merged.size(), numRows, width) != Parallelism::SERIAL)
+    {
+        vector<float> local(dataSet.numAttributes, 0.0f);
+        vector<pair<float, int>> localBest(numRows, {0.0f, -1});
 
-        // do a reduction to efficiently compute the size of the circle in terms of point count
-        // we do the reduction because we are computing a ton of euclidean distances in the inside function.
-        #pragma omp parallel for reduction(+ : insideCount)
-        for (auto & point : dataSet) {
+        #pragma omp for schedule(dynamic, 16)
+        for (int m = 0; m < merged.size(); ++m) {
+            const int c = merged[m];
+            dataSet.scatter(rowOf[c], local.data());
 
-            // if this point is inside, increment numPoints
-            if (circle.insideCircle(point.location)) {
-                insideCount++;
+            for (int p = 0; p < numRows; ++p) {
+                if (!dataSet.mightBeWithin(rowOf[p], norms[c], radius[c]) || dataSet.distanceTo(rowOf[p], local.data(), powerNorms[c]) > radius[c])
+                    continue;
+                numPoints[m] += weights[p];
+                if (labels[p] == labels[c] && better({radius[c], m}, localBest[p]))
+                    localBest[p] = {radius[c], m};
             }
+
+            dataSet.unscatter(rowOf[c], local.data());
         }
-        // update the value now that the for loop is over
-        circle.numPoints = insideCount;
+
+        #pragma omp critical
+        for (int p = 0; p < numRows; ++p)
+            if (better(localBest[p], best[p]))
+                best[p] = localBest[p];
     }
 
-    // remove circles which don't uniquely classify any points
-    removeUselessCircles(circles, dataSet);
+    vector<char> useful(merged.size(), 0);
+    for (const auto &[r, m] : best)
+        if (m != -1)
+            useful[m] = 1;
+
+    vector<int> kept, keptRows;
+    vector<int> keptPoints;
+    for (int m = 0; m < merged.size(); ++m) {
+        if (useful[m]) {
+            kept.push_back(rowOf[merged[m]]);
+            keptRows.push_back(merged[m]);
+            keptPoints.push_back(numPoints[m]);
+        }
+    }
 
-    cout << "Useless Circles Removed...\nWe generated:\t" << circles.size() << " circles." << endl;
+    // now the survivors get real centers
+    float *centerRows = dataSet.denseCopy(kept);
+    vector<HyperCircle> circles;
+    circles.reserve(kept.size());
+    for (int i = 0; i < kept.size(); ++i) {
+        circles.emplace_back(radius[keptRows[i]], centerRows + (size_t) i * dataSet.numAttributes, labels[keptRows[i]]);
+        circles.back().numPoints = keptPoints[i];
+    }
 
-    // get our count of how many circles per class
-    numCirclesPerClass.resize(numClasses);
-    for (auto &circle : circles)
-        numCirclesPerClass[circle.classification]++;
+    cout << "Useless Circles Removed...\nWe generated:\t" << circles.size() << " circles." << endl;
 
     return circles;
 }
 
 // generates circles based on how big their radius can possible be of pure classification. then we simplify by removing useless circles.
-vector<HyperCircle> HyperCircle::generateMaxDistanceBasedHyperCircles(vector<Point> &dataSet, int numClasses) {
+vector<HyperCircle> HyperCircle::generateMaxDistanceBasedHyperCircles(Dataset &dataSet) {
 
-    numCirclesPerClass.clear();
-    numCirclesPerClass.resize(numClasses);
+    Dataset unique = collapseDuplicates(dataSet);
 
-    vector<HyperCircle> circles(dataSet.size());
+    vector<HyperCircle> circles(unique.size());
 
     // Parallel HC creation.
     #pragma omp parallel for
-    for (int i = 0; i < dataSet.size(); ++i) {
-        Point &p = dataSet[i];
+    for (int i = 0; i < unique.size(); ++i) {
+        Point &p = unique[i];
         circles[i] = HyperCircle(0.0f, p.location, p.classification);
     }
 
-    #pragma omp parallel for
-    for (int i = 0; i < circles.size(); ++i) {
-        circles[i].findMaxDistance(dataSet);
-    }
+    Utils::withDimension(unique.numAttributes, [&](auto dim) {
+        #pragma omp parallel for if(Parallelism::choose(circles.size(), unique.size(), unique.numAttributes) != Parallelism::SERIAL)
+        for (int i = 0; i < circles.size(); ++i) {
+            circles[i].findMaxDistance<decltype(dim)::value>(unique);
+        }
+    });
+
+    // circles inside other circles would get removed below anyway. this finds them without looking at any points.
+    pruneDominatedCircles(circles, unique);
 
     // count how many points are in each circle.
-    for (auto &circle : circles) {
+    countPointsInCircles(circles, unique);
+
+    // remove circles which don't uniquely classify any points
+    removeUselessCircles(circles, unique);
+
+    cout << "Useless Circles Removed...\nWe generated:\t" << circles.size() << " circles." << endl;
+
+    return circles;
+}
+
+// builds circles from samples instead of all the data, checking them against all of it as we go.
+vector<HyperCircle> HyperCircle::generateSampledHyperCircles(Dataset &dataSet, size_t sampleSize, int maxRounds, unsigned seed) {
+
+    Dataset unique = collapseDuplicates(dataSet);
+    const size_t total = unique.size();
+    sampleSize = max<size_t>(sampleSize, 1);
+
+    mt19937 rng(seed);
+    vector<char> covered(total, 0);
+    // points which have been in a sample already. if one of those is still uncovered its circle didn't work out, and
+    // sampling it again would just build the same circle.
+    vector<char> tried(total, 0);
+    vector<HyperCircle> circles;
+
+    for (int round = 0; round < maxRounds; ++round) {
+
+        // everything we could still sample, by class
+        map<int, vector<int>> byClass;
+        size_t left = 0;
+        for (int p = 0; p < total; ++p) {
+            if (!covered[p] && !tried[p]) {
+                byClass[unique[p].classification].push_back(p);
+                left++;
+            }
+        }
+        if (left == 0)
+            break;
+
+        // take the same fraction of every class, at least one each
+        const double fraction = min(1.0, (double) sampleSize / (double) left);
+        Dataset sample = unique.emptyLike();
+        for (auto &[cls, members] : byClass) {
+            shuffle(members.begin(), members.end(), rng);
+            const size_t take = max<size_t>(1, (size_t) ceil(fraction * members.size()));
+            for (size_t m = 0; m < min(take, members.size()); ++m) {
+                sample.push_back(unique[members[m]]);
+                tried[members[m]] = 1;
+            }
+        }
+
+        // the normal generator, just on the sample. these are only pure against the sample so far.
+        vector<HyperCircle> fresh = createCircles(sample);
+        mergeCircles(fresh, sample, NeighborGraph::exact(fresh, sample.numAttributes, MERGE_NEIGHBORS));
+
+        // one pass over everything fixes that, and marks what the survivors cover
+        Utils::withDimension(unique.numAttributes, [&](auto dim) { verifyAgainst<decltype(dim)::value>(fresh, unique, covered); });
+        circles.insert(circles.end(), fresh.begin(), fresh.end());
+
+        const size_t coveredCount = count(covered.begin(), covered.end(), 1);
+        cout << "Round " << round + 1 << ": sampled " << sample.size() << " points, " << circles.size() << " circles cover "
+             << coveredCount << " of " << total << " points." << endl;
+    }
+
+    // same clean up as the other generators, against all the data
+    pruneDominatedCircles(circles, unique);
+    countPointsInCircles(circles, unique);
+    removeUselessCircles(circles, unique);
+
+    cout << "Useless Circles Removed...\nWe generated:\t" << circles.size() << " circles." << endl;
+
+    return circles;
+}
+
+// shrinks each circle to just under its nearest enemy in dataSet if one is inside it (dropping it if that leaves
+// nothing), and sets covered for every point a surviving circle covers. streams through the points in blocks, so each
+// block stays in cache while every circle looks at it.
+template <int DIM>
+void HyperCircle::verifyAgainst(vector<HyperCircle> &circles, Dataset &dataSet, vector<char> &covered) {
+
+    const int n = dataSet.numAttributes;
+    const size_t BLOCK = 1024;
+    const int policy = Parallelism::choose(circles.size(), dataSet.size(), n);
+
+    for (auto &c : circles)
+        c.nearestEnemy = numeric_limits<float>::max();
+
+    for (size_t start = 0; start < dataSet.size(); start += BLOCK) {
+        const size_t end = min(dataSet.size(), start + BLOCK);
+
+        #pragma omp parallel for schedule(dynamic, 16) if(policy != Parallelism::SERIAL)
+        for (int c = 0; c < circles.size(); ++c) {
+            auto &circle = circles[c];
+            for (size_t p = start; p < end; ++p) {
+                if (dataSet[p].classification != circle.classification)
+                    circle.nearestEnemy = min(circle.nearestEnemy, Utils::boundedDistance<DIM>(dataSet[p].location, circle.centerPoint, n, circle.nearestEnemy));
+            }
+        }
+    }
+
+    // pull the radius in to just under the nearest enemy. not just one float under, since with fast math the same
+    // distance can come out a rounding different somewhere else, so we leave the same slack the early abandon does.
+    for (auto &c : circles) {
+        if (c.nearestEnemy <= c.radius)
+            c.radius = c.nearestEnemy * (1.0f - Utils::ABANDON_SLACK);
+    }
+    circles.erase(remove_if(circles.begin(), circles.end(), [](const HyperCircle &c) { return c.radius <= 0.0f; }), circles.end());
+
+    #pragma omp parallel for schedule(static) if(Parallelism::choose(dataSet.size(), circles.size(), n) != Parallelism::SERIAL)
+    for (long long p = 0; p < (long long) dataSet.size(); ++p) {
+        if (covered[p])
+            continue;
+        for (auto &c : circles) {
+            if (c.classification == dataSet[p].classification && c.insideCircle<DIM>(dataSet[p].location, n)) {
+                covered[p] = 1;
+                break;
+            }
+        }
+    }
+}
+
+// sets numPoints on every circle to how many training points fall inside it.
+// the policy tells us whether to give each thread whole circles, or split every circle's point scan across the threads.
+void HyperCircle::countPointsInCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return countPointsInCircles<decltype(dim)::value>(circles, dataSet); });
+}
+
+template <int DIM>
+void HyperCircle::countPointsInCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
+
+    const int policy = Parallelism::choose(circles.size(), dataSet.size(), dataSet.numAttributes);
+
+    #pragma omp parallel for schedule(dynamic, 16) if(policy == Parallelism::INTER_QUERY)
+    for (int c = 0; c < circles.size(); ++c) {
+        auto &circle = circles[c];
 
         int insideCount = 0;
         // do a reduction to efficiently compute the size of the circle in terms of point count
         // we do the reduction because we are computing a ton of euclidean distances in the inside function.
-        #pragma omp parallel for reduction(+ : insideCount)
+        #pragma omp parallel for reduction(+ : insideCount) if(policy == Parallelism::INTRA_QUERY)
         for (int p = 0; p < dataSet.size(); ++p) {
 
             // if this point is inside, increment numPoints
-            if (circle.insideCircle(dataSet[p].location)) {
-                insideCount++;
+            if (circle.insideCircle<DIM>(dataSet[p].location, dataSet.numAttributes)) {
+                insideCount += dataSet[p].weight;
             }
         }
         // update the value now that the for loop is over
         circle.numPoints = insideCount;
     }
+}
 
-    // remove circles which don't uniquely classify any points
-    removeUselessCircles(circles, dataSet);
+// simplification. removes circles which classify no points uniquely.
+void HyperCircle::removeUselessCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return removeUselessCircles<decltype(dim)::value>(circles, dataSet); });
+}
 
-    cout << "Useless Circles Removed...\nWe generated:\t" << circles.size() << " circles." << endl;
+template <int DIM>
+void HyperCircle::removeUselessCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
+    // how many points each circle is the best circle for
+    vector<int> circlePointCounts = countBestCircles<DIM>(circles, dataSet);
 
-    // get our count of how many circles per class
-    numCirclesPerClass.resize(numClasses);
-    for (auto &circle : circles)
-        numCirclesPerClass[circle.classification]++;
+    // make a new list, and move in just the HC's which are able to uniquely classify training points.
+    vector<HyperCircle> filtered;
+    filtered.reserve(circles.size());
+    for (int i = 0; i < circles.size(); ++i) {
+        if (circlePointCounts[i] != 0)
+            filtered.push_back(std::move(circles[i]));
+    }
+    circles = std::move(filtered);
+}
 
-    return circles;
+vector<int> HyperCircle::countBestCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return countBestCircles<decltype(dim)::value>(circles, dataSet); });
 }
 
-// simplification. removes circles which classify no points uniquely.
-void HyperCircle::removeUselessCircles(vector<HyperCircle> &circles, vector<Point> &dataSet) {
+template <int DIM>
+vector<int> HyperCircle::countBestCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
     // vector to track how many points each circle had
     vector<int> circlePointCounts(circles.size(), 0);
 
 
-    #pragma omp parallel
+    #pragma omp parallel if(Parallelism::choose(dataSet.size(), circles.size(), dataSet.numAttributes) != Parallelism::SERIAL)
     {
         vector<int> localCounts(circles.size(), 0);   // private
 
@@ -333,7 +1036,7 @@ void HyperCircle::removeUselessCircles(vector<HyperCircle> &circles, vector<Poin
                 if (c.classification != p.classification)
                     continue;
 
-                if (c.insideCircle(p.location) && c.radius > biggestRadius) {
+                if (c.insideCircle<DIM>(p.location, dataSet.numAttributes) && c.radius > biggestRadius) {
                     biggestRadius = c.radius;
                     bestCircleIndex = circ;
                 }
@@ -350,201 +1053,419 @@ void HyperCircle::removeUselessCircles(vector<HyperCircle> &circles, vector<Poin
 
     }// end pragma
 
-    // make a new list, and move in just the HC's which are able to uniquely classify training points.
-    vector<HyperCircle> filtered;
-    filtered.reserve(circles.size());
-    for (int i = 0; i < circles.size(); ++i) {
-        if (circlePointCounts[i] != 0)
-            filtered.push_back(std::move(circles[i]));
-    }
-    circles = std::move(filtered);
+    return circlePointCounts;
 }
 
-int HyperCircle::classifyPoint(vector<HyperCircle> &circles, vector<Point> &train, float *dataToCheck, int classificationMode, int subMode,  int numClasses, int k = 5) {
-
-    // here we use our different classification options.
-    // first option is to just take whichever class we find our point in the most.
-    // we could also use the average density of each circle, so number of points / area on average of each circle
-    // another option is to use the total point count of each circle our point fell into
-    int prediction = -1;
-    switch (classificationMode) {
-
-        case USE_CIRCLES: {
-
-            vector<float> votes(numClasses, 0.0f);
-
-            // smallest circles radius and class
-            pair<float, int> smallestCircle {numeric_limits<float>::max(), -1};
-
-            for (int i = 0; i < circles.size(); i++) {
-                if (circles[i].insideCircle(dataToCheck)) {
-
-                    // determine which style voting
-                    switch (subMode) {
-
-                        // regular vote, we just use the count of circles we're inside by class
-                        case SIMPLE_MAJORITY: {
-                            votes[circles[i].classification] += 1.0f;
-                            break;
-                        }
-
-                        // vote with the amount of points in the circle.
-                        case COUNT_VOTE: {
-                            votes[circles[i].classification] += circles[i].numPoints;
-                            break;
-                        }
-
-
-                        case DENSITY_VOTE: {
-                            // simple count/radius
-                            float r = max(circles[i].radius, 1e-6f);
-                            float weight = circles[i].numPoints / r;
-                            votes[circles[i].classification] += weight;
-                            break;
-                        }
-
-                        case DISTANCE_VOTE: {
-                            // count / distance from the center
-                            float dist = Utils::distance(dataToCheck, circles[i].centerPoint, Point::numAttributes);
-                            float weight = circles[i].numPoints / (dist + 1e-4f);
-                            votes[circles[i].classification] += weight;
-                            break;
-                        }
-
-                        case PER_CLASS_VOTE: {
-                            // we add 1 / num circles of this class as a vote.
-                            votes[circles[i].classification] += 1.0f / numCirclesPerClass[circles[i].classification];
-                            break;
-                        }
-
-                        case SMALLEST_CIRCLE: {
-                            // get our distance.
-                            float distance = Utils::distance(circles[i].centerPoint, dataToCheck, Point::numAttributes);
-
-                            // if we're inside, and this is smallest circle, we take this circle's classification.
-                            if (distance < smallestCircle.first) {
-                                smallestCircle.first = distance;
-                                smallestCircle.second = i;
-                            }
-                            break;
-                        }
-
-                        // shut up the compiler
-                        default: {
-                            throw new runtime_error("Unknown classification mode");
-                        }
-                    } // voting switch
-                } // inside
-            } // circles loop
-
-            // if we were looking for smallest circle, we can just return it from here.
-            if (subMode == SMALLEST_CIRCLE) {
-                if (smallestCircle.second == -1) {
-                    return -1; // No circle contained the point
-                }
-                return circles[smallestCircle.second].classification;
-            }
+// finds circles which are inside another circle of the same class, and throws them out.
+void HyperCircle::pruneDominatedCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return pruneDominatedCircles<decltype(dim)::value>(circles, dataSet); });
+}
 
-            // start maxVotes at 0. that way if no votes are cast, we know that we have to classify with the fallback mechanisms
-            float maxVotes = 0.0f;
-            for (int cls = 0; cls < numClasses; ++cls) {
-                if (votes[cls] > maxVotes) {
-                    maxVotes = votes[cls];
-                    prediction = cls;
+template <int DIM>
+void HyperCircle::pruneDominatedCircles(vector<HyperCircle> &circles, Dataset &dataSet) {
+
+    const int n = dataSet.numAttributes;
+    if (circles.size() < 2 || n == 0)
+        return;
+
+    // the grid only uses a few attributes. the distance over some of the attributes is never more than the distance over
+    // all of them (for every NORM), so centers a couple cells apart there really are that far apart. we grid on the
+    // attributes the centers are most spread out along, since those split them up the best.
+    const int gridDims = min(n, 3);
+    vector<pair<float, int>> spread(n);
+    for (int a = 0; a < n; ++a) {
+        float low = numeric_limits<float>::max(), high = numeric_limits<float>::lowest();
+        for (auto &c : circles) {
+            low = min(low, c.centerPoint[a]);
+            high = max(high, c.centerPoint[a]);
+        }
+        spread[a] = {high - low, -a};
+    }
+    partial_sort(spread.begin(), spread.begin() + gridDims, spread.end(), greater<>());
+    int gridAttributes[3];
+    for (int g = 0; g < gridDims; ++g)
+        gridAttributes[g] = -spread[g].second;
+
+    // biggest first, so anything which could contain a circle is already in the grid by the time we get to it.
+    // anything inside a circle we threw out is also inside whatever that circle was inside, so only kept ones matter.
+    vector<int> order(circles.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return circles[a].radius > circles[b].radius; });
+
+    // level L has cells biggest / 2^L wide, and holds the circles whose radius fits in a cell there but not a level
+    // deeper. a circle containing us has its center within its radius of ours, so on its own level it is in our cell or
+    // one right next to it.
+    const int MAX_LEVEL = 24;
+    const float biggest = circles[order[0]].radius > 0.0f ? circles[order[0]].radius : 1.0f;
+    auto levelOf = [&](float radius) {
+        int level = 0;
+        while (level < MAX_LEVEL && ldexpf(biggest, -(level + 1)) >= radius)
+            ++level;
+        return level;
+    };
+
+    auto cellKey = [&](int classification, int level, const int64_t *cell) {
+        uint64_t key = 0x9E3779B97F4A7C15ull * (uint64_t) (classification + 1) + (uint64_t) level;
+        for (int g = 0; g < gridDims; ++g)
+            key ^= (uint64_t) cell[g] + 0x9E3779B97F4A7C15ull + (key << 6) + (key >> 2);
+        return key;
+    };
+
+    unordered_map<uint64_t, vector<int>> grid;
+    grid.reserve(circles.size());
+    vector<char> levelUsed(MAX_LEVEL + 1, 0);
+    vector<char> dominated(circles.size(), 0);
+
+    int neighbors = 1;
+    for (int g = 0; g < gridDims; ++g)
+        neighbors *= 3;
+
+    for (int j : order) {
+        const auto &circle = circles[j];
+        bool inside = false;
+
+        // levels whose cells are smaller than us only hold circles smaller than us
+        for (int level = 0; level <= MAX_LEVEL && !inside; ++level) {
+            const float cellSize = ldexpf(biggest, -level);
+            if (cellSize < circle.radius)
+                break;
+            if (!levelUsed[level])
+                continue;
+
+            int64_t home[3], cell[3];
+            for (int g = 0; g < gridDims; ++g)
+                home[g] = (int64_t) floorf(circle.centerPoint[gridAttributes[g]] / cellSize);
+
+            for (int neighbor = 0; neighbor < neighbors && !inside; ++neighbor) {
+                int which = neighbor;
+                for (int g = 0; g < gridDims; ++g, which /= 3)
+                    cell[g] = home[g] + which % 3 - 1;
+
+                auto found = grid.find(cellKey(circle.classification, level, cell));
+                if (found == grid.end())
+                    continue;
+                for (int i : found->second) {
+                    if (Utils::distance<DIM>(circles[i].centerPoint, circle.centerPoint, n) + circle.radius <= circles[i].radius) {
+                        inside = true;
+                        break;
+                    }
                 }
             }
-
-            // end of using circles case.
-            break;
         }
 
-        // standard knn algorithm
-        case REGULAR_KNN: {
-            prediction = regularKNN(train, dataToCheck, k, numClasses);
-            break;
+        if (inside) {
+            dominated[j] = 1;
+            continue;
         }
 
-        // k nearest HC's by radius
-        case K_NEAREST_CIRCLES: {
-            prediction = kNearestCircle(circles, dataToCheck, k, numClasses);
-            break;
-        }
+        const int level = levelOf(circle.radius);
+        const float cellSize = ldexpf(biggest, -level);
+        int64_t cell[3];
+        for (int g = 0; g < gridDims; ++g)
+            cell[g] = (int64_t) floorf(circle.centerPoint[gridAttributes[g]] / cellSize);
+        grid[cellKey(circle.classification, level, cell)].push_back(j);
+        levelUsed[level] = 1;
+    }
 
-        // k nearest HC's by distance / radius. this way we know relatively how far outside a circles radius it was.
-        case K_NEAREST_RATIOS: {
-            prediction = kNearestCircleRatio(circles, dataToCheck, k, numClasses);
-            break;
-        }
+    // keep the survivors in the order they were in
+    vector<HyperCircle> kept;
+    kept.reserve(circles.size());
+    for (int c = 0; c < circles.size(); ++c)
+        if (!dominated[c])
+            kept.push_back(std::move(circles[c]));
+    circles = std::move(kept);
+}
+
+void HyperCircle::coverCircles(vector<HyperCircle> &circles, Dataset &dataSet, int maxCircles) {
+
+    // a circle inside another covers nothing the bigger one doesn't, so there's no point building its bitset
+    pruneDominatedCircles(circles, dataSet);
 
-        default:{}
+    CoverageMatrix coverage(circles, dataSet);
+    coverCircles(circles, dataSet, coverage, maxCircles);
+}
+
+void HyperCircle::coverCircles(vector<HyperCircle> &circles, Dataset &dataSet, const CoverageMatrix &coverage, int maxCircles) {
+    vector<int> taken = coverage.greedyCover(maxCircles);
+
+    // keep them in the order they were generated in, not the order the cover picked them
+    sort(taken.begin(), taken.end());
+
+    vector<HyperCircle> kept;
+    kept.reserve(taken.size());
+    for (int c : taken) {
+        kept.push_back(std::move(circles[c]));
+        kept.back().numPoints = 0;
+        coverage.forEachPoint(c, [&](size_t p) { kept.back().numPoints += dataSet[p].weight; });
     }
+    circles = std::move(kept);
+}
 
-    // fallback mechanism
-    return prediction;
+// incremental version of generation, for when more labeled points show up after the circles are built.
+void HyperCircle::updateHyperCircles(vector<HyperCircle> &circles, Dataset &dataSet, const Dataset &newPoints) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return updateHyperCircles<decltype(dim)::value>(circles, dataSet, newPoints); });
 }
 
-int HyperCircle::regularKNN(vector<Point> &dataSet, float *point, int k, int numClasses) {
+template <int DIM>
+void HyperCircle::updateHyperCircles(vector<HyperCircle> &circles, Dataset &dataSet, const Dataset &newPoints) {
+
+    const int n = dataSet.numAttributes;
+    const size_t oldSize = dataSet.size();
+    const int oldCircles = (int) circles.size();
+    dataSet.append(newPoints);
+
+    const int policy = Parallelism::choose(circles.size(), dataSet.size(), n);
+    constexpr float FAR = numeric_limits<float>::max();
+
+    // how far each circle reached before we touched it. the points it let go of, and the circles which might have lost
+    // points to it, are all within this.
+    vector<float> reach(oldCircles);
+    vector<const float *> oldCenter(oldCircles);
+    vector<char> shrunk(oldCircles, 0);
+
+    // whether circle can reach out to r with no enemy inside it. its nearest enemy settles that, unless r is too close
+    // to it to trust the rounding (same as the merge), and then we check the data like the merge does.
+    auto pureOut = [&](const HyperCircle &circle, float r) {
+        if (r < circle.nearestEnemy * (1.0f - Utils::ABANDON_SLACK))
+            return true;
+        if (r > circle.nearestEnemy * (1.0f + Utils::ABANDON_SLACK))
+            return false;
+        return noEnemyWithin<DIM>(circle, dataSet, r);
+    };
+
+    // bring every nearest enemy up to date. circles which have never had one worked out look at everything, the rest
+    // only need the new points. an enemy at or inside our radius means we aren't pure anymore.
+    #pragma omp parallel for schedule(dynamic, 16) if(policy != Parallelism::SERIAL)
+    for (int c = 0; c < oldCircles; ++c) {
+        auto &circle = circles[c];
+        reach[c] = circle.radius;
+        oldCenter[c] = circle.centerPoint;
+
+        float oldEnemy = circle.nearestEnemy < 0.0f ? FAR : circle.nearestEnemy;
+        if (circle.nearestEnemy < 0.0f) {
+            for (size_t p = 0; p < oldSize; ++p)
+                if (dataSet[p].classification != circle.classification)
+                    oldEnemy = min(oldEnemy, Utils::boundedDistance<DIM>(dataSet[p].location, circle.centerPoint, n, oldEnemy));
+        }
 
-    vector<pair<float, int>> distances(dataSet.size());
+        float newEnemy = FAR;
+        for (size_t p = oldSize; p < dataSet.size(); ++p)
+            if (dataSet[p].classification != circle.classification)
+                newEnemy = min(newEnemy, Utils::boundedDistance<DIM>(dataSet[p].location, circle.centerPoint, n, newEnemy));
 
-    #pragma omp parallel for
-    for (int dp = 0; dp < dataSet.size(); ++dp) {
-        distances[dp] = {Utils::distance(dataSet[dp].location, point, Point::numAttributes), dataSet[dp].classification};
+        circle.nearestEnemy = min(oldEnemy, newEnemy);
+        shrunk[c] = !pureOut(circle, circle.radius);
     }
 
-    // sort up to kth element. clamping if needed
-    if (k > distances.size())
-        k = distances.size();
+    // shrink the broken circles to the furthest point of our own class which is still closer than any enemy, same as
+    // findMaxDistance would. if that is only our own center, the circle is gone.
+    #pragma omp parallel for schedule(dynamic, 1) if(policy != Parallelism::SERIAL)
+    for (int c = 0; c < oldCircles; ++c) {
+        if (!shrunk[c])
+            continue;
+        auto &circle = circles[c];
+
+        // points clearly closer than the enemy are fine. the ones too close to it to call get checked against the
+        // data, furthest first, and only if they'd beat what we have.
+        float furthest = 0.0f;
+        vector<float> tooClose;
+        for (auto &p : dataSet) {
+            if (p.classification != circle.classification)
+                continue;
+            const float d = Utils::distance<DIM>(p.location, circle.centerPoint, n);
+            if (d < circle.nearestEnemy * (1.0f - Utils::ABANDON_SLACK))
+                furthest = max(furthest, d);
+            else if (d <= circle.nearestEnemy * (1.0f + Utils::ABANDON_SLACK))
+                tooClose.push_back(d);
+        }
+        sort(tooClose.begin(), tooClose.end(), greater<float>());
+        for (float d : tooClose) {
+            if (d <= furthest)
+                break;
+            if (noEnemyWithin<DIM>(circle, dataSet, d)) {
+                furthest = d;
+                break;
+            }
+        }
+        circle.radius = furthest;
+        if (furthest == 0.0f)
+            circle.centerPoint = nullptr;
+    }
 
-    nth_element(distances.begin(),distances.begin() + k, distances.end(),[](const auto& a, const auto& b){ return a.first < b.first; });
+    // old points a shrunk circle used to cover, which nothing covers anymore. they get new circles like the new points.
+    vector<char> orphaned(oldSize, 0);
+    #pragma omp parallel for schedule(static) if(policy != Parallelism::SERIAL)
+    for (long long p = 0; p < (long long) oldSize; ++p) {
+        auto &point = dataSet[p];
+
+        bool lost = false;
+        for (int c = 0; c < oldCircles && !lost; ++c)
+            lost = shrunk[c] && circles[c].classification == point.classification
+                   && Utils::withinRadius<DIM>(point.location, oldCenter[c], n, reach[c])
+                   && (!circles[c].centerPoint || !circles[c].insideCircle<DIM>(point.location, n));
+        if (!lost)
+            continue;
 
-    // vote. weighting by the 1/distance.
-    vector<float> votes(numClasses, 0.0f);
-    for (int i = 0; i < k; ++i)
-        votes[distances[i].second] += (1 / distances[i].first);
+        bool covered = false;
+        for (int c = 0; c < oldCircles && !covered; ++c)
+            covered = circles[c].centerPoint && circles[c].classification == point.classification && circles[c].insideCircle<DIM>(point.location, n);
+        orphaned[p] = !covered;
+    }
 
-    // return our best class by finding max element
-    return distance(votes.begin(),max_element(votes.begin(), votes.end()));
-}
+    // the new points, and the orphans, get circles the same way createCircles makes them, against everything.
+    vector<HyperCircle> fresh;
+    for (size_t p = 0; p < dataSet.size(); ++p)
+        if (p >= oldSize || orphaned[p])
+            fresh.emplace_back(0.0f, dataSet[p].location, dataSet[p].classification);
+
+    #pragma omp parallel for if(Parallelism::choose(fresh.size(), dataSet.size(), n) != Parallelism::SERIAL)
+    for (int i = 0; i < fresh.size(); ++i)
+        fresh[i].findNearestNeighbor<DIM>(dataSet);
+    fresh.erase(remove_if(fresh.begin(), fresh.end(), [](const HyperCircle &c) { return c.radius == 0.0f; }), fresh.end());
+
+    // let an existing circle eat each new one if it can. growing only has to stay under its nearest enemy, so unlike
+    // mergeCircles this doesn't scan the data. we take whichever circle has to grow the least.
+    vector<char> grown(oldCircles, 0);
+    for (auto &f : fresh) {
+        int best = -1;
+        float bestGrowth = FAR, bestNeeded = 0.0f;
+        for (int c = 0; c < oldCircles; ++c) {
+            auto &circle = circles[c];
+            if (!circle.centerPoint || circle.classification != f.classification)
+                continue;
 
-int HyperCircle::kNearestCircle(vector<HyperCircle> &circles, float *point, int k, int numClasses) {
+            const float needed = Utils::distance<DIM>(circle.centerPoint, f.centerPoint, n) + f.radius;
+            const float growth = max(needed - circle.radius, 0.0f);
+            if (growth >= bestGrowth || (growth > 0.0f && !pureOut(circle, needed)))
+                continue;
+            bestGrowth = growth;
+            bestNeeded = needed;
+            best = c;
+            if (growth == 0.0f)
+                break;
+        }
+        if (best == -1)
+            continue;
 
-    vector<pair<float, int>> distances(circles.size());
+        // straight to what we checked, since radius + growth can round past it
+        if (bestGrowth > 0.0f) {
+            circles[best].radius = bestNeeded;
+            grown[best] = 1;
+        }
+        f.centerPoint = nullptr;
+    }
+    fresh.erase(remove_if(fresh.begin(), fresh.end(), [](const HyperCircle &c) { return c.centerPoint == nullptr; }), fresh.end());
+
+    // whatever is left merges with each other like normal, then works out its own nearest enemy for next time.
+    mergeCircles<DIM>(fresh, dataSet);
+    #pragma omp parallel for schedule(dynamic, 16) if(Parallelism::choose(fresh.size(), dataSet.size(), n) != Parallelism::SERIAL)
+    for (int i = 0; i < fresh.size(); ++i) {
+        float enemy = FAR;
+        for (auto &p : dataSet)
+            if (p.classification != fresh[i].classification)
+                enemy = min(enemy, Utils::boundedDistance<DIM>(p.location, fresh[i].centerPoint, n, enemy));
+        fresh[i].nearestEnemy = enemy;
+    }
 
-    #pragma omp parallel for
-    for (int c = 0; c < circles.size(); ++c) {
-        // save our distance and this circles class
-        distances[c] = {Utils::distance(circles[c].centerPoint, point, Point::numAttributes), circles[c].classification};
+    // put it all back together. changed circles are the ones whose counts and usefulness we have to redo, and every
+    // change (including circles which went away) remembers how far it reached, for working out who it could affect.
+    struct Change {
+        const float *center;
+        float reach;
+        int classification;
+    };
+    vector<Change> changes;
+    vector<HyperCircle> updated;
+    vector<char> changed;
+    updated.reserve(circles.size() + fresh.size());
+    for (int c = 0; c < oldCircles; ++c) {
+        if (shrunk[c] || grown[c])
+            changes.push_back({oldCenter[c], max(reach[c], circles[c].radius), circles[c].classification});
+        if (circles[c].centerPoint) {
+            updated.push_back(circles[c]);
+            changed.push_back(shrunk[c] || grown[c]);
+        }
+    }
+    for (auto &f : fresh) {
+        changes.push_back({f.centerPoint, f.radius, f.classification});
+        updated.push_back(f);
+        changed.push_back(1);
     }
 
-    nth_element(distances.begin(),distances.begin() + k, distances.end(),[](const auto& a, const auto& b){ return a.first < b.first; });
+    // numPoints. changed circles count again from scratch, the rest just add the new points which landed in them.
+    #pragma omp parallel for schedule(dynamic, 16) if(policy != Parallelism::SERIAL)
+    for (int c = 0; c < updated.size(); ++c) {
+        auto &circle = updated[c];
+        const size_t from = changed[c] ? 0 : oldSize;
 
-    // vote. weighting by the 1 / distance.
-    vector<float> votes(numClasses, 0.0f);
-    for (int i = 0; i < k; ++i)
-        votes[distances[i].second] += (1 / distances[i].first);
+        int inside = changed[c] ? 0 : circle.numPoints;
+        for (size_t p = from; p < dataSet.size(); ++p)
+            inside += circle.insideCircle<DIM>(dataSet[p].location, n) ? dataSet[p].weight : 0;
+        circle.numPoints = inside;
+    }
 
-    // return our best class by finding max element
-    return distance(votes.begin(), max_element(votes.begin(), votes.end()));
-}
+    // a circle is useful when it is the biggest circle of its class some point is inside of (removeUselessCircles).
+    // a point's biggest circle can only have moved if the point is near something that changed, so the only circles
+    // which could have become useless are the changed ones, and the ones overlapping a changed (or removed) circle.
+    vector<char> suspect(changed.begin(), changed.end());
+    #pragma omp parallel for schedule(dynamic, 16) if(policy != Parallelism::SERIAL)
+    for (int c = 0; c < updated.size(); ++c) {
+        for (size_t o = 0; o < changes.size() && !suspect[c]; ++o) {
+            if (changes[o].classification == updated[c].classification)
+                suspect[c] = Utils::withinRadius<DIM>(updated[c].centerPoint, changes[o].center, n, changes[o].reach + updated[c].radius);
+        }
+    }
 
-int HyperCircle::kNearestCircleRatio(vector<HyperCircle> &circles, float *point, int k, int numClasses) {
+    // the biggest circle of its class a point is inside of, ties going to the first one, like removeUselessCircles
+    auto biggestCircle = [&](const Point &p) {
+        float biggestRadius = 0.0f;
+        int best = -1;
+        for (int c = 0; c < updated.size(); ++c) {
+            if (updated[c].classification == p.classification && updated[c].insideCircle<DIM>(p.location, n) && updated[c].radius > biggestRadius) {
+                biggestRadius = updated[c].radius;
+                best = c;
+            }
+        }
+        return best;
+    };
 
-    vector<pair<float, int>> distances(circles.size());
+    vector<char> useful(updated.size(), 1);
+    #pragma omp parallel for schedule(dynamic, 1) if(policy != Parallelism::SERIAL)
+    for (int c = 0; c < updated.size(); ++c) {
+        if (!suspect[c])
+            continue;
 
-    #pragma omp parallel for
-    for (int c = 0; c < circles.size(); ++c) {
-        // save our distance / radius, and the class corresponding to this circle
-        distances[c] = {(Utils::distance(circles[c].centerPoint, point, Point::numAttributes) / circles[c].radius), circles[c].classification};
+        bool found = false;
+        for (size_t p = 0; p < dataSet.size() && !found; ++p) {
+            auto &point = dataSet[p];
+            found = point.classification == updated[c].classification && updated[c].insideCircle<DIM>(point.location, n) && biggestCircle(point) == c;
+        }
+        useful[c] = found;
     }
 
-    nth_element(distances.begin(),distances.begin() + k, distances.end(),[](const auto& a, const auto& b){ return a.first < b.first; });
+    circles.clear();
+    for (int c = 0; c < updated.size(); ++c)
+        if (useful[c])
+            circles.push_back(updated[c]);
+
+    cout << "Circles updated with " << newPoints.size() << " new points...\nWe have:\t" << circles.size() << " circles." << endl;
+}
+
+int HyperCircle::regularKNN(Dataset &dataSet, const float *point, int k, int numClasses) {
+    return Utils::withDimension(dataSet.numAttributes, [&](auto dim) { return regularKNN<decltype(dim)::value>(dataSet, point, k, numClasses); });
+}
+
+template <int DIM>
+int HyperCircle::regularKNN(Dataset &dataSet, const float *point, int k, int numClasses) {
+
+    // clamp k if needed
+    if (k > dataSet.size())
+        k = dataSet.size();
 
-    // vote. weighting by the 1 / distance.
-    vector<float> votes(numClasses, 0.0f);
-    for (int i = 0; i < k; ++i)
-        votes[distances[i].second] += (1 / distances[i].first);
+    TopK nearest = TopK::select(dataSet.size(), k, dataSet.numAttributes,
+        [&](int dp, float bound) { return Utils::boundedDistance<DIM>(dataSet[dp].location, point, dataSet.numAttributes, bound); },
+        [&](int dp) { return dataSet[dp].classification; });
 
-    // return our best class by finding max element
-    return distance(votes.begin(), max_element(votes.begin(), votes.end()));
-}
\ No newline at end of file
+    // vote. weighting by the 1/distance.
+    return nearest.vote(numClasses);
+}
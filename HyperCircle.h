@@ -17,9 +17,17 @@
 #include <map>
 #include <queue>
 #include <utility>
+#include <string>
+#include <limits>
 
 
 #include "Point.h"
+#include "Dataset.h"
+#include "Utils.h"
+
+class NeighborGraph;
+class SparseDataset;
+class CoverageMatrix;
 
 class HyperCircle {
 
@@ -33,36 +41,122 @@ public:
 
     int numPoints;
 
-    static std::vector<int> numCirclesPerClass;
+    // distance from our center to the closest training point of another class, or negative if nobody has worked it out.
+    // we are pure as long as our radius stays under it, so updateHyperCircles can grow us without scanning the data.
+    float nearestEnemy;
+
+    // how many of the cheapest later circles of its class each circle keeps in the merge graph
+    static constexpr int MERGE_NEIGHBORS = 8;
 
     HyperCircle();
     HyperCircle(float rad, float *center, int cls);
 
     // finds the nearest neighbor to each HC
-    void findNearestNeighbor(std::vector<Point> &dataSet);
+    void findNearestNeighbor(Dataset &dataSet);
+
+    // carries a nearest neighbor search on over dataSet's rows. minDist and minClass are what the rows searched before
+    // found (float max and -1 to start), and our radius is minDist once every row has been searched, if minClass is our
+    // class. the answer doesn't depend on which order the rows come in, so a sharded run can search a block at a time.
+    void findNearestNeighbor(Dataset &dataSet, float &minDist, int &minClass) const;
+
+    // lowers nearestEnemy (negative means nobody worked it out yet) to our distance from the closest row of another
+    // class in dataSet. the graph merge checks it before scanning the data.
+    void findNearestEnemy(Dataset &dataSet);
 
     // similar to find nearest neighbor based creation. but this time it makes each circle as big as possible. and we are going to kill circle which are useless like normal.
-    void findMaxDistance(std::vector<Point> &dataSet);
+    void findMaxDistance(Dataset &dataSet);
 
     // creates our list of HC's
-    static std::vector<HyperCircle> createCircles(std::vector<Point> &dataset);
+    static std::vector<HyperCircle> createCircles(Dataset &dataset);
 
     // function which takes all our built circles, and starts deleting them as possible.
-    static void mergeCircles(std::vector<HyperCircle> &circles, std::vector<Point> &dataSet);
+    static void mergeCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+
+    // the same merge, but each circle takes its candidates off its list in graph (built over these circles, before
+    // merging) instead of measuring and sorting every later circle of its class. it only does that the slow way if it
+    // eats its whole list. with NeighborGraph::exact the circles come out exactly the same as above.
+    // if keepGoing is set, it gets asked before each circle takes its turn, with that circle's index and about how many
+    // distances we've worked out so far (a scan over the data counts as all of it). if it says no, we stop there, and
+    // return false. the circles after that one just stay as they are, so everything is still pure.
+    // a circle whose nearestEnemy is set only scans the data when a candidate would take it right up to that enemy.
+    static bool mergeCircles(std::vector<HyperCircle> &circles, Dataset &dataSet, const NeighborGraph &graph,
+                             const std::function<bool(int, long long)> &keepGoing = nullptr);
+
+    // limits for generateHyperCircles. zero means no limit.
+    struct Budget {
+        // wall clock seconds for the whole run
+        double seconds = 0;
+
+        // distance computations for the whole run (an upper bound, the early abandoning kernels often stop short)
+        long long distances = 0;
+
+        // where to save how far we've gotten, so a run that got cut off (or killed) can pick up from there. empty means
+        // don't. if the file is already there, and was saved from the same training set, we resume from it.
+        std::string checkpointFile;
+
+        // seconds between checkpoints. we also save one whenever we move on to the next step, and when we run out.
+        double checkpointEvery = 60;
+    };
 
     // wrapper function which makes all our circles by finding neighbors, then runs the merging algorithm and returns us our circles list
-    static std::vector<HyperCircle> generateHyperCircles(std::vector<Point> &dataSet, int numClasses);
+    static std::vector<HyperCircle> generateHyperCircles(Dataset &dataSet);
 
-    static std::vector<HyperCircle> generateMaxDistanceBasedHyperCircles(std::vector<Point> &dataSet, int numClasses);
+    // generateHyperCircles within a budget. once the budget would run out, we stop making or merging circles and
+    // finish up with what we have (we hold back enough of the budget to count the points and drop useless circles).
+    // rows that didn't get to make a circle just go uncovered, so it's always a valid, pure model, just a smaller or
+    // less merged one. with no limits and no checkpoint file it's exactly generateHyperCircles. a resumed run comes out
+    // the same as one that never stopped.
+    static std::vector<HyperCircle> generateHyperCircles(Dataset &dataSet, const Budget &budget);
 
-    static void removeUselessCircles(std::vector<HyperCircle> &circles, std::vector<Point> &dataSet);
+    // generateHyperCircles for sparse rows. the circles' centers are dense copies of their rows, which dataSet keeps.
+    static std::vector<HyperCircle> generateHyperCircles(SparseDataset &dataSet);
 
-    // helper function which checks if a given HC has a point inside it
-    bool insideCircle(float *dataToCheck);
+    static std::vector<HyperCircle> generateMaxDistanceBasedHyperCircles(Dataset &dataSet);
+
+    // for training sets too big for the O(n^2) generators. builds circles from a stratified sample of sampleSize points
+    // (nearest neighbor and merging, like generateHyperCircles), then makes one pass over all the data to shrink any
+    // circle that isn't pure against everything, and to see which points are covered. the next round samples from the
+    // points still uncovered, until everything is covered, nothing new is left to try, or we hit maxRounds.
+    static std::vector<HyperCircle> generateSampledHyperCircles(Dataset &dataSet, size_t sampleSize, int maxRounds = 8, unsigned seed = 42);
+
+    static void removeUselessCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+
+    // how many points of dataSet have each circle as the biggest circle of their own class they're in (the first one,
+    // on ties). removeUselessCircles drops the circles at 0. the counts add up over any split of the points.
+    static std::vector<int> countBestCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
 
-    // classification mode determines whether we use HC's or KNN (or whatever other fallback). then we use the sub mode in the switch to determine voting style or which particular fallback
-    static int classifyPoint(std::vector<HyperCircle> &circles, std::vector<Point> &train, float *dataToCheck, int classificationMode, int subMode,  int numClasses, int k);
+    // drops every circle which sits entirely inside a bigger circle of its own class (d(ci, cj) + rj <= ri). those can
+    // never be the biggest circle a point is in, so removeUselessCircles throws them out anyway, but it needs a scan over
+    // every point to find that out. this only looks at the centers, through a grid, so it is cheap enough to run first.
+    static void pruneDominatedCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
 
+    // stronger simplification than removeUselessCircles. keeps just enough circles to still cover every training point
+    // the circles cover between them now, picked by greedy set cover over a CoverageMatrix. sets numPoints too.
+    // with maxCircles, keeps at most that many: the ones covering the most points nothing kept before them covers. the
+    // points only the dropped circles covered go to the fallback instead.
+    static void coverCircles(std::vector<HyperCircle> &circles, Dataset &dataSet, int maxCircles = std::numeric_limits<int>::max());
+
+    // coverCircles over a coverage matrix we already have, which has to be of these circles and dataSet, dominated
+    // circles already pruned. lets one matrix serve a whole list of budgets.
+    static void coverCircles(std::vector<HyperCircle> &circles, Dataset &dataSet, const CoverageMatrix &coverage, int maxCircles);
+
+    // adds newPoints (read against dataSet's classes) onto the end of dataSet, and fixes up circles, which came from
+    // either generator on dataSet, instead of starting over. circles a new point of another class landed in shrink,
+    // the new points (and any old ones a shrunk circle let go of) get circles of their own, and those get eaten by the
+    // existing circles when nearestEnemy says it is safe, or merged with each other. numPoints and the useless circle
+    // check are only redone for the circles which changed, and the ones overlapping them.
+    static void updateHyperCircles(std::vector<HyperCircle> &circles, Dataset &dataSet, const Dataset &newPoints);
+
+    // sets numPoints of each circle to the amount of training points inside of it, counting each point by its weight
+    static void countPointsInCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+
+    // helper function which checks if a given HC has a point inside it
+    template <int DIM = 0>
+    bool insideCircle(const float *dataToCheck, int numAttributes) const {
+        return Utils::withinRadius<DIM>(centerPoint, dataToCheck, numAttributes, radius);
+    }
+
+    // classification itself lives in HyperCircleModel, which owns a copy of the circles.
     // all the different ways we can use the HC's for voting on each class
     enum {
         SIMPLE_MAJORITY = 0,
@@ -79,13 +173,29 @@ public:
         REGULAR_KNN = 1,
         K_NEAREST_CIRCLES = 2,
         K_NEAREST_RATIOS = 3,
+        APPROX_CIRCLES = 4, // USE_CIRCLES, but only the circles the model's LSH index puts near the point. see buildIndex.
+        APPROX_KNN = 5,     // REGULAR_KNN, but only the training points train's LSH index puts near the point.
     };
 
-    static int regularKNN(std::vector<Point> &dataSet, float *point, int k, int numClasses);
-
-    static int kNearestCircle(std::vector<HyperCircle> &circles, float *point, int k, int numClasses);
-
-    static int kNearestCircleRatio(std::vector<HyperCircle> &circles, float *point, int k, int numClasses);
+    // the 1 / distance weighted vote of point's k nearest rows of dataSet. -1 if dataSet is empty or k is 0.
+    static int regularKNN(Dataset &dataSet, const float *point, int k, int numClasses);
+
+    // the same passes with the attribute count baked in at compile time. DIM == 0 is the generic any-width version.
+    // the functions above pick one of these once per call with Utils::withDimension, so you normally don't call these directly.
+    template <int DIM> void findNearestNeighbor(Dataset &dataSet);
+    template <int DIM> void findNearestNeighbor(Dataset &dataSet, float &minDist, int &minClass) const;
+    template <int DIM> void findNearestEnemy(Dataset &dataSet);
+    template <int DIM> void findMaxDistance(Dataset &dataSet);
+    template <int DIM> static void mergeCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+    template <int DIM> static bool mergeCircles(std::vector<HyperCircle> &circles, Dataset &dataSet, const NeighborGraph &graph,
+                                                const std::function<bool(int, long long)> &keepGoing);
+    template <int DIM> static void countPointsInCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+    template <int DIM> static void removeUselessCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+    template <int DIM> static std::vector<int> countBestCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+    template <int DIM> static void pruneDominatedCircles(std::vector<HyperCircle> &circles, Dataset &dataSet);
+    template <int DIM> static void verifyAgainst(std::vector<HyperCircle> &circles, Dataset &dataSet, std::vector<char> &covered);
+    template <int DIM> static void updateHyperCircles(std::vector<HyperCircle> &circles, Dataset &dataSet, const Dataset &newPoints);
+    template <int DIM> static int regularKNN(Dataset &dataSet, const float *point, int k, int numClasses);
 
 };
 
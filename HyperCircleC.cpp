@@ -0,0 +1,116 @@
+#include "HyperCircleC.h"
+#include "HyperCircleModel.h"
+#include "Parallelism.h"
+#include <string>
+#include <mutex>
+#include <exception>
+using namespace std;
+
+// our labels go straight into the caller's buffer, so these have to line up
+static_assert(sizeof(int) == sizeof(int32_t), "classifyRows writes int labels into an int32_t buffer");
+static_assert((int) HC_SIMPLE_MAJORITY == HyperCircle::SIMPLE_MAJORITY && (int) HC_SMALLEST_CIRCLE == HyperCircle::SMALLEST_CIRCLE, "vote values out of sync");
+static_assert((int) HC_FP32 == HyperCircleModel::FP32 && (int) HC_FP16 == HyperCircleModel::FP16 && (int) HC_INT8 == HyperCircleModel::INT8, "precision values out of sync");
+static_assert((int) HC_NO_FALLBACK == HyperCircle::USE_CIRCLES && (int) HC_K_NEAREST_CIRCLES == HyperCircle::K_NEAREST_CIRCLES && (int) HC_K_NEAREST_RATIOS == HyperCircle::K_NEAREST_RATIOS, "fallback values out of sync");
+
+struct hc_model {
+    HyperCircleModel model;
+};
+
+static thread_local string lastError;
+
+static int fail(int code, const string &message) {
+    lastError = message;
+    return code;
+}
+
+int hc_api_version(void) {
+    return HC_API_VERSION;
+}
+
+hc_model *hc_load_model(const char *fileName) {
+    if (fileName == nullptr) {
+        fail(HC_ERROR_ARGUMENT, "fileName is null");
+        return nullptr;
+    }
+
+    // the interactive program does this in main, a library user never would
+    static once_flag calibrated;
+    call_once(calibrated, Parallelism::calibrate);
+
+    try {
+        return new hc_model{HyperCircleModel::load(fileName)};
+    } catch (const exception &e) {
+        fail(HC_ERROR_INTERNAL, e.what());
+        return nullptr;
+    }
+}
+
+void hc_free_model(hc_model *model) {
+    delete model;
+}
+
+int hc_num_attributes(const hc_model *model) {
+    return model ? model->model.numAttributes : fail(HC_ERROR_ARGUMENT, "model is null");
+}
+
+int hc_num_classes(const hc_model *model) {
+    return model ? model->model.numClasses : fail(HC_ERROR_ARGUMENT, "model is null");
+}
+
+int hc_num_circles(const hc_model *model) {
+    return model ? model->model.size() : fail(HC_ERROR_ARGUMENT, "model is null");
+}
+
+int hc_set_precision(hc_model *model, hc_precision precision) {
+    if (model == nullptr)
+        return fail(HC_ERROR_ARGUMENT, "model is null");
+    if (precision != HC_FP32 && precision != HC_FP16 && precision != HC_INT8)
+        return fail(HC_ERROR_ARGUMENT, "unknown precision");
+
+    try {
+        model->model.setPrecision(precision);
+    } catch (const exception &e) {
+        return fail(HC_ERROR_INTERNAL, e.what());
+    }
+    return HC_OK;
+}
+
+int hc_set_pivots(hc_model *model, int numPivots) {
+    if (model == nullptr)
+        return fail(HC_ERROR_ARGUMENT, "model is null");
+    if (numPivots < 0 || numPivots > HyperCircleModel::MAX_PIVOTS)
+        return fail(HC_ERROR_ARGUMENT, "numPivots out of range");
+
+    try {
+        model->model.buildPivots(numPivots);
+    } catch (const exception &e) {
+        return fail(HC_ERROR_INTERNAL, e.what());
+    }
+    return HC_OK;
+}
+
+int hc_classify(const hc_model *model, const float *rows, size_t numRows, int32_t *labels, hc_vote vote, hc_fallback fallback, int k) {
+    if (model == nullptr)
+        return fail(HC_ERROR_ARGUMENT, "model is null");
+    if (numRows == 0)
+        return HC_OK;
+    if (rows == nullptr || labels == nullptr)
+        return fail(HC_ERROR_ARGUMENT, "rows and labels can't be null");
+    if (vote < HC_SIMPLE_MAJORITY || vote > HC_SMALLEST_CIRCLE)
+        return fail(HC_ERROR_ARGUMENT, "unknown vote");
+    if (fallback != HC_NO_FALLBACK && fallback != HC_K_NEAREST_CIRCLES && fallback != HC_K_NEAREST_RATIOS)
+        return fail(HC_ERROR_ARGUMENT, "unknown fallback");
+    if (fallback != HC_NO_FALLBACK && k <= 0)
+        return fail(HC_ERROR_ARGUMENT, "k has to be positive when using a fallback");
+
+    try {
+        model->model.classifyRows(rows, numRows, reinterpret_cast<int *>(labels), vote, fallback, k);
+    } catch (const exception &e) {
+        return fail(HC_ERROR_INTERNAL, e.what());
+    }
+    return HC_OK;
+}
+
+const char *hc_last_error(void) {
+    return lastError.c_str();
+}
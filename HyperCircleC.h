@@ -0,0 +1,97 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef HYPERCIRCLEC_H
+#define HYPERCIRCLEC_H
+
+// plain C interface to libhypercircles, so other programs can load a saved model and classify with it in process.
+// nothing in here throws. functions which can fail return NULL or a negative code, and hc_last_error() says why.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(HC_BUILDING_SHARED)
+#define HC_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(HC_USING_SHARED)
+#define HC_API __declspec(dllimport)
+#elif defined(__GNUC__)
+#define HC_API __attribute__((visibility("default")))
+#else
+#define HC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bumped whenever a function below changes signature or meaning
+#define HC_API_VERSION 1
+
+typedef struct hc_model hc_model;
+
+// how the circles a point lands in vote. same values as the HyperCircle enum.
+typedef enum {
+    HC_SIMPLE_MAJORITY = 0,
+    HC_COUNT_VOTE = 1,
+    HC_DENSITY_VOTE = 2,
+    HC_DISTANCE_VOTE = 3,
+    HC_PER_CLASS_VOTE = 4,
+    HC_SMALLEST_CIRCLE = 5
+} hc_vote;
+
+// what to do with points no circle covers
+typedef enum {
+    HC_NO_FALLBACK = 0,         // leave the label as -1
+    HC_K_NEAREST_CIRCLES = 2,
+    HC_K_NEAREST_RATIOS = 3
+} hc_fallback;
+
+// how the model stores its centers for the inside-a-circle check. answers are the same either way, the smaller ones
+// just read less memory per circle, which pays off once a model is too big for the cache.
+typedef enum {
+    HC_FP32 = 0,
+    HC_FP16 = 1,
+    HC_INT8 = 2
+} hc_precision;
+
+// error codes
+enum {
+    HC_OK = 0,
+    HC_ERROR_ARGUMENT = -1,
+    HC_ERROR_INTERNAL = -2
+};
+
+HC_API int hc_api_version(void);
+
+// loads a model saved by the HyperCircles program (the current format with a header). NULL on failure.
+HC_API hc_model *hc_load_model(const char *fileName);
+
+HC_API void hc_free_model(hc_model *model);
+
+HC_API int hc_num_attributes(const hc_model *model);
+HC_API int hc_num_classes(const hc_model *model);
+HC_API int hc_num_circles(const hc_model *model);
+
+// switches the center storage used by hc_classify. not safe to call while another thread is classifying with model.
+HC_API int hc_set_precision(hc_model *model, hc_precision precision);
+
+// picks numPivots pivots (up to 32) to rule out circles with, 0 turns it off. answers don't change. only pays off for
+// models with few attributes. not safe to call while another thread is classifying with model.
+HC_API int hc_set_pivots(hc_model *model, int numPivots);
+
+// classifies numRows rows of hc_num_attributes() floats each, stored back to back in rows, and writes one class id per
+// row into labels, or -1 for a row nothing covered and the fallback couldn't vote on (no fallback, no circles, or k 0).
+// both buffers belong to the caller and are used as is, nothing gets copied. k is the amount of neighbors the fallback
+// uses. safe to call from several threads at once on the same model.
+HC_API int hc_classify(const hc_model *model, const float *rows, size_t numRows, int32_t *labels,
+                       hc_vote vote, hc_fallback fallback, int k);
+
+// message for the last failure on this thread. empty if nothing has failed.
+HC_API const char *hc_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //HYPERCIRCLEC_H
@@ -0,0 +1,749 @@
+#include "HyperCircleModel.h"
+#include "Utils.h"
+#include "Parallelism.h"
+#include "TopK.h"
+#include "SparseDataset.h"
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+// first four bytes of every model file. "HCM1" in little endian.
+static const int32_t MODEL_MAGIC = 0x314D4348;
+
+// after the centers, newer files have the class names: this, then each name as its length and its bytes
+static const int32_t NAMES_MAGIC = 0x4E4D4348;
+
+HyperCircleModel::HyperCircleModel() {
+    numAttributes = 0;
+    numClasses = 0;
+}
+
+HyperCircleModel::HyperCircleModel(const vector<HyperCircle> &circles, int numAttributes, int numClasses, vector<string> classNames) {
+    this->numAttributes = numAttributes;
+    this->numClasses = numClasses;
+    this->classNames = std::move(classNames);
+
+    const size_t n = circles.size();
+    centers.resize(n * numAttributes);
+    radii.resize(n);
+    labels.resize(n);
+    counts.resize(n);
+    circlesPerClass.assign(numClasses, 0);
+
+    // copy every circle into its slot in each array
+    for (size_t i = 0; i < n; ++i) {
+        const HyperCircle &hc = circles[i];
+        memcpy(centers.data() + i * numAttributes, hc.centerPoint, numAttributes * sizeof(float));
+        radii[i] = hc.radius;
+        labels[i] = hc.classification;
+        counts[i] = hc.numPoints;
+        circlesPerClass[hc.classification]++;
+    }
+}
+
+void HyperCircleModel::replicateCenters(const Numa::Config &numa) {
+    centerReplicas.clear();
+    replicaNodes.reset();
+    const auto nodes = Numa::topology(numa.simulatedNodes);
+    if (!numa.replicate || centers.empty() || nodes->size() < 2)
+        return;
+
+    // each node's copy gets made and filled by a thread pinned there, so its pages land there
+    centerReplicas.assign(nodes->size(), nullptr);
+    Numa::onEachNode(*nodes, [&](int node) {
+        auto replica = make_shared<Numa::Buffer<float>>(centers.size());
+        copy(centers.begin(), centers.end(), replica->data());
+        centerReplicas[node] = replica;
+    });
+    replicaNodes = nodes;
+}
+
+void HyperCircleModel::save(const string &fileName) const {
+    ofstream out(fileName, ios::binary);
+
+    // header
+    const int32_t header[4] = {MODEL_MAGIC, numAttributes, numClasses, size()};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    // then each array in one go
+    out.write(reinterpret_cast<const char*>(radii.data()), radii.size() * sizeof(float));
+    out.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(int32_t));
+    out.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(int32_t));
+    out.write(reinterpret_cast<const char*>(centers.data()), centers.size() * sizeof(float));
+
+    // the label names, if we know every one of them
+    if (classNames.size() == numClasses) {
+        out.write(reinterpret_cast<const char*>(&NAMES_MAGIC), sizeof(NAMES_MAGIC));
+        for (const string &name : classNames) {
+            const int32_t length = (int32_t) name.size();
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(name.data(), length);
+        }
+    }
+    out.close();
+}
+
+HyperCircleModel HyperCircleModel::load(const string &fileName, int legacyNumAttributes, int legacyNumClasses) {
+    ifstream in(fileName, ios::binary);
+    if (!in.is_open())
+        throw runtime_error("Failed to open model file: " + fileName);
+
+    int32_t first;
+    in.read(reinterpret_cast<char*>(&first), sizeof(first));
+    if (!in)
+        throw runtime_error("Model file is truncated: " + fileName);
+
+    if (first == MODEL_MAGIC) {
+        // read the whole file in, and let fromBytes pull it apart
+        in.seekg(0, ios::end);
+        vector<char> bytes((size_t) in.tellg());
+        in.seekg(0, ios::beg);
+        in.read(bytes.data(), bytes.size());
+        if (!in)
+            throw runtime_error("Model file is truncated: " + fileName);
+        return fromBytes(bytes.data(), bytes.size());
+    }
+
+    // old format. first int is the circle count, then each circle is radius, class, count, center.
+    if (legacyNumAttributes <= 0)
+        throw runtime_error("Old style model file, import the training data it was made with first.");
+
+    HyperCircleModel model;
+    model.numAttributes = legacyNumAttributes;
+    model.numClasses = legacyNumClasses;
+    const int32_t n = first;
+
+    // every circle takes up its bytes in the file, so a count bigger than the file can hold is garbage
+    const size_t perCircle = sizeof(float) + 2 * sizeof(int32_t) + (size_t) model.numAttributes * sizeof(float);
+    in.seekg(0, ios::end);
+    const size_t rest = (size_t) in.tellg() - sizeof(first);
+    in.seekg(sizeof(first), ios::beg);
+    if (n < 0 || model.numClasses <= 0 || model.numClasses > MAX_CLASSES || rest / perCircle < (size_t) n)
+        throw runtime_error("Model file is corrupt: " + fileName);
+
+    model.radii.resize(n);
+    model.labels.resize(n);
+    model.counts.resize(n);
+    model.centers.resize((size_t) n * model.numAttributes);
+    for (int32_t i = 0; i < n; ++i) {
+        in.read(reinterpret_cast<char*>(&model.radii[i]), sizeof(float));
+        in.read(reinterpret_cast<char*>(&model.labels[i]), sizeof(int32_t));
+        in.read(reinterpret_cast<char*>(&model.counts[i]), sizeof(int32_t));
+        in.read(reinterpret_cast<char*>(model.centers.data() + (size_t) i * model.numAttributes), model.numAttributes * sizeof(float));
+    }
+
+    if (!in)
+        throw runtime_error("Model file is truncated: " + fileName);
+    in.close();
+
+    if (!model.countCirclesPerClass())
+        throw runtime_error("Model file is corrupt: " + fileName);
+    return model;
+}
+
+HyperCircleModel HyperCircleModel::fromBytes(const char *bytes, size_t size) {
+
+    int32_t header[4];
+    if (size < sizeof(header))
+        throw runtime_error("Model is truncated");
+    memcpy(header, bytes, sizeof(header));
+    if (header[0] != MODEL_MAGIC)
+        throw runtime_error("Not a model file");
+
+    HyperCircleModel model;
+    model.numAttributes = header[1];
+    model.numClasses = header[2];
+    const int32_t n = header[3];
+    if (model.numAttributes <= 0 || model.numClasses < 0 || model.numClasses > MAX_CLASSES || n < 0)
+        throw runtime_error("Model header is corrupt");
+
+    // radii, labels, counts, then the centers. divided instead of multiplied out, so a huge n can't wrap around.
+    const size_t perCircle = sizeof(float) + 2 * sizeof(int32_t) + (size_t) model.numAttributes * sizeof(float);
+    if ((size - sizeof(header)) / perCircle < (size_t) n)
+        throw runtime_error("Model is truncated");
+
+    const char *at = bytes + sizeof(header);
+    auto take = [&](auto &array, size_t count) {
+        array.resize(count);
+        memcpy(array.data(), at, count * sizeof(array[0]));
+        at += count * sizeof(array[0]);
+    };
+    take(model.radii, n);
+    take(model.labels, n);
+    take(model.counts, n);
+    take(model.centers, (size_t) n * model.numAttributes);
+
+    // a label is an index into the per class arrays, so one outside the header's classes would go past them
+    if (!model.countCirclesPerClass())
+        throw runtime_error("Model header is corrupt");
+
+    // files from before we saved the names just end here
+    const char *end = bytes + size;
+    auto takeInt = [&]() {
+        int32_t value;
+        if (end - at < (ptrdiff_t) sizeof(value))
+            throw runtime_error("Model is truncated");
+        memcpy(&value, at, sizeof(value));
+        at += sizeof(value);
+        return value;
+    };
+    if (at != end) {
+        if (takeInt() != NAMES_MAGIC)
+            throw runtime_error("Model header is corrupt");
+        for (int c = 0; c < model.numClasses; ++c) {
+            const int32_t length = takeInt();
+            if (length < 0 || end - at < length)
+                throw runtime_error("Model is truncated");
+            model.classNames.emplace_back(at, length);
+            at += length;
+        }
+    }
+
+    return model;
+}
+
+bool HyperCircleModel::countCirclesPerClass() {
+    if (any_of(labels.begin(), labels.end(), [&](int label) { return label < 0 || label >= numClasses; }))
+        return false;
+    circlesPerClass.assign(numClasses, 0);
+    for (int label : labels)
+        circlesPerClass[label]++;
+    return true;
+}
+
+int HyperCircleModel::classifyPoint(Dataset &train, const float *dataToCheck, int classificationMode, int subMode, int k) const {
+    return Utils::withDimension(numAttributes, [&](auto dim) { return classifyPoint<decltype(dim)::value>(train, dataToCheck, classificationMode, subMode, k); });
+}
+
+void HyperCircleModel::setPrecision(int precision) {
+
+    int8Centers.clear();
+    fp16Centers.clear();
+    codeScale.clear();
+    codeOffset.clear();
+    surelyInside.clear();
+    surelyOutside.clear();
+    this->precision = FP32;
+
+    if (precision != INT8 && precision != FP16)
+        return;
+
+    const int n = size();
+    codeScale.assign(numAttributes, 1.0f);
+    codeOffset.assign(numAttributes, 0.0f);
+
+    // int8 gets its own scale per attribute, so the 256 codes cover just the range the centers actually use
+    if (precision == INT8) {
+        for (int a = 0; a < numAttributes; ++a) {
+            float lo = numeric_limits<float>::max();
+            float hi = numeric_limits<float>::lowest();
+            for (int i = 0; i < n; ++i) {
+                lo = min(lo, center(i)[a]);
+                hi = max(hi, center(i)[a]);
+            }
+            if (n == 0 || hi <= lo)
+                hi = lo + 1.0f;
+            codeScale[a] = (hi - lo) / 255.0f;
+            codeOffset[a] = lo + 128.0f * codeScale[a];
+        }
+    }
+
+    // make the codes, and write down what each center actually decodes to so we know how far off it is
+    vector<float> decoded(numAttributes);
+    if (precision == INT8)
+        int8Centers.resize((size_t) n * numAttributes);
+    else
+        fp16Centers.resize((size_t) n * numAttributes);
+
+    surelyInside.resize(n);
+    surelyOutside.resize(n);
+    for (int i = 0; i < n; ++i) {
+        const float *c = center(i);
+        for (int a = 0; a < numAttributes; ++a) {
+            const size_t at = (size_t) i * numAttributes + a;
+            if (precision == INT8) {
+                const float code = roundf((c[a] - codeOffset[a]) / codeScale[a]);
+                int8Centers[at] = (int8_t) max(-128.0f, min(127.0f, code));
+                decoded[a] = codeOffset[a] + codeScale[a] * (float) int8Centers[at];
+            }
+            else {
+                fp16Centers[at] = Utils::floatToHalf(c[a]);
+                decoded[a] = Utils::halfToFloat(fp16Centers[at]);
+            }
+        }
+
+        // the real distance is within error of the compact one (triangle inequality), so pad the radius both ways by
+        // it. the slack covers float rounding, same as the early abandon kernels.
+        const float error = Utils::distance(c, decoded.data(), numAttributes) * (1.0f + Utils::ABANDON_SLACK);
+        const float inner = radii[i] - error;
+        surelyInside[i] = inner > 0.0f ? Utils::toPower(inner) * (1.0f - Utils::ABANDON_SLACK) : -1.0f;
+        surelyOutside[i] = Utils::toPower(radii[i] + error) * (1.0f + Utils::ABANDON_SLACK);
+    }
+
+    this->precision = precision;
+}
+
+void HyperCircleModel::buildIndex(int numTables, int hashesPerTable, float widthFactor) {
+    vector<float> sorted(radii.begin(), radii.end());
+    float width = 1.0f;
+    if (!sorted.empty()) {
+        nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        width = sorted[sorted.size() / 2] > 0.0f ? sorted[sorted.size() / 2] : 1.0f;
+    }
+    circleIndex = make_shared<LSHIndex>(centers.data(), size(), numAttributes, numTables, hashesPerTable, widthFactor * width);
+}
+
+void HyperCircleModel::buildPivots(int numPivots) {
+
+    pivots.clear();
+    pivotDistances.clear();
+    this->numPivots = 0;
+
+    const int n = size();
+    numPivots = min({numPivots, MAX_PIVOTS, n});
+    if (numPivots <= 0)
+        return;
+
+    // farthest first. start from the center furthest from the first one, then keep taking whichever center is furthest
+    // from every pivot so far. spread out pivots give the tightest bounds.
+    vector<float> closest(n, numeric_limits<float>::max());
+    int next = 0;
+    float furthest = -1.0f;
+    for (int c = 0; c < n; ++c) {
+        const float d = Utils::distance(center(c), center(0), numAttributes);
+        if (d > furthest) {
+            furthest = d;
+            next = c;
+        }
+    }
+
+    pivots.resize((size_t) numPivots * numAttributes);
+    for (int p = 0; p < numPivots; ++p) {
+        copy(center(next), center(next) + numAttributes, pivots.begin() + (size_t) p * numAttributes);
+
+        furthest = -1.0f;
+        for (int c = 0; c < n; ++c) {
+            closest[c] = min(closest[c], Utils::distance(center(c), pivots.data() + (size_t) p * numAttributes, numAttributes));
+            if (closest[c] > furthest) {
+                furthest = closest[c];
+                next = c;
+            }
+        }
+    }
+
+    this->numPivots = numPivots;
+    pivotDistances.resize((size_t) n * numPivots);
+    Utils::withDimension(numAttributes, [&](auto dim) {
+        #pragma omp parallel for schedule(static) if(Parallelism::choose(n, numPivots, numAttributes) != Parallelism::SERIAL)
+        for (int c = 0; c < n; ++c)
+            distancesToPivots<decltype(dim)::value>(center(c), pivotDistances.data() + (size_t) c * numPivots);
+    });
+}
+
+template <int DIM>
+void HyperCircleModel::distancesToPivots(const float *point, float *toPivots) const {
+    for (int p = 0; p < numPivots; ++p)
+        toPivots[p] = Utils::distance<DIM>(point, pivots.data() + (size_t) p * numAttributes, numAttributes);
+}
+
+// both sides of the triangle inequality get padded by the same relative slack as the early abandon. a difference of two
+// big distances can be off by a lot more than the difference itself, so the slack scales with the distances, not it.
+float HyperCircleModel::pivotLowerBound(int circle, const float *toPivots) const {
+    const float *mine = pivotDistances.data() + (size_t) circle * numPivots;
+    float lower = 0.0f;
+    for (int p = 0; p < numPivots; ++p)
+        lower = max(lower, fabsf(toPivots[p] - mine[p]) - Utils::ABANDON_SLACK * (toPivots[p] + mine[p]));
+    return lower;
+}
+
+float HyperCircleModel::pivotUpperBound(int circle, const float *toPivots) const {
+    const float *mine = pivotDistances.data() + (size_t) circle * numPivots;
+    float upper = numeric_limits<float>::max();
+    for (int p = 0; p < numPivots; ++p)
+        upper = min(upper, (toPivots[p] + mine[p]) * (1.0f + Utils::ABANDON_SLACK));
+    return upper;
+}
+
+template <int DIM>
+bool HyperCircleModel::insideCircle(int circle, const float *dataToCheck, const float *shifted, const float *base) const {
+
+    if (precision == FP32)
+        return Utils::withinRadius<DIM>(base + (size_t) circle * numAttributes, dataToCheck, numAttributes, radii[circle]);
+
+    // screen with the compact center first
+    const size_t at = (size_t) circle * numAttributes;
+    float sum = 0.0f;
+    if (precision == INT8)
+        sum = Utils::partialQuantizedPowerSum<DIM>(shifted, codeScale.data(), int8Centers.data() + at, numAttributes, surelyOutside[circle]);
+    else
+        sum = Utils::partialQuantizedPowerSum<DIM>(shifted, codeScale.data(), fp16Centers.data() + at, numAttributes, surelyOutside[circle]);
+
+    if (sum > surelyOutside[circle])
+        return false;
+    if (sum < surelyInside[circle])
+        return true;
+
+    // too close to the edge to tell, so ask the real center
+    return Utils::withinRadius<DIM>(base + (size_t) circle * numAttributes, dataToCheck, numAttributes, radii[circle]);
+}
+
+template <typename Distance>
+void HyperCircleModel::castVote(int i, int subMode, float *votes, pair<float, int> &smallestCircle, Distance distanceTo) const {
+
+    switch (subMode) {
+
+        // regular vote, we just use the count of circles we're inside by class
+        case HyperCircle::SIMPLE_MAJORITY: {
+            votes[labels[i]] += 1.0f;
+            break;
+        }
+
+        // vote with the amount of points in the circle.
+        case HyperCircle::COUNT_VOTE: {
+            votes[labels[i]] += counts[i];
+            break;
+        }
+
+        case HyperCircle::DENSITY_VOTE: {
+            // simple count/radius
+            float r = max(radii[i], 1e-6f);
+            float weight = counts[i] / r;
+            votes[labels[i]] += weight;
+            break;
+        }
+
+        case HyperCircle::DISTANCE_VOTE: {
+            // count / distance from the center
+            float dist = distanceTo();
+            float weight = counts[i] / (dist + 1e-4f);
+            votes[labels[i]] += weight;
+            break;
+        }
+
+        case HyperCircle::PER_CLASS_VOTE: {
+            // we add 1 / num circles of this class as a vote.
+            votes[labels[i]] += 1.0f / circlesPerClass[labels[i]];
+            break;
+        }
+
+        case HyperCircle::SMALLEST_CIRCLE: {
+            // get our distance.
+            float distance = distanceTo();
+
+            // if we're inside, and this is smallest circle, we take this circle's classification.
+            if (distance < smallestCircle.first) {
+                smallestCircle.first = distance;
+                smallestCircle.second = i;
+            }
+            break;
+        }
+
+        // shut up the compiler
+        default: {
+            throw runtime_error("Unknown classification mode");
+        }
+    } // voting switch
+}
+
+int HyperCircleModel::countVotes(int subMode, float *votes, const pair<float, int> &smallestCircle) const {
+
+    // if we were looking for smallest circle, we can just return it from here. it gets the only vote.
+    if (subMode == HyperCircle::SMALLEST_CIRCLE) {
+        if (smallestCircle.second == -1) {
+            return -1; // No circle contained the point
+        }
+        votes[labels[smallestCircle.second]] = 1.0f;
+        return labels[smallestCircle.second];
+    }
+
+    // start maxVotes at 0. that way if no votes are cast, we know that we have to classify with the fallback mechanisms
+    int prediction = -1;
+    float maxVotes = 0.0f;
+    for (int cls = 0; cls < numClasses; ++cls) {
+        if (votes[cls] > maxVotes) {
+            maxVotes = votes[cls];
+            prediction = cls;
+        }
+    }
+    return prediction;
+}
+
+template <int DIM>
+int HyperCircleModel::circleVotes(const float *dataToCheck, int subMode, float *votes, const vector<int> *candidates) const {
+
+    for (int cls = 0; cls < numClasses; ++cls)
+        votes[cls] = 0.0f;
+
+    // when quantized, move the query into the codes' frame once instead of once per circle
+    vector<float> shifted;
+    if (precision != FP32) {
+        shifted.resize(numAttributes);
+        for (int a = 0; a < numAttributes; ++a)
+            shifted[a] = dataToCheck[a] - codeOffset[a];
+    }
+
+    // with pivots, measure the query against them once, and let the bounds settle what they can
+    float toPivots[MAX_PIVOTS];
+    if (numPivots > 0)
+        distancesToPivots<DIM>(dataToCheck, toPivots);
+
+    // smallest circles radius and class
+    pair<float, int> smallestCircle {numeric_limits<float>::max(), -1};
+
+    const float *base = localCenters();
+    const int n = candidates ? (int) candidates->size() : size();
+    for (int at = 0; at < n; at++) {
+        const int i = candidates ? (*candidates)[at] : at;
+        const float *c = base + (size_t) i * numAttributes;
+
+        bool inside;
+        if (numPivots > 0 && pivotLowerBound(i, toPivots) > radii[i])
+            inside = false;
+        else if (numPivots > 0 && pivotUpperBound(i, toPivots) < radii[i])
+            inside = true;
+        else
+            inside = insideCircle<DIM>(i, dataToCheck, shifted.data(), base);
+
+        if (inside)
+            castVote(i, subMode, votes, smallestCircle, [&] { return Utils::distance<DIM>(dataToCheck, c, numAttributes); });
+    } // circles loop
+
+    return countVotes(subMode, votes, smallestCircle);
+}
+
+template <int DIM>
+int HyperCircleModel::classifyPoint(Dataset &train, const float *dataToCheck, int classificationMode, int subMode, int k) const {
+
+    // here we use our different classification options.
+    // first option is to just take whichever class we find our point in the most.
+    // we could also use the average density of each circle, so number of points / area on average of each circle
+    // another option is to use the total point count of each circle our point fell into
+    int prediction = -1;
+    switch (classificationMode) {
+
+        case HyperCircle::USE_CIRCLES: {
+            vector<float> votes(numClasses);
+            prediction = circleVotes<DIM>(dataToCheck, subMode, votes.data());
+            break;
+        }
+
+        // only the circles near us. without an index this is just USE_CIRCLES.
+        case HyperCircle::APPROX_CIRCLES: {
+            vector<float> votes(numClasses);
+            // kept around per thread, so we aren't allocating a fresh list for every query
+            thread_local vector<int> nearby;
+            nearby.clear();
+            if (circleIndex)
+                circleIndex->candidates(dataToCheck, nearby);
+            prediction = circleVotes<DIM>(dataToCheck, subMode, votes.data(), circleIndex ? &nearby : nullptr);
+            break;
+        }
+
+        // standard knn algorithm
+        case HyperCircle::REGULAR_KNN: {
+            prediction = HyperCircle::regularKNN(train, dataToCheck, k, numClasses);
+            break;
+        }
+
+        // knn over just the training points near us. if the index turned up fewer than k, do the whole thing.
+        case HyperCircle::APPROX_KNN: {
+            thread_local vector<int> nearby;
+            nearby.clear();
+            if (train.index)
+                train.index->candidates(dataToCheck, nearby);
+            if (nearby.size() < max(k, 1)) {
+                prediction = HyperCircle::regularKNN(train, dataToCheck, k, numClasses);
+                break;
+            }
+
+            TopK nearest = TopK::select(nearby.size(), k, numAttributes,
+                [&](int c, float bound) { return Utils::boundedDistance<DIM>(train[nearby[c]].location, dataToCheck, numAttributes, bound); },
+                [&](int c) { return train[nearby[c]].classification; });
+            prediction = nearest.vote(numClasses);
+            break;
+        }
+
+        // k nearest HC's by radius
+        case HyperCircle::K_NEAREST_CIRCLES: {
+            prediction = kNearestCircle<DIM>(dataToCheck, k);
+            break;
+        }
+
+        // k nearest HC's by distance / radius. this way we know relatively how far outside a circles radius it was.
+        case HyperCircle::K_NEAREST_RATIOS: {
+            prediction = kNearestCircleRatio<DIM>(dataToCheck, k);
+            break;
+        }
+
+        default:{}
+    }
+
+    // fallback mechanism
+    return prediction;
+}
+
+// classifies a whole batch of points at once. the policy decides whether each thread takes whole queries, or whether
+// every query splits its own scan up (which the fallbacks do on their own when it pays off).
+vector<int> HyperCircleModel::classifyPoints(Dataset &train, Dataset &queries, int classificationMode, int subMode, int k) const {
+
+    vector<int> predictions(queries.size(), -1);
+
+    // the candidates each query scans. regular knn goes over the training set, everything else the circles.
+    const bool overTraining = classificationMode == HyperCircle::REGULAR_KNN || classificationMode == HyperCircle::APPROX_KNN;
+    const size_t candidates = overTraining ? train.size() : size();
+    const int policy = Parallelism::choose(queries.size(), candidates, numAttributes);
+
+    Utils::withDimension(numAttributes, [&](auto dim) {
+        #pragma omp parallel for schedule(dynamic, 8) if(policy == Parallelism::INTER_QUERY)
+        for (int q = 0; q < queries.size(); ++q) {
+            predictions[q] = classifyPoint<decltype(dim)::value>(train, queries[q].location, classificationMode, subMode, k);
+        }
+    });
+
+    return predictions;
+}
+
+void HyperCircleModel::classifyRows(const float *rows, size_t numRows, int *rowLabels, int subMode, int fallbackMode, int k, float *scores) const {
+
+    // the fallbacks we allow never look at the training set, so an empty one is fine
+    Dataset noTrain;
+    const int policy = Parallelism::choose(numRows, size(), numAttributes);
+
+    Utils::withDimension(numAttributes, [&](auto dim) {
+        #pragma omp parallel if(policy == Parallelism::INTER_QUERY)
+        {
+            // votes go straight into the caller's scores if they want them, otherwise into a scratch row
+            vector<float> scratch(scores ? 0 : numClasses);
+
+            #pragma omp for schedule(dynamic, 8)
+            for (long long r = 0; r < (long long) numRows; ++r) {
+                const float *row = rows + (size_t) r * numAttributes;
+                float *votes = scores ? scores + (size_t) r * numClasses : scratch.data();
+
+                int prediction = circleVotes<decltype(dim)::value>(row, subMode, votes);
+                if (prediction == -1 && fallbackMode != HyperCircle::USE_CIRCLES)
+                    prediction = classifyPoint<decltype(dim)::value>(noTrain, row, fallbackMode, subMode, k);
+                rowLabels[r] = prediction;
+            }
+        }
+    });
+}
+
+void HyperCircleModel::classifySparse(const SparseDataset &rows, int *rowLabels, int subMode, int fallbackMode, int k, float *scores) const {
+
+    // a column past our width would index past the end of every center
+    if (rows.numAttributes > numAttributes)
+        throw runtime_error("Sparse rows are " + to_string(rows.numAttributes) + " wide, but the model is " + to_string(numAttributes));
+
+    // each center's powerNorm, once for the whole batch
+    vector<double> centerNorms(size());
+    for (int c = 0; c < size(); ++c)
+        centerNorms[c] = Utils::powerNorm(center(c), numAttributes);
+
+    // a distance costs about as much as a row has nonzeros
+    const int width = max(1, (int) (rows.columns.size() / max<size_t>(rows.size(), 1)));
+    const int policy = Parallelism::choose(rows.size(), size(), width);
+    k = min(k, size());
+
+    #pragma omp parallel if(policy == Parallelism::INTER_QUERY)
+    {
+        vector<float> scratch(scores ? 0 : numClasses);
+        vector<float> distances(size());
+        const float *base = localCenters();
+
+        #pragma omp for schedule(dynamic, 8)
+        for (long long r = 0; r < (long long) rows.size(); ++r) {
+            float *votes = scores ? scores + (size_t) r * numClasses : scratch.data();
+
+            // every vote and fallback needs the distance to each center anyway, so get them all up front
+            for (int c = 0; c < size(); ++c)
+                distances[c] = Utils::fromPower(Utils::sparseDensePowerSum(rows.columnsOf(r), rows.valuesOf(r), rows.nonzeros(r), base + (size_t) c * numAttributes, centerNorms[c]));
+
+            int prediction = voteFromDistances(distances.data(), subMode, votes);
+
+            // the circle fallbacks, off the same distances
+            if (prediction == -1 && (fallbackMode == HyperCircle::K_NEAREST_CIRCLES || fallbackMode == HyperCircle::K_NEAREST_RATIOS)) {
+                TopK nearest(k);
+                for (int c = 0; c < size(); ++c)
+                    nearest.push(fallbackMode == HyperCircle::K_NEAREST_RATIOS ? distances[c] / radii[c] : distances[c], labels[c]);
+                prediction = nearest.vote(numClasses);
+            }
+            rowLabels[r] = prediction;
+        }
+    }
+}
+
+int HyperCircleModel::voteFromDistances(const float *distances, int subMode, float *votes) const {
+    for (int cls = 0; cls < numClasses; ++cls)
+        votes[cls] = 0.0f;
+    pair<float, int> smallestCircle {numeric_limits<float>::max(), -1};
+    for (int c = 0; c < size(); ++c)
+        if (distances[c] <= radii[c])
+            castVote(c, subMode, votes, smallestCircle, [&] { return distances[c]; });
+
+    return countVotes(subMode, votes, smallestCircle);
+}
+
+int HyperCircleModel::kNearestCircle(const float *point, int k) const {
+    return Utils::withDimension(numAttributes, [&](auto dim) { return kNearestCircle<decltype(dim)::value>(point, k); });
+}
+
+template <int DIM>
+int HyperCircleModel::kNearestCircle(const float *point, int k) const {
+
+    // clamp k if needed. we can't have more neighbors than circles.
+    if (k > size())
+        k = size();
+
+    float toPivots[MAX_PIVOTS];
+    if (numPivots > 0)
+        distancesToPivots<DIM>(point, toPivots);
+
+    // our distance to each circle's center, and that circle's class. centers the pivots say are too far away to make
+    // the top k get skipped without measuring them.
+    const float *base = localCenters();
+    TopK nearest = TopK::select(size(), k, numAttributes,
+        [&](int c, float bound) {
+            if (numPivots > 0 && pivotLowerBound(c, toPivots) > bound)
+                return numeric_limits<float>::max();
+            return Utils::boundedDistance<DIM>(base + (size_t) c * numAttributes, point, numAttributes, bound);
+        },
+        [&](int c) { return labels[c]; });
+
+    // vote. weighting by the 1 / distance.
+    return nearest.vote(numClasses);
+}
+
+int HyperCircleModel::kNearestCircleRatio(const float *point, int k) const {
+    return Utils::withDimension(numAttributes, [&](auto dim) { return kNearestCircleRatio<decltype(dim)::value>(point, k); });
+}
+
+template <int DIM>
+int HyperCircleModel::kNearestCircleRatio(const float *point, int k) const {
+
+    // clamp k if needed. we can't have more neighbors than circles.
+    if (k > size())
+        k = size();
+
+    float toPivots[MAX_PIVOTS];
+    if (numPivots > 0)
+        distancesToPivots<DIM>(point, toPivots);
+
+    // our distance / radius, and the class corresponding to this circle
+    const float *base = localCenters();
+    TopK nearest = TopK::select(size(), k, numAttributes,
+        [&](int c, float bound) {
+            // ratio <= bound means distance <= bound * radius. only pass a bound through if it doesn't overflow.
+            float distanceBound = bound < numeric_limits<float>::max() / radii[c] ? bound * radii[c] : numeric_limits<float>::max();
+            if (numPivots > 0 && pivotLowerBound(c, toPivots) > distanceBound)
+                return numeric_limits<float>::max();
+            return Utils::boundedDistance<DIM>(base + (size_t) c * numAttributes, point, numAttributes, distanceBound) / radii[c];
+        },
+        [&](int c) { return labels[c]; });
+
+    // vote. weighting by the 1 / distance.
+    return nearest.vote(numClasses);
+}
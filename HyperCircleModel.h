@@ -0,0 +1,243 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef HYPERCIRCLEMODEL_H
+#define HYPERCIRCLEMODEL_H
+
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <new>
+#include <cstdint>
+#include <memory>
+
+#include "Point.h"
+#include "Dataset.h"
+#include "HyperCircle.h"
+#include "LSHIndex.h"
+#include "Numa.h"
+
+class SparseDataset;
+
+// allocator which hands out 64 byte aligned memory, so every array in the model starts on a cache line.
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
+    }
+
+    void deallocate(T *p, std::size_t) {
+        ::operator delete(p, std::align_val_t(ALIGNMENT));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// the finished classifier. generation works with HyperCircles which point into the training rows, but once we are done
+// we copy everything we need into here, as separate arrays (struct of arrays). the model owns all of it, so the training
+// set can be thrown away, and classification scans straight through the radii and centers instead of hopping through
+// center pointers.
+class HyperCircleModel {
+
+public:
+
+    int numAttributes;
+
+    int numClasses;
+
+    // the most classes a saved model can say it has. anything past this is a corrupt (or hostile) file, not a model,
+    // and would have us allocate per class arrays gigabytes long.
+    static constexpr int MAX_CLASSES = 1 << 20;
+
+    // numCircles rows of numAttributes floats, back to back
+    AlignedVector<float> centers;
+
+    AlignedVector<float> radii;
+
+    AlignedVector<int> labels;
+
+    // how many training points were in each circle
+    AlignedVector<int> counts;
+
+    // how many circles we have in each class. used by PER_CLASS_VOTE.
+    std::vector<int> circlesPerClass;
+
+    // how the centers are stored for the inside-a-circle check. see setPrecision.
+    enum {
+        FP32 = 0,
+        FP16 = 1,
+        INT8 = 2
+    };
+
+    int precision = FP32;
+
+    // compact copies of centers, laid out the same way. a center attribute is codeOffset[a] + codeScale[a] * code.
+    // for FP16 the offset is 0 and the scale is 1.
+    AlignedVector<int8_t> int8Centers;
+    AlignedVector<uint16_t> fp16Centers;
+    AlignedVector<float> codeScale;
+    AlignedVector<float> codeOffset;
+
+    // per circle, in the metric's power space. a compact distance under surelyInside is inside for sure, and one over
+    // surelyOutside is outside for sure. both are the radius moved by how far the compact center is from the real one.
+    AlignedVector<float> surelyInside;
+    AlignedVector<float> surelyOutside;
+
+    // landmark points for LAESA style pruning, see buildPivots. numPivots rows of numAttributes floats.
+    static constexpr int MAX_PIVOTS = 32;
+    int numPivots = 0;
+    AlignedVector<float> pivots;
+
+    // per circle, numPivots floats: the distance from its center to each pivot
+    AlignedVector<float> pivotDistances;
+
+    // optional LSH index over the centers, used by APPROX_CIRCLES
+    std::shared_ptr<const LSHIndex> circleIndex;
+
+    // a copy of centers on every node of replicaNodes, if replicateCenters made them. localCenters() finds the
+    // caller's node's copy.
+    std::vector<std::shared_ptr<const Numa::Buffer<float>>> centerReplicas;
+    std::shared_ptr<const Numa::Topology> replicaNodes;
+
+    HyperCircleModel();
+
+    // the label of each class id, from the training set (ClassMap::names). saved with the model, so a test file read
+    // against a loaded model gets the same ids without the training file. empty if we don't know them.
+    std::vector<std::string> classNames;
+
+    // copies the circles out of a generation run. the circles (and the training set they point into) can go away after this.
+    HyperCircleModel(const std::vector<HyperCircle> &circles, int numAttributes, int numClasses, std::vector<std::string> classNames = {});
+
+    int size() const {
+        return (int) radii.size();
+    }
+
+    const float *center(int circle) const {
+        return centers.data() + (size_t) circle * numAttributes;
+    }
+
+    // the centers to scan from the calling thread: its node's replica, or centers if there aren't any. finding the
+    // node costs a syscall on an unpinned thread, so look this up once per scan and index into it, not per circle.
+    const float *localCenters() const {
+        if (centerReplicas.empty())
+            return centers.data();
+        return centerReplicas[Numa::currentNode(*replicaNodes) % centerReplicas.size()]->data();
+    }
+
+    // when numa.replicate is on, gives every node (of the topology numa asks for) its own copy of the centers, written
+    // by a thread on that node so it lives there. every query scans all of them, so with threads on every socket that's
+    // where most cross socket reads go. with it off, drops any copies we had. the answers don't change either way.
+    void replicateCenters(const Numa::Config &numa);
+
+    // saves to a binary file which includes our attribute and class counts, so loading doesn't need any dataset.
+    void save(const std::string &fileName) const;
+
+    // loads a saved model. files from before the model had a header don't say how wide they are, so for those we need
+    // legacyNumAttributes (the training set's width) and legacyNumClasses. throws runtime_error if the file can't be
+    // read, or has a class count or label that doesn't make sense.
+    static HyperCircleModel load(const std::string &fileName, int legacyNumAttributes = 0, int legacyNumClasses = 0);
+
+    // builds a model out of the bytes of a saved file (the current format only) that are already in memory, like a
+    // memory mapped file. the arrays get copied out, so the bytes can go away afterwards.
+    static HyperCircleModel fromBytes(const char *bytes, size_t size);
+
+    // builds the compact centers the inside-a-circle check screens with first. only points which land right around a
+    // circle's edge get checked again against the real fp32 centers, so every answer stays exactly the same as FP32,
+    // but most circles only cost 1 (INT8) or 2 (FP16) bytes per attribute to rule out. FP32 drops the compact copies.
+    // worth it once the centers don't fit in cache. below that the decode costs more than the memory it saves.
+    void setPrecision(int precision);
+
+    // picks numPivots of the centers as pivots (each one as far as it can be from the ones picked before it), and
+    // works out every center's distance to them. a query then only measures its distance to the pivots, and the
+    // triangle inequality gives a range the distance to any center has to be in: |d(q, p) - d(c, p)| up to
+    // d(q, p) + d(c, p). that settles circles as surely outside (or surely inside) without touching their center,
+    // and lets the k nearest circle fallbacks skip centers which can't make the top k. answers don't change.
+    // works for every NORM, since they are all real metrics. 0 turns it back off.
+    // only worth it with a handful of attributes. with 30+ the ranges come out too wide to settle much, and the
+    // early abandoning distance kernels are already quicker.
+    void buildPivots(int numPivots);
+
+    // builds circleIndex for APPROX_CIRCLES. a point is inside a circle when it is within a radius of the center, so the
+    // bucket width is widthFactor times the median radius.
+    void buildIndex(int numTables, int hashesPerTable, float widthFactor);
+
+    // classifies one point. train is only used for the REGULAR_KNN fallback, and can be empty otherwise.
+    int classifyPoint(Dataset &train, const float *dataToCheck, int classificationMode, int subMode, int k) const;
+
+    // classifies every point in queries, spreading the work out however the parallelism policy says is cheapest.
+    std::vector<int> classifyPoints(Dataset &train, Dataset &queries, int classificationMode, int subMode, int k) const;
+
+    // classifies numRows rows of numAttributes floats laid out back to back, writing each label straight into rowLabels.
+    // nothing is copied, so this is what the library API uses. points no circle covers go to fallbackMode (one of the
+    // circle based fallbacks, since we have no training data here), or stay -1 if fallbackMode is USE_CIRCLES.
+    // if scores isn't null it gets numClasses floats per row, the votes each class got from the circles. rows no circle
+    // covered have all zero scores, even if the fallback labeled them.
+    void classifyRows(const float *rows, size_t numRows, int *rowLabels, int subMode, int fallbackMode, int k, float *scores = nullptr) const;
+
+    // classifyRows for sparse rows (numAttributes wide). a row costs its nonzeros per circle, not numAttributes: its
+    // distance to a center is the center's powerNorm, fixed up at just the row's columns. fallbackMode can be
+    // K_NEAREST_CIRCLES or K_NEAREST_RATIOS, anything else leaves uncovered rows at -1.
+    // throws runtime_error if rows are wider than we are.
+    void classifySparse(const SparseDataset &rows, int *rowLabels, int subMode, int fallbackMode, int k, float *scores = nullptr) const;
+
+    // the circle vote for a point whose distance to every circle (size() floats, like a row of a distance tile) we
+    // already have. the circles within their radius vote under subMode into votes (numClasses of them), and we return
+    // the winner, or -1 if none covered it. lets anything which measures a point against every circle anyway try all
+    // the voting modes without measuring again.
+    int voteFromDistances(const float *distances, int subMode, float *votes) const;
+
+    // the 1 / distance weighted vote of the k nearest centers (or by distance / radius). -1 if we have no circles or k is 0.
+    int kNearestCircle(const float *point, int k) const;
+
+    int kNearestCircleRatio(const float *point, int k) const;
+
+    // versions with our width baked in. see Utils::withDimension.
+    template <int DIM> int classifyPoint(Dataset &train, const float *dataToCheck, int classificationMode, int subMode, int k) const;
+    template <int DIM> int kNearestCircle(const float *point, int k) const;
+    template <int DIM> int kNearestCircleRatio(const float *point, int k) const;
+
+    // adds up the votes of every circle dataToCheck is inside of into votes (numClasses of them), and returns the winner,
+    // or -1 if no circle covered it. with candidates, only those circles get looked at.
+    template <int DIM> int circleVotes(const float *dataToCheck, int subMode, float *votes, const std::vector<int> *candidates = nullptr) const;
+
+    // whether dataToCheck is inside circle. shifted is dataToCheck minus codeOffset, only used when we are quantized.
+    // base is the centers to read, from localCenters().
+    template <int DIM> bool insideCircle(int circle, const float *dataToCheck, const float *shifted, const float *base) const;
+
+private:
+
+    // rebuilds circlesPerClass from labels. false (and nothing counted) if a label isn't one of our numClasses.
+    bool countCirclesPerClass();
+
+    // adds circle's vote for subMode into votes. distanceTo() is the query's distance to its center, and only gets called
+    // by the modes which use it. smallestCircle is SMALLEST_CIRCLE's (distance, circle) so far.
+    template <typename Distance> void castVote(int circle, int subMode, float *votes, std::pair<float, int> &smallestCircle, Distance distanceTo) const;
+
+    // the winner once every circle has voted, or -1 if none did
+    int countVotes(int subMode, float *votes, const std::pair<float, int> &smallestCircle) const;
+
+    // fills toPivots (numPivots floats) with point's distance to each pivot
+    template <int DIM> void distancesToPivots(const float *point, float *toPivots) const;
+
+    // the smallest distance from the query to circle's center that the pivots allow, padded down for rounding
+    float pivotLowerBound(int circle, const float *toPivots) const;
+
+    // the biggest one, padded up
+    float pivotUpperBound(int circle, const float *toPivots) const;
+};
+
+#endif //HYPERCIRCLEMODEL_H
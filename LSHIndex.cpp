@@ -0,0 +1,117 @@
+#include "LSHIndex.h"
+#include "Utils.h"
+#include <random>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+LSHIndex::LSHIndex(const float *rows, size_t n, int numAttributes, int numTables, int hashesPerTable, float bucketWidth, unsigned seed) {
+    this->numAttributes = numAttributes;
+    this->numTables = max(numTables, 1);
+    this->hashesPerTable = max(hashesPerTable, 1);
+    this->bucketWidth = bucketWidth > 0.0f ? bucketWidth : 1.0f;
+
+    // gaussian directions are what make projected distances track euclidean ones. cauchy does the same for manhattan.
+    mt19937 rng(seed);
+#if NORM == 1
+    cauchy_distribution<float> gaussian(0.0f, 1.0f);
+#else
+    normal_distribution<float> gaussian(0.0f, 1.0f);
+#endif
+    uniform_real_distribution<float> uniform(0.0f, this->bucketWidth);
+
+    const int numHashes = this->numTables * this->hashesPerTable;
+    directions.resize((size_t) numHashes * numAttributes);
+    offsets.resize(numHashes);
+    for (auto &d : directions)
+        d = gaussian(rng);
+    for (auto &o : offsets)
+        o = uniform(rng);
+
+    buckets.resize(this->numTables);
+    members.resize(this->numTables);
+
+    vector<pair<uint64_t, int>> keyed(n);
+    for (int t = 0; t < this->numTables; ++t) {
+
+        #pragma omp parallel for schedule(static)
+        for (long long r = 0; r < (long long) n; ++r)
+            keyed[r] = {bucketOf(t, rows + (size_t) r * numAttributes), (int) r};
+
+        // sort by bucket, so every bucket's members are next to each other
+        sort(keyed.begin(), keyed.end());
+
+        members[t].resize(n);
+        buckets[t].reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            members[t][i] = keyed[i].second;
+            auto &bucket = buckets[t][keyed[i].first];
+            if (bucket.second == 0)
+                bucket.first = (uint32_t) i;
+            bucket.second++;
+        }
+    }
+}
+
+uint64_t LSHIndex::bucketOf(int table, const float *row) const {
+
+    // mix the piece number along each direction into one key
+    uint64_t key = 0x9E3779B97F4A7C15ull * (table + 1);
+    for (int h = 0; h < hashesPerTable; ++h) {
+        const int which = table * hashesPerTable + h;
+        const float *direction = directions.data() + (size_t) which * numAttributes;
+
+        float projected = 0.0f;
+        for (int a = 0; a < numAttributes; ++a)
+            projected += direction[a] * row[a];
+
+        const int64_t piece = (int64_t) floorf((projected + offsets[which]) / bucketWidth);
+        key ^= (uint64_t) piece + 0x9E3779B97F4A7C15ull + (key << 6) + (key >> 2);
+    }
+    return key;
+}
+
+void LSHIndex::candidates(const float *query, vector<int> &out) const {
+    out.clear();
+    for (int t = 0; t < numTables; ++t) {
+        auto found = buckets[t].find(bucketOf(t, query));
+        if (found == buckets[t].end())
+            continue;
+        const auto &range = found->second;
+        out.insert(out.end(), members[t].begin() + range.first, members[t].begin() + range.first + range.second);
+    }
+
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+float LSHIndex::typicalSpacing(const float *rows, size_t n, int numAttributes, unsigned seed) {
+    if (n < 2)
+        return 1.0f;
+
+    // brute force nearest neighbors for a couple hundred rows is plenty to get a feel for the spacing
+    const size_t samples = min<size_t>(n, 256);
+    mt19937 rng(seed);
+    uniform_int_distribution<size_t> pick(0, n - 1);
+
+    vector<size_t> sampled(samples);
+    for (size_t s = 0; s < samples; ++s)
+        sampled[s] = samples == n ? s : pick(rng);
+
+    vector<float> nearest(samples);
+    #pragma omp parallel for schedule(static)
+    for (long long s = 0; s < (long long) samples; ++s) {
+        const size_t me = sampled[s];
+        float best = numeric_limits<float>::max();
+        for (size_t other = 0; other < n; ++other) {
+            if (other == me)
+                continue;
+            best = min(best, Utils::boundedDistance(rows + me * numAttributes, rows + other * numAttributes, numAttributes, best));
+        }
+        nearest[s] = best;
+    }
+
+    nth_element(nearest.begin(), nearest.begin() + samples / 2, nearest.end());
+    const float median = nearest[samples / 2];
+    return median > 0.0f ? median : 1.0f;
+}
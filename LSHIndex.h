@@ -0,0 +1,54 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef LSHINDEX_H
+#define LSHINDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// random projection locality sensitive hashing (the p-stable kind, so it goes with our NORM for 1 and 2. 3 gets the
+// euclidean version, which still groups close rows together, just a little less tightly).
+// each table projects a row onto hashesPerTable random directions and chops each projection into bucketWidth sized
+// pieces. rows close together usually land in the same piece of every direction, so they share a bucket. a query
+// only looks at the rows sharing a bucket with it in at least one table, instead of all of them.
+// this is approximate: something close can get unlucky and miss in every table. more tables finds more of them, more
+// hashes per table makes buckets smaller (faster but misses more), and a wider bucket catches things further away.
+class LSHIndex {
+public:
+
+    // indexes n rows of numAttributes floats, back to back. row ids are their position, starting at 0.
+    LSHIndex(const float *rows, size_t n, int numAttributes, int numTables, int hashesPerTable, float bucketWidth, unsigned seed = 42);
+
+    // fills out with the ids of every row sharing a bucket with query in any table, sorted, no repeats.
+    void candidates(const float *query, std::vector<int> &out) const;
+
+    // a starting point for bucketWidth: the median distance from a sample of rows to their nearest other row.
+    static float typicalSpacing(const float *rows, size_t n, int numAttributes, unsigned seed = 42);
+
+    int numTables;
+    int hashesPerTable;
+    float bucketWidth;
+
+private:
+
+    int numAttributes;
+
+    // numTables * hashesPerTable random directions of numAttributes floats, and a random offset for each
+    std::vector<float> directions;
+    std::vector<float> offsets;
+
+    // per table: bucket key -> (start, count) in that table's members
+    std::vector<std::unordered_map<uint64_t, std::pair<uint32_t, uint32_t>>> buckets;
+
+    // per table: every row id, grouped by bucket
+    std::vector<std::vector<int>> members;
+
+    uint64_t bucketOf(int table, const float *row) const;
+};
+
+#endif //LSHINDEX_H
@@ -0,0 +1,154 @@
+#include "NeighborGraph.h"
+#include "LSHIndex.h"
+#include "Parallelism.h"
+#include "TopK.h"
+#include "Utils.h"
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+// the k cheapest we kept, cheapest first. ties go to the lower circle id, same as mergeCircles sorting (cost, id) pairs.
+static vector<NeighborGraph::Neighbor> cheapestFirst(const TopK &cheapest) {
+    vector<TopK::Entry> items = cheapest.items();
+    sort(items.begin(), items.end());
+
+    vector<NeighborGraph::Neighbor> list;
+    list.reserve(items.size());
+    for (const auto &[cost, circle] : items)
+        list.push_back({cost, circle});
+    return list;
+}
+
+// what it costs a circle centered at center to eat other. the distance only matters if the total can beat bound, so
+// it can stop early. it's the exact same sum mergeCircles makes, so the order comes out the same too.
+template <int DIM>
+static float costOf(const float *center, const HyperCircle &other, int numAttributes, float bound) {
+    if (other.radius > bound)
+        return numeric_limits<float>::max();
+    const float distance = Utils::boundedDistance<DIM>(center, other.centerPoint, numAttributes, bound - other.radius);
+    return distance == numeric_limits<float>::max() ? distance : distance + other.radius;
+}
+
+NeighborGraph NeighborGraph::exact(const vector<HyperCircle> &circles, int numAttributes, int k) {
+    NeighborGraph graph;
+    graph.k = max(k, 1);
+    graph.isExact = true;
+    Utils::withDimension(numAttributes, [&](auto dim) { graph.buildExact<decltype(dim)::value>(circles, numAttributes); });
+    return graph;
+}
+
+NeighborGraph NeighborGraph::approximate(const vector<HyperCircle> &circles, int numAttributes, int k, int numTables, int hashesPerTable, float widthFactor) {
+    NeighborGraph graph;
+    graph.k = max(k, 1);
+    graph.isExact = false;
+    Utils::withDimension(numAttributes, [&](auto dim) {
+        graph.buildApproximate<decltype(dim)::value>(circles, numAttributes, numTables, hashesPerTable, widthFactor);
+    });
+    return graph;
+}
+
+template <int DIM>
+void NeighborGraph::buildExact(const vector<HyperCircle> &circles, int numAttributes) {
+
+    // each class's circles in order, so a circle only walks the ones after it in its own class
+    vector<vector<int>> byClass;
+    vector<int> position(circles.size());
+    for (int c = 0; c < circles.size(); ++c) {
+        if (circles[c].classification >= byClass.size())
+            byClass.resize(circles[c].classification + 1);
+        position[c] = (int) byClass[circles[c].classification].size();
+        byClass[circles[c].classification].push_back(c);
+    }
+
+    vector<vector<Neighbor>> lists(circles.size());
+
+    // the early circles have the most later ones to look at, so hand them out dynamically
+    #pragma omp parallel for schedule(dynamic, 16) if(Parallelism::choose(circles.size(), circles.size(), numAttributes) != Parallelism::SERIAL)
+    for (int c = 0; c < circles.size(); ++c) {
+        const vector<int> &same = byClass[circles[c].classification];
+        const float *center = circles[c].centerPoint;
+
+        // once we have k, a circle only gets measured as far as it takes to know it isn't cheaper than our kth
+        TopK cheapest(k);
+        for (int s = position[c] + 1; s < same.size(); ++s)
+            cheapest.push(costOf<DIM>(center, circles[same[s]], numAttributes, cheapest.bound()), same[s]);
+
+        lists[c] = cheapestFirst(cheapest);
+    }
+
+    pack(lists);
+}
+
+NeighborGraph NeighborGraph::fromLists(vector<vector<Neighbor>> &lists, int k) {
+    NeighborGraph graph;
+    graph.k = max(k, 1);
+    graph.isExact = true;
+    graph.pack(lists);
+    return graph;
+}
+
+void NeighborGraph::findCheapest(const HyperCircle &circle, int id, const vector<HyperCircle> &candidates, const vector<int> &ids, int numAttributes, TopK &cheapest) {
+    Utils::withDimension(numAttributes, [&](auto dim) { findCheapest<decltype(dim)::value>(circle, id, candidates, ids, numAttributes, cheapest); });
+}
+
+template <int DIM>
+void NeighborGraph::findCheapest(const HyperCircle &circle, int id, const vector<HyperCircle> &candidates, const vector<int> &ids, int numAttributes, TopK &cheapest) {
+    for (int s = 0; s < candidates.size(); ++s)
+        if (ids[s] > id && candidates[s].classification == circle.classification)
+            cheapest.push(costOf<DIM>(circle.centerPoint, candidates[s], numAttributes, cheapest.bound()), ids[s]);
+}
+
+template <int DIM>
+void NeighborGraph::buildApproximate(const vector<HyperCircle> &circles, int numAttributes, int numTables, int hashesPerTable, float widthFactor) {
+
+    vector<float> centers;
+    centers.reserve(circles.size() * numAttributes);
+    for (const HyperCircle &c : circles)
+        centers.insert(centers.end(), c.centerPoint, c.centerPoint + numAttributes);
+
+    // circles about as far apart as a typical radius are the ones which have a shot at merging
+    vector<float> radii;
+    radii.reserve(circles.size());
+    for (const HyperCircle &c : circles)
+        radii.push_back(c.radius);
+    float width = 1.0f;
+    if (!radii.empty()) {
+        nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+        width = radii[radii.size() / 2] > 0.0f ? radii[radii.size() / 2] : 1.0f;
+    }
+    const LSHIndex index(centers.data(), circles.size(), numAttributes, numTables, hashesPerTable, widthFactor * width);
+
+    vector<vector<Neighbor>> lists(circles.size());
+
+    #pragma omp parallel if(Parallelism::choose(circles.size(), numTables * hashesPerTable, numAttributes) != Parallelism::SERIAL)
+    {
+        vector<int> nearby;
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int c = 0; c < circles.size(); ++c) {
+            index.candidates(circles[c].centerPoint, nearby);
+
+            // candidates come back sorted, so skip straight past everyone before us
+            TopK cheapest(k);
+            for (auto other = upper_bound(nearby.begin(), nearby.end(), c); other != nearby.end(); ++other) {
+                if (circles[*other].classification != circles[c].classification)
+                    continue;
+                cheapest.push(costOf<DIM>(circles[c].centerPoint, circles[*other], numAttributes, cheapest.bound()), *other);
+            }
+
+            lists[c] = cheapestFirst(cheapest);
+        }
+    }
+
+    pack(lists);
+}
+
+void NeighborGraph::pack(vector<vector<Neighbor>> &lists) {
+    start.assign(lists.size() + 1, 0);
+    for (size_t c = 0; c < lists.size(); ++c)
+        start[c + 1] = start[c] + lists[c].size();
+
+    neighbors.resize(start.back());
+    for (size_t c = 0; c < lists.size(); ++c)
+        copy(lists[c].begin(), lists[c].end(), neighbors.begin() + start[c]);
+}
@@ -0,0 +1,81 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef NEIGHBORGRAPH_H
+#define NEIGHBORGRAPH_H
+
+#include <vector>
+#include <span>
+#include <cstddef>
+
+#include "HyperCircle.h"
+
+class TopK;
+
+// for every circle, the k circles of its class which come after it in the list and would be cheapest to eat, cheapest
+// first. eating one means growing to the distance between our centers plus its radius, and that's the order mergeCircles
+// tries them in, so working these out once up front means the merge only ever reads a handful of them, instead of
+// measuring and sorting every later circle of the class every time it gets to a circle.
+class NeighborGraph {
+public:
+
+    struct Neighbor {
+        // distance between the centers plus the neighbor's radius
+        float cost;
+        int circle;
+    };
+
+    // exact: measures each circle against every later circle of its class (stopping early on the ones which can't make
+    // the k cheapest). a list shorter than k means there weren't k later circles of that class.
+    // build it right before merging. a circle's cost uses its neighbors' radii as they are now.
+    static NeighborGraph exact(const std::vector<HyperCircle> &circles, int numAttributes, int k);
+
+    // approximate: each circle only gets measured against the circles sharing an LSH bucket with it (see LSHIndex).
+    // bucket width is widthFactor times the median radius. a lot cheaper on big sets, but a close circle can get missed.
+    static NeighborGraph approximate(const std::vector<HyperCircle> &circles, int numAttributes, int k,
+                                     int numTables = 8, int hashesPerTable = 4, float widthFactor = 2.0f);
+
+    // a graph out of lists worked out somewhere else (like the workers of a sharded run), one per circle, cheapest
+    // first. each has to be the k cheapest later circles of its class, or all of them if there are fewer, like exact.
+    static NeighborGraph fromLists(std::vector<std::vector<Neighbor>> &lists, int k);
+
+    // carries the search for circle's k cheapest on over candidates. id is circle's place in the whole list, and ids
+    // are the candidates' places, since only the ones of its class after it count. cheapest is what the candidates
+    // before found. it comes out the same whatever order they come in, so a sharded run can hand them over in blocks.
+    static void findCheapest(const HyperCircle &circle, int id, const std::vector<HyperCircle> &candidates,
+                             const std::vector<int> &ids, int numAttributes, TopK &cheapest);
+
+    int k = 0;
+
+    // whether every list really is the k cheapest. if not, a cheaper circle than some on the list might be missing.
+    bool isExact = false;
+
+    size_t size() const { return start.empty() ? 0 : start.size() - 1; }
+
+    std::span<const Neighbor> of(int circle) const {
+        return {neighbors.data() + start[circle], neighbors.data() + start[circle + 1]};
+    }
+
+    // whether circle's list has every later circle of its class on it
+    bool complete(int circle) const {
+        return isExact && start[circle + 1] - start[circle] < (size_t) k;
+    }
+
+private:
+
+    // circle c's list is neighbors[start[c], start[c + 1])
+    std::vector<size_t> start;
+    std::vector<Neighbor> neighbors;
+
+    template <int DIM> void buildExact(const std::vector<HyperCircle> &circles, int numAttributes);
+    template <int DIM> static void findCheapest(const HyperCircle &circle, int id, const std::vector<HyperCircle> &candidates,
+                                                const std::vector<int> &ids, int numAttributes, TopK &cheapest);
+    template <int DIM> void buildApproximate(const std::vector<HyperCircle> &circles, int numAttributes, int numTables,
+                                             int hashesPerTable, float widthFactor);
+
+    // stitches per circle lists (already cheapest first) into start / neighbors
+    void pack(std::vector<std::vector<Neighbor>> &lists);
+};
+
+#endif //NEIGHBORGRAPH_H
@@ -0,0 +1,338 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <memory>
+#include <new>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// decides WHERE our big arrays live on machines with more than one memory node (socket). memory goes on the node of
+// whichever thread touches a page first, so the training rows readFile parses on the main thread all end up on the
+// main thread's socket, and every thread on the other one reads them from across the link. that link is what runs out
+// first once there are enough threads. so we can:
+//   - place the big arrays (dataset rows, distance tiles) by first touch, each page touched first by the thread whose
+//     static share of the work it is, or interleaved, pages going round robin over the nodes so both links share it
+//   - give every node its own copy of a model's centers, which every query scans (see HyperCircleModel::replicateCenters)
+//   - pin the OpenMP threads, each to the cpus of one node, so a thread stays next to its memory
+// none of it is global: whoever reads a dataset, builds a model or runs a server says how with a Config, and
+// everything is off unless it asks. the topology comes from /sys on linux, or can be simulated by splitting our cpus
+// into simulatedNodes fake nodes, so all of it runs (and gives the same answers) on a one socket machine. answers never
+// depend on any of this, only where the bytes are.
+class Numa {
+public:
+
+    // how to place a fresh array
+    enum {
+        OFF = 0,         // however it falls out: the thread that allocates touches all of it
+        FIRST_TOUCH = 1, // each thread touches the pages of its static share, so they land on its node
+        INTERLEAVE = 2   // pages round robin over the nodes
+    };
+
+    // how one dataset, model or server wants its memory laid out
+    struct Config {
+        // for fresh arrays: the rows of a dataset read with this, and the distance tiles a sweep over it makes
+        int placement = OFF;
+
+        // whether a model keeps a copy of its centers on every node
+        bool replicate = false;
+
+        // 0 for the real topology, otherwise this many nodes made up out of our cpus
+        int simulatedNodes = 0;
+    };
+
+    static constexpr size_t PAGE = 4096;
+
+    // the highest node number we look for
+    static constexpr int MAX_NODES = 64;
+
+    // the nodes, each with the cpus of it we're allowed to run on
+    struct Topology {
+        std::vector<std::vector<int>> cpus;
+
+        // cpu number -> node, 0 for cpus we don't know
+        std::vector<int> nodeOfCpu;
+
+        int size() const { return (int) cpus.size(); }
+    };
+
+    // worked out the first time anyone asks for this many simulated nodes (or the real ones), and never changed or
+    // freed after, so it's safe to hold on to from any thread
+    static std::shared_ptr<const Topology> topology(int simulatedNodes = 0) {
+        std::lock_guard<std::mutex> guard(lock());
+        auto &found = cache()[std::max(simulatedNodes, 0)];
+        if (!found)
+            found = detect(simulatedNodes);
+        return found;
+    }
+
+    // thread t of numThreads works on node t * nodes / numThreads. static schedules hand out contiguous shares in thread
+    // order too, so a thread's share of an array is on its own node.
+    static int nodeOfThread(int thread, int numThreads, const Topology &nodes) {
+        return (int) ((long long) thread * nodes.size() / std::max(numThreads, 1));
+    }
+
+    // the node of nodes the calling thread is on: the one it was pinned to under nodes, or else wherever it's running
+    // right now. unpinned threads can move, so ask once per scan, not once per row you read.
+    static int currentNode(const Topology &nodes) {
+        if (pinnedTopology() == &nodes)
+            return pinnedNode();
+        const int cpu = runningOn();
+        return cpu >= 0 && cpu < nodes.nodeOfCpu.size() ? nodes.nodeOfCpu[cpu] : 0;
+    }
+
+    // keeps the calling thread on node's cpus. false if we can't (not linux, or it failed).
+    static bool pinTo(int node, const Topology &nodes) {
+        if (node < 0 || node >= nodes.size())
+            return false;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : nodes.cpus[node])
+            CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            return false;
+        pinnedNode() = node;
+        pinnedTopology() = &nodes;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // pins every OpenMP thread to its node, by nodeOfThread. the runtime keeps its threads between regions, so they
+    // stay pinned. returns how many threads it managed.
+    static int pinThreads(int simulatedNodes = 0) {
+        const auto nodes = topology(simulatedNodes);
+        int pinned = 0;
+        #pragma omp parallel reduction(+ : pinned)
+        {
+            pinned += pinTo(nodeOfThread(threadNum(), teamSize(), *nodes), *nodes);
+        }
+        return pinned;
+    }
+
+    // runs job(node) once for every node, each on its own thread pinned to that node, all at once
+    template <typename Job>
+    static void onEachNode(const Topology &nodes, Job &&job) {
+        std::vector<std::thread> threads;
+        for (int node = 0; node < nodes.size(); ++node)
+            threads.emplace_back([&job, &nodes, node]() {
+                pinTo(node, nodes);
+                job(node);
+            });
+        for (auto &t : threads)
+            t.join();
+    }
+
+    // zeros bytes (page aligned) in a way that puts its pages where config's placement says
+    static void place(char *bytes, size_t size, const Config &config) {
+        const size_t pages = (size + PAGE - 1) / PAGE;
+        auto zeroPage = [&](size_t p) {
+            memset(bytes + p * PAGE, 0, std::min(PAGE, size - p * PAGE));
+        };
+
+        const auto nodes = topology(config.simulatedNodes);
+        if (config.placement == FIRST_TOUCH) {
+            #pragma omp parallel for schedule(static)
+            for (long long p = 0; p < (long long) pages; ++p)
+                zeroPage(p);
+        } else if (config.placement == INTERLEAVE && nodes->size() > 1) {
+            const int n = nodes->size();
+            onEachNode(*nodes, [&](int node) {
+                for (size_t p = node; p < pages; p += n)
+                    zeroPage(p);
+            });
+        } else
+            memset(bytes, 0, size);
+    }
+
+    // an array of trivial Ts on pages of its own, placed when it's made. starts out zeroed, like a vector.
+    template <typename T>
+    class Buffer {
+    public:
+        Buffer() = default;
+
+        explicit Buffer(size_t count, const Config &config = {}) : count(count) {
+            if (count == 0)
+                return;
+            // new memory this big comes straight from the kernel, and nothing has touched it yet
+            block.reset(static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t(PAGE))));
+            place(reinterpret_cast<char *>(block.get()), count * sizeof(T), config);
+        }
+
+        T *data() { return block.get(); }
+        const T *data() const { return block.get(); }
+        size_t size() const { return count; }
+
+        T &operator[](size_t i) { return block[i]; }
+        const T &operator[](size_t i) const { return block[i]; }
+
+    private:
+        struct Free {
+            void operator()(T *p) const { ::operator delete(p, std::align_val_t(PAGE)); }
+        };
+
+        size_t count = 0;
+        std::unique_ptr<T[], Free> block;
+    };
+
+    static const char *placementName(int how) {
+        switch (how) {
+            case FIRST_TOUCH: return "first touch";
+            case INTERLEAVE: return "interleaved";
+            default: return "off";
+        }
+    }
+
+private:
+
+    static std::mutex &lock() {
+        static std::mutex m;
+        return m;
+    }
+
+    // simulatedNodes -> its topology
+    static std::map<int, std::shared_ptr<const Topology>> &cache() {
+        static std::map<int, std::shared_ptr<const Topology>> c;
+        return c;
+    }
+
+    static int &pinnedNode() {
+        thread_local int node = -1;
+        return node;
+    }
+
+    // the topology the calling thread was pinned under, so a thread pinned for one doesn't answer for another
+    static const Topology *&pinnedTopology() {
+        thread_local const Topology *nodes = nullptr;
+        return nodes;
+    }
+
+    static int threadNum() {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return 0;
+#endif
+    }
+
+    static int teamSize() {
+#ifdef _OPENMP
+        return omp_get_num_threads();
+#else
+        return 1;
+#endif
+    }
+
+    static int runningOn() {
+#ifdef __linux__
+        return sched_getcpu();
+#else
+        return 0;
+#endif
+    }
+
+    // the cpus we may run on
+    static std::vector<int> allowedCpus() {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &set))
+                    cpus.push_back(cpu);
+#endif
+        if (cpus.empty())
+            cpus.push_back(0);
+        return cpus;
+    }
+
+    // "0-3,8-11" style cpu lists, like /sys writes them
+    static std::vector<int> parseCpuList(const std::string &text) {
+        std::vector<int> cpus;
+        std::stringstream ss(text);
+        std::string range;
+        while (std::getline(ss, range, ',')) {
+            if (range.empty() || range == "\n")
+                continue;
+            const size_t dash = range.find('-');
+            try {
+                const int lo = std::stoi(range.substr(0, dash));
+                const int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+                for (int cpu = lo; cpu <= hi; ++cpu)
+                    cpus.push_back(cpu);
+            } catch (...) {
+                continue;
+            }
+        }
+        return cpus;
+    }
+
+    static std::shared_ptr<const Topology> detect(int simulatedNodes) {
+        const std::vector<int> allowed = allowedCpus();
+        auto found = std::make_shared<Topology>();
+        auto &nodes = found->cpus;
+
+        // made up: our cpus split into simulatedNodes contiguous groups. with fewer cpus than nodes they get shared.
+        if (simulatedNodes > 0) {
+            for (int node = 0; node < simulatedNodes; ++node) {
+                nodes.emplace_back();
+                for (size_t i = allowed.size() * node / simulatedNodes; i < allowed.size() * (node + 1) / simulatedNodes; ++i)
+                    nodes.back().push_back(allowed[i]);
+                if (nodes.back().empty())
+                    nodes.back().push_back(allowed[node % allowed.size()]);
+            }
+        }
+
+#ifdef __linux__
+        // nodes with none of our cpus don't count. node numbers can have gaps.
+        for (int node = 0; simulatedNodes <= 0 && node < MAX_NODES; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file.is_open())
+                continue;
+            std::string text;
+            std::getline(file, text);
+            std::vector<int> cpus;
+            for (int cpu : parseCpuList(text))
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                    cpus.push_back(cpu);
+            if (!cpus.empty())
+                nodes.push_back(cpus);
+        }
+#endif
+        if (nodes.empty())
+            nodes.push_back(allowed);
+
+        // a shared cpu goes to the first node that has it
+        for (int node = (int) nodes.size() - 1; node >= 0; --node)
+            for (int cpu : nodes[node]) {
+                if (cpu >= found->nodeOfCpu.size())
+                    found->nodeOfCpu.resize(cpu + 1, 0);
+                found->nodeOfCpu[cpu] = node;
+            }
+        return found;
+    }
+};
+
+#endif //NUMA_H
@@ -0,0 +1,131 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef PARALLELISM_H
+#define PARALLELISM_H
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Utils.h"
+
+// decides HOW we spread work across threads. starting an omp parallel region for every single query costs more than
+// scanning a 150 row training set, so instead we look at how many queries we have, how many candidates each one scans,
+// and how wide the points are, and pick between going across queries, going within a query, or just running serial.
+// the two costs we compare are measured once at startup by calibrate().
+class Parallelism {
+public:
+
+    // the different ways we can run a batch of work
+    enum {
+        SERIAL = 0,      // one thread does everything. best for tiny jobs.
+        INTER_QUERY = 1, // each thread takes whole queries (or whole circles during generation)
+        INTRA_QUERY = 2  // every query splits its candidate scan across all the threads
+    };
+
+    // seconds it takes to open and close an empty parallel region with all our threads
+    static inline double forkJoinCost = 5e-6;
+
+    // seconds per attribute of one distance computation
+    static inline double attributeCost = 1e-9;
+
+    // how many times bigger than the fork/join cost the work has to be before we bother splitting it
+    static inline double minSpeedup = 4.0;
+
+    // how many threads we would get in a parallel region
+    static int numThreads() {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    // quick probe which measures our fork/join overhead and the cost of a distance. takes a couple milliseconds.
+    static void calibrate() {
+        using clock = std::chrono::steady_clock;
+
+        // time a bunch of empty parallel regions, and take the average. the region is a call into the runtime, so it
+        // doesn't need anything in it to not get thrown away.
+        const int regions = 64;
+        auto start = clock::now();
+        for (int r = 0; r < regions; ++r) {
+            #pragma omp parallel
+            {
+            }
+        }
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        forkJoinCost = std::max(elapsed / regions, 1e-7);
+
+        // time distances between a couple of 64 wide rows. we use the per attribute cost since that is what scales.
+        const int width = 64;
+        const int reps = 4096;
+        std::vector<float> a(width), b(width);
+        for (int i = 0; i < width; ++i) {
+            a[i] = (float) i * 0.5f;
+            b[i] = (float) (width - i) * 0.25f;
+        }
+        float total = 0.0f;
+        start = clock::now();
+        for (int r = 0; r < reps; ++r) {
+            a[r % width] += 1e-3f;
+            total += Utils::distance(a.data(), b.data(), width);
+        }
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+        // hand the total off and read it back, so the distances can't be optimized away as unused
+        std::atomic<int> sink {0};
+        sink.store((int) total, std::memory_order_relaxed);
+        (void) sink.load(std::memory_order_relaxed);
+        attributeCost = std::max(elapsed / ((double) reps * width), 1e-11);
+    }
+
+    // picks how to run a batch of numQueries jobs, where each one scans numCandidates rows of numAttributes floats.
+    static int choose(size_t numQueries, size_t numCandidates, int numAttributes) {
+
+        const int threads = numThreads();
+
+        // already inside someone else's parallel region, or no threads to go around
+        if (threads <= 1 || inParallel())
+            return SERIAL;
+
+        const double perQuery = (double) numCandidates * numAttributes * attributeCost;
+        const double total = perQuery * (double) numQueries;
+
+        // not even the whole batch is worth waking up the other threads for
+        if (total < forkJoinCost * minSpeedup)
+            return SERIAL;
+
+        // enough queries to give every thread some, so one region around the whole batch is cheapest
+        if (numQueries >= (size_t) threads)
+            return INTER_QUERY;
+
+        // few queries, so split each one up if a single scan is big enough to pay for its own region
+        if (perQuery >= forkJoinCost * minSpeedup)
+            return INTRA_QUERY;
+
+        return numQueries > 1 ? INTER_QUERY : SERIAL;
+    }
+
+    // used for the if() clause on loops inside a single query. true when splitting that one scan up pays off.
+    static bool intraQuery(size_t numCandidates, int numAttributes) {
+        return choose(1, numCandidates, numAttributes) == INTRA_QUERY;
+    }
+
+    static bool inParallel() {
+#ifdef _OPENMP
+        return omp_in_parallel();
+#else
+        return false;
+#endif
+    }
+
+};
+
+#endif //PARALLELISM_H
@@ -11,13 +11,15 @@ class Point {
     float *location;
     // the actual class
     int classification;
+    // how many identical training rows this point stands for. see Dataset::collapsed.
+    int weight;
 
-    // amount of attributes in dataset.
-    static int numAttributes;
+    // how wide the point is lives on its Dataset, so that different datasets can be loaded at once.
 
-    Point(float *attributes, int cls) {
+    Point(float *attributes, int cls, int weight = 1) {
         location = attributes;
         classification = cls;
+        this->weight = weight;
     }
 
 };
@@ -0,0 +1,215 @@
+#include "SparseDataset.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <unordered_map>
+#include <cstdint>
+#include <stdexcept>
+using namespace std;
+
+SparseDataset::SparseDataset() {
+    classes = make_shared<ClassMap>();
+}
+
+void SparseDataset::addRow(vector<pair<int, float>> entries, int label) {
+    stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    if (!entries.empty() && entries.front().first < 0)
+        throw runtime_error("Negative column in a sparse row: " + to_string(entries.front().first));
+
+    for (size_t e = 0; e < entries.size(); ++e) {
+        // a column listed twice keeps the last value, like a dense row written over. the sort is stable, so that's
+        // the last of its run. this goes before dropping zeros so a zero written over a value still wins.
+        if (e + 1 < entries.size() && entries[e + 1].first == entries[e].first)
+            continue;
+
+        const auto &[column, value] = entries[e];
+        if (value == 0.0f)
+            continue;
+        columns.push_back(column);
+        values.push_back(value);
+        numAttributes = max(numAttributes, column + 1);
+    }
+    const double powerSum = Utils::powerNorm(values.data() + rowStart.back(), (int) (values.size() - rowStart.back()));
+
+    rowStart.push_back(columns.size());
+    labels.push_back(label);
+    powerNorms.push_back(powerSum);
+    norms.push_back(Utils::fromPower((float) powerSum));
+}
+
+// strips a '\r' left over from windows line endings
+static void trimLine(string &s) {
+    if (!s.empty() && s.back() == '\r')
+        s.pop_back();
+}
+
+SparseDataset SparseDataset::readFile(const string &fileName, shared_ptr<ClassMap> classes, int numAttributes) {
+
+    SparseDataset data;
+    if (classes)
+        data.classes = classes;
+
+#ifdef _WIN32
+    const string realName = "datasets\\" + fileName;
+#else
+    const string realName = "datasets/" + fileName;
+#endif
+
+    ifstream file(realName);
+    if (!file.is_open()) {
+        cerr << "Failed to open file: " << fileName << endl;
+        return data;
+    }
+
+    string line;
+    vector<pair<int, float>> entries;
+    const bool csv = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0;
+
+    if (csv) {
+        // header tells us how many columns there are, same as Dataset::readFile
+        if (!getline(file, line))
+            return data;
+
+        stringstream headerSS(line);
+        int columnCount = 0;
+        string token;
+        while (getline(headerSS, token, ','))
+            ++columnCount;
+        // with a width passed in, columns past it only get through as zeros, like the libsvm rows below
+        if (numAttributes <= 0)
+            numAttributes = columnCount - 1;
+
+        while (getline(file, line)) {
+            trimLine(line);
+            stringstream ss(line);
+            vector<string> tokens;
+            while (getline(ss, token, ','))
+                tokens.push_back(token);
+
+            if (tokens.size() != columnCount) {
+                cerr << "Skipping malformed row: " << line << endl;
+                continue;
+            }
+
+            entries.clear();
+            bool good = true;
+            try {
+                for (int i = 0; i < columnCount - 1; ++i) {
+                    const float value = stof(tokens[i]);
+                    if (value == 0.0f)
+                        continue;
+                    if (i >= numAttributes) {
+                        good = false;
+                        break;
+                    }
+                    entries.emplace_back(i, value);
+                }
+            } catch (...) {
+                cerr << "Failed to parse floats on line: " << line << endl;
+                continue;
+            }
+
+            if (!good) {
+                cerr << "Skipping malformed row: " << line << endl;
+                continue;
+            }
+
+            data.addRow(entries, data.classes->idFor(tokens.back()));
+        }
+    } else {
+        while (getline(file, line)) {
+            trimLine(line);
+            stringstream ss(line);
+            string label, token;
+            if (!(ss >> label) || label[0] == '#')
+                continue;
+
+            entries.clear();
+            bool good = true;
+            while (ss >> token) {
+                const size_t colon = token.find(':');
+
+                // libsvm ranking files tag rows with qid:N. that isn't an attribute.
+                if (colon == string::npos || token.compare(0, colon, "qid") == 0)
+                    continue;
+
+                try {
+                    const int column = stoi(token.substr(0, colon));
+                    if (column < 1 || (numAttributes > 0 && column > numAttributes)) {
+                        good = false;
+                        break;
+                    }
+                    entries.emplace_back(column - 1, stof(token.substr(colon + 1)));
+                } catch (...) {
+                    good = false;
+                    break;
+                }
+            }
+
+            if (!good) {
+                cerr << "Skipping malformed row: " << line << endl;
+                continue;
+            }
+            data.addRow(entries, data.classes->idFor(label));
+        }
+    }
+
+    data.numAttributes = max(data.numAttributes, numAttributes);
+    return data;
+}
+
+void SparseDataset::scatter(size_t row, float *dense) const {
+    for (size_t at = rowStart[row]; at < rowStart[row + 1]; ++at)
+        dense[columns[at]] = values[at];
+}
+
+void SparseDataset::unscatter(size_t row, float *dense) const {
+    for (size_t at = rowStart[row]; at < rowStart[row + 1]; ++at)
+        dense[columns[at]] = 0.0f;
+}
+
+vector<int> SparseDataset::distinctRows(vector<int> &weights) const {
+    vector<int> rows;
+    weights.clear();
+
+    // row hash -> the distinct rows with that hash. zeros are never stored, so equal rows store exactly the same thing.
+    unordered_map<uint64_t, vector<int>> seen;
+    for (int row = 0; row < (int) size(); ++row) {
+        uint64_t hash = 0xcbf29ce484222325ull ^ (uint64_t) labels[row];
+        for (size_t at = rowStart[row]; at < rowStart[row + 1]; ++at) {
+            hash = (hash ^ (uint32_t) columns[at]) * 0x100000001b3ull;
+            hash = (hash ^ bit_cast<uint32_t>(values[at])) * 0x100000001b3ull;
+        }
+
+        int same = -1;
+        for (int d : seen[hash]) {
+            const int other = rows[d];
+            if (labels[other] == labels[row] && nonzeros(other) == nonzeros(row)
+                && equal(columnsOf(row), columnsOf(row) + nonzeros(row), columnsOf(other))
+                && equal(valuesOf(row), valuesOf(row) + nonzeros(row), valuesOf(other))) {
+                same = d;
+                break;
+            }
+        }
+
+        if (same != -1) {
+            weights[same]++;
+        } else {
+            seen[hash].push_back((int) rows.size());
+            rows.push_back(row);
+            weights.push_back(1);
+        }
+    }
+    return rows;
+}
+
+float *SparseDataset::denseCopy(const vector<int> &rows) {
+    auto block = make_shared<vector<float>>((size_t) rows.size() * numAttributes, 0.0f);
+    for (size_t i = 0; i < rows.size(); ++i)
+        scatter(rows[i], block->data() + i * numAttributes);
+    denseCopies.push_back(block);
+    return block->data();
+}
@@ -0,0 +1,96 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef SPARSEDATASET_H
+#define SPARSEDATASET_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cmath>
+
+#include "Dataset.h"
+#include "Utils.h"
+
+// a dataset which only stores each row's nonzero attributes (compressed rows: every row's columns and values back to
+// back, and where each row starts). for feature sets with thousands of columns that are almost all zero, a dense row
+// is mostly zeros we keep in memory and run through on every distance. here a row costs what it has.
+class SparseDataset {
+public:
+
+    // how wide the rows would be dense
+    int numAttributes = 0;
+
+    // row r's nonzeros are columns / values [rowStart[r], rowStart[r + 1]), columns ascending
+    std::vector<size_t> rowStart {0};
+    std::vector<int> columns;
+    std::vector<float> values;
+
+    // class id of each row
+    std::vector<int> labels;
+
+    // each row's powerNorm (Utils::powerNorm, its power sum against all zeros), and its norm, its distance from all
+    // zeros. the power norms let a distance only visit one row's nonzeros (Utils::sparseDensePowerSum). the norms rule
+    // rows out before that: two rows can't be closer than the difference of their norms.
+    std::vector<double> powerNorms;
+    std::vector<float> norms;
+
+    // label names for our class ids, the same as Dataset's.
+    std::shared_ptr<ClassMap> classes;
+
+    SparseDataset();
+
+    // reads a file from the datasets folder. a .csv is read like Dataset::readFile (header, class label last), just
+    // keeping the nonzeros. anything else is read as libsvm: "label column:value column:value ..." per line, columns
+    // starting at 1, zeros left out. numAttributes is the biggest column, or pass one in (the training set's, when
+    // reading a test set), and rows with a nonzero past it get skipped. pass in another dataset's classes to read a test set whose labels match up with it.
+    static SparseDataset readFile(const std::string &fileName, std::shared_ptr<ClassMap> classes = nullptr, int numAttributes = 0);
+
+    // adds a row. entries are (column, value) pairs starting at column 0, in any order. a column listed twice keeps
+    // its last value, then zeros get dropped. throws on a negative column, without adding anything.
+    void addRow(std::vector<std::pair<int, float>> entries, int label);
+
+    size_t size() const { return labels.size(); }
+    bool empty() const { return labels.empty(); }
+
+    int numClasses() const {
+        return classes->size();
+    }
+
+    int nonzeros(size_t row) const { return (int) (rowStart[row + 1] - rowStart[row]); }
+    const int *columnsOf(size_t row) const { return columns.data() + rowStart[row]; }
+    const float *valuesOf(size_t row) const { return values.data() + rowStart[row]; }
+
+    // writes row's nonzeros into dense (numAttributes floats, all zero), and takes them back out again. a row spread out
+    // like this can be measured against any other row by walking only the other row's nonzeros.
+    void scatter(size_t row, float *dense) const;
+    void unscatter(size_t row, float *dense) const;
+
+    // distance from row to a dense row with the given powerNorm. the same distance the dense kernels give, up to rounding.
+    float distanceTo(size_t row, const float *dense, double densePowerNorm) const {
+        return Utils::fromPower(Utils::sparseDensePowerSum(columnsOf(row), valuesOf(row), nonzeros(row), dense, densePowerNorm));
+    }
+
+    // whether row is within r of a row with the given norm, going by the norms alone. padded for rounding in the norms,
+    // so it never says no to a row that really is within r.
+    bool mightBeWithin(size_t row, float norm, float r) const {
+        return std::fabs(norms[row] - norm) - Utils::ABANDON_SLACK * (norms[row] + norm) <= r;
+    }
+
+    // one row id per distinct row and label, in the order they first show up, like Dataset::collapsed. weights gets how
+    // many rows each one stands for.
+    std::vector<int> distinctRows(std::vector<int> &weights) const;
+
+    // dense copies of rows, one after another, which we keep alive for as long as we are around. circles made from our
+    // rows point into these, just like dense circles point into their training rows.
+    float *denseCopy(const std::vector<int> &rows);
+
+private:
+
+    std::vector<std::shared_ptr<std::vector<float>>> denseCopies;
+};
+
+#endif //SPARSEDATASET_H
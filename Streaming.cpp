@@ -0,0 +1,169 @@
+#include "Streaming.h"
+#include "BoundedQueue.h"
+#include "Parallelism.h"
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+// what one thread has added up so far
+struct Tally {
+    vector<vector<long long>> confusionMatrix;
+    long long rows = 0;
+    long long unclassified = 0;
+    size_t chunks = 0;
+    double classifySeconds = 0.0;
+};
+
+// grows a confusion matrix to numClasses by numClasses, since labels can show up for the first time partway through
+static void growTo(vector<vector<long long>> &matrix, int numClasses) {
+    if (matrix.size() < numClasses)
+        matrix.resize(numClasses);
+    for (auto &row : matrix)
+        if (row.size() < numClasses)
+            row.resize(numClasses);
+}
+
+// one chunk, exactly like testAccuracy does a whole test set. we're already inside our own parallel region, so the
+// parallelism policy keeps these serial.
+static void classifyChunk(const HyperCircleModel &model, Dataset &train, Dataset &chunk, int k, Tally &tally) {
+    const auto start = Clock::now();
+
+    vector<int> predictions = model.classifyPoints(train, chunk, HyperCircle::USE_CIRCLES, HyperCircle::SIMPLE_MAJORITY, -1);
+
+    Dataset missed = chunk.emptyLike();
+    vector<int> missedIndexes;
+    for (int p = 0; p < chunk.size(); ++p) {
+        if (predictions[p] == -1) {
+            missed.push_back(chunk[p]);
+            missedIndexes.push_back(p);
+        }
+    }
+
+    const int fallback = train.empty() ? HyperCircle::K_NEAREST_CIRCLES : HyperCircle::REGULAR_KNN;
+    vector<int> fallbackPredictions = model.classifyPoints(train, missed, fallback, -1, k);
+    for (int m = 0; m < missed.size(); ++m)
+        predictions[missedIndexes[m]] = fallbackPredictions[m];
+
+    // the chunk was read before we got it, so the labels have every class in it by now
+    growTo(tally.confusionMatrix, max(chunk.numClasses(), model.numClasses));
+    // the fallback comes up empty only with nothing to vote (no circles, no training rows). those count as wrong.
+    for (int p = 0; p < chunk.size(); ++p)
+        if (predictions[p] != -1)
+            tally.confusionMatrix[chunk[p].classification][predictions[p]]++;
+
+    tally.rows += (long long) chunk.size();
+    tally.unclassified += (long long) missed.size();
+    tally.chunks++;
+    tally.classifySeconds += chrono::duration<double>(Clock::now() - start).count();
+}
+
+// waiting on the queue. yield for a while, then sleep, so an idle thread doesn't take a core off of the ones working.
+static void backOff(int &idle) {
+    if (++idle < 64)
+        this_thread::yield();
+    else
+        this_thread::sleep_for(chrono::microseconds(50));
+}
+
+float Streaming::Result::accuracy() const {
+    long long right = 0;
+    for (int cls = 0; cls < confusionMatrix.size(); ++cls)
+        right += confusionMatrix[cls][cls];
+    return rows > 0 ? (float) right / (float) rows : 0.0f;
+}
+
+Streaming::Result Streaming::evaluate(const HyperCircleModel &model, Dataset &train, const string &fileName,
+                                      shared_ptr<ClassMap> classes, const Settings &settings) {
+    Result result;
+
+    Dataset::Reader reader(fileName, classes);
+    if (!reader.good())
+        return result;
+    if (reader.numAttributes != model.numAttributes) {
+        cerr << fileName << " has " << reader.numAttributes << " attributes, but the model has " << model.numAttributes << endl;
+        return result;
+    }
+
+    const int threads = Parallelism::numThreads();
+    const size_t chunkRows = max<size_t>(settings.chunkRows, 1);
+    BoundedQueue<Dataset> queue(settings.queueChunks > 0 ? settings.queueChunks : 2 * threads);
+
+    vector<Tally> tallies(threads);
+    atomic<bool> doneReading {false};
+    double parseSeconds = 0.0;
+    size_t readerChunks = 0;
+
+    const auto start = Clock::now();
+
+    #pragma omp parallel num_threads(threads)
+    {
+#ifdef _OPENMP
+        const int me = omp_get_thread_num();
+#else
+        const int me = 0;
+#endif
+        Tally &tally = tallies[me];
+        Dataset chunk;
+        int idle = 0;
+
+        // thread 0 reads, and classifies too whenever the queue is full
+        if (me == 0) {
+            while (true) {
+                const auto parseStart = Clock::now();
+                Dataset next = reader.next(chunkRows);
+                parseSeconds += chrono::duration<double>(Clock::now() - parseStart).count();
+                if (next.empty())
+                    break;
+
+                while (!queue.tryPush(next)) {
+                    if (queue.tryPop(chunk)) {
+                        classifyChunk(model, train, chunk, settings.k, tally);
+                        readerChunks++;
+                    } else
+                        backOff(idle);
+                }
+            }
+            doneReading.store(true, memory_order_release);
+        }
+
+        // everybody (the reader too, once it's done) empties the queue. once reading is done, a failed pop means
+        // there's nothing left.
+        idle = 0;
+        while (true) {
+            if (queue.tryPop(chunk)) {
+                classifyChunk(model, train, chunk, settings.k, tally);
+                idle = 0;
+            } else if (doneReading.load(memory_order_acquire)) {
+                if (!queue.tryPop(chunk))
+                    break;
+                classifyChunk(model, train, chunk, settings.k, tally);
+            } else
+                backOff(idle);
+        }
+    }
+
+    result.seconds = chrono::duration<double>(Clock::now() - start).count();
+    result.parseSeconds = parseSeconds;
+    result.readerChunks = readerChunks;
+
+    // add up every thread's counts, in the final set of labels
+    growTo(result.confusionMatrix, max(reader.classes->size(), model.numClasses));
+    for (Tally &tally : tallies) {
+        for (int actual = 0; actual < tally.confusionMatrix.size(); ++actual)
+            for (int predicted = 0; predicted < tally.confusionMatrix[actual].size(); ++predicted)
+                result.confusionMatrix[actual][predicted] += tally.confusionMatrix[actual][predicted];
+        result.rows += tally.rows;
+        result.unclassified += tally.unclassified;
+        result.chunks += tally.chunks;
+        result.classifySeconds += tally.classifySeconds;
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+
+#include "Dataset.h"
+#include "HyperCircleModel.h"
+
+// tests a model on a csv too big to hold in memory, and classifies while the file is still being read instead of after.
+// one thread reads chunks of rows (Dataset::Reader) into a BoundedQueue, and the rest take chunks off it and classify
+// them the same way testAccuracy does, each adding to a confusion matrix of its own. they all get added up at the end.
+// only the queue's worth of chunks, plus the one each thread is working on, are ever in memory at once. when the
+// classifiers fall behind and the queue fills up, the reader classifies a chunk itself instead of waiting, so with one
+// thread it just takes turns.
+class Streaming {
+public:
+
+    struct Settings {
+        // rows per chunk
+        size_t chunkRows = 4096;
+
+        // how many chunks the reader can get ahead of the classifiers. 0 for two per thread.
+        int queueChunks = 0;
+
+        // for the fallback, like testAccuracy
+        int k = 3;
+    };
+
+    struct Result {
+        // actual class by predicted class, sized to the labels we had once the whole file was read
+        std::vector<std::vector<long long>> confusionMatrix;
+
+        long long rows = 0;
+
+        // how many no circle covered, so the fallback got them
+        long long unclassified = 0;
+
+        size_t chunks = 0;
+
+        // how many of those the reader classified itself because the queue was full
+        size_t readerChunks = 0;
+
+        // wall time, and the time spent parsing and classifying added up over the threads. when parsing + classifying
+        // is more than seconds, the difference is how much they overlapped.
+        double seconds = 0.0;
+        double parseSeconds = 0.0;
+        double classifySeconds = 0.0;
+
+        float accuracy() const;
+    };
+
+    // streams fileName (from the datasets folder, read against classes) through model. train is only for the
+    // REGULAR_KNN fallback, and with an empty one the fallback is K_NEAREST_CIRCLES, same as testAccuracy. the result
+    // has no rows if the file couldn't be read or isn't as wide as the model.
+    static Result evaluate(const HyperCircleModel &model, Dataset &train, const std::string &fileName,
+                           std::shared_ptr<ClassMap> classes, const Settings &settings);
+};
+
+#endif //STREAMING_H
@@ -0,0 +1,308 @@
+#include "Sweep.h"
+#include "HyperCircleModel.h"
+#include "Parallelism.h"
+#include "TopK.h"
+#include "Utils.h"
+#include "Numa.h"
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+using Entry = TopK::Entry;
+using Clock = chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// writes nearest's entries into list nearest first, padding out to k with empty entries (label -1) if it had fewer
+static void sortInto(const TopK &nearest, Entry *list, int k) {
+    vector<Entry> items = nearest.items();
+    sort(items.begin(), items.end());
+    for (int i = 0; i < k; ++i)
+        list[i] = i < items.size() ? items[i] : Entry {numeric_limits<float>::max(), -1};
+}
+
+// the vote of the first k entries of a list from sortInto. the same neighbors TopK would have picked, so the same vote.
+static int voteFirst(const Entry *list, int k, int numClasses) {
+    TopK nearest(k);
+    for (int i = 0; i < k && list[i].second != -1; ++i)
+        nearest.push(list[i].first, list[i].second);
+    return nearest.vote(numClasses);
+}
+
+// lists gets the k nearest training rows to each test point in [first, last), k entries per point
+template <int DIM>
+static void nearestTrainingRows(Dataset &train, Dataset &test, size_t first, size_t last, int k, Entry *lists) {
+    const int n = train.numAttributes;
+    const int policy = Parallelism::choose(last - first, train.size(), n);
+
+    #pragma omp parallel for schedule(dynamic, 8) if(policy == Parallelism::INTER_QUERY)
+    for (long long r = (long long) first; r < (long long) last; ++r) {
+        TopK nearest(k);
+        for (int i = 0; i < train.size(); ++i)
+            nearest.push(Utils::boundedDistance<DIM>(train[i].location, test[r].location, n, nearest.bound()), train[i].classification);
+        sortInto(nearest, lists + (r - first) * k, k);
+    }
+}
+
+// tile gets every test point in [first, last) against every circle of model, one row of model.size() per point
+template <int DIM>
+static void distanceTile(const HyperCircleModel &model, Dataset &test, size_t first, size_t last, float *tile) {
+    const int n = model.numAttributes;
+    const int numCircles = model.size();
+    const int policy = Parallelism::choose(last - first, numCircles, n);
+
+    #pragma omp parallel for schedule(static) if(policy == Parallelism::INTER_QUERY)
+    for (long long r = (long long) first; r < (long long) last; ++r) {
+        float *row = tile + (size_t) (r - first) * numCircles;
+        const float *centers = model.localCenters();
+        for (int c = 0; c < numCircles; ++c)
+            row[c] = Utils::distance<DIM>(test[r].location, centers + (size_t) c * n, n);
+    }
+}
+
+vector<Sweep::Result> Sweep::run(Dataset &data, const Grid &grid) {
+
+    const int G = grid.generators.size();
+    const int S = grid.subModes.size();
+    const int F = grid.fallbacks.size();
+    const int K = grid.kValues.size();
+    const int numFolds = grid.numFolds;
+    const int numClasses = data.numClasses();
+    if (G == 0 || S == 0 || F == 0 || K == 0 || numFolds < 2 || data.empty())
+        return {};
+
+    // every list of neighbors is kept long enough for the biggest k, and the smaller ks just read the front of it
+    const int maxK = max(1, *max_element(grid.kValues.begin(), grid.kValues.end()));
+    const bool needKNN = find(grid.fallbacks.begin(), grid.fallbacks.end(), HyperCircle::REGULAR_KNN) != grid.fallbacks.end();
+    const bool needCircles = find(grid.fallbacks.begin(), grid.fallbacks.end(), HyperCircle::K_NEAREST_CIRCLES) != grid.fallbacks.end();
+    const bool needRatios = find(grid.fallbacks.begin(), grid.fallbacks.end(), HyperCircle::K_NEAREST_RATIOS) != grid.fallbacks.end();
+
+    auto settingOf = [&](int g, int s, int f, int k) { return ((g * S + s) * F + f) * K + k; };
+    const int numSettings = G * S * F * K;
+
+    cout << "Sweeping " << numSettings << " settings with " << numFolds << " folds: " << numFolds * G << " circle sets, "
+         << numFolds * G << " distance tiles and " << (needKNN ? numFolds : 0) << " nearest neighbor lists, instead of "
+         << "working them out again for every setting." << endl;
+
+    // what each shared step cost, over every fold, so every setting can be charged for the ones it uses
+    vector<double> accuracySum(numSettings, 0.0), ownSeconds(numSettings, 0.0);
+    vector<double> circleSum(G, 0.0), generateSeconds(G, 0.0), tileSeconds(G, 0.0);
+    vector<double> voteSeconds(G * S, 0.0), circleListSeconds(G, 0.0), ratioListSeconds(G, 0.0);
+    double knnSeconds = 0.0;
+
+    vector<Dataset> kBuckets = Utils::stratifiedKFolds(numFolds, data);
+    for (int fold = 0; fold < numFolds; ++fold) {
+
+        // the same split kFoldValidation makes
+        Dataset trainingData = data.emptyLike();
+        Dataset testData = data.emptyLike();
+        for (int trainFold = 0; trainFold < numFolds; ++trainFold) {
+            if (trainFold == fold)
+                testData = kBuckets[fold];
+            else
+                trainingData.points.insert(trainingData.end(), kBuckets[trainFold].begin(), kBuckets[trainFold].end());
+        }
+        if (testData.empty() || trainingData.empty())
+            continue;
+
+        // every generator's circles for this fold. the models copy the centers out, so the circles can go right away.
+        vector<HyperCircleModel> models;
+        int mostCircles = 0;
+        for (int g = 0; g < G; ++g) {
+            auto start = Clock::now();
+            vector<HyperCircle> circles = grid.generators[g] == MAX_DISTANCE
+                ? HyperCircle::generateMaxDistanceBasedHyperCircles(trainingData)
+                : HyperCircle::generateHyperCircles(trainingData);
+            models.emplace_back(circles, trainingData.numAttributes, trainingData.numClasses());
+            generateSeconds[g] += secondsSince(start);
+            circleSum[g] += models.back().size();
+            mostCircles = max(mostCircles, models.back().size());
+        }
+
+        // what one test point takes up while its block is in flight
+        const size_t perPoint = (size_t) mostCircles * sizeof(float) + (size_t) S * sizeof(int) + 3 * (size_t) maxK * sizeof(Entry) + 1;
+        const size_t blockSize = max<size_t>(1, min(testData.size(), grid.memoryBudget / perPoint));
+
+        vector<Entry> knnLists(needKNN ? blockSize * maxK : 0);
+        // each thread fills its static share of the tile's rows, so with the data's placement on, that's the share it
+        // touches first
+        Numa::Buffer<float> tile(blockSize * mostCircles, data.numa);
+        vector<int> circleVotes(blockSize * S);
+        vector<char> uncovered(blockSize);
+        vector<Entry> circleLists(needCircles ? blockSize * maxK : 0), ratioLists(needRatios ? blockSize * maxK : 0);
+        const vector<Entry> noLists;
+        vector<long long> right(numSettings, 0);
+
+        for (size_t first = 0; first < testData.size(); first += blockSize) {
+            const size_t last = min(testData.size(), first + blockSize);
+            const long long count = (long long) (last - first);
+
+            // the training rows nearest each point don't depend on the circles, so every generator shares them
+            if (needKNN) {
+                auto start = Clock::now();
+                Utils::withDimension(trainingData.numAttributes, [&](auto dim) {
+                    nearestTrainingRows<decltype(dim)::value>(trainingData, testData, first, last, maxK, knnLists.data());
+                });
+                knnSeconds += secondsSince(start);
+            }
+
+            for (int g = 0; g < G; ++g) {
+                const HyperCircleModel &model = models[g];
+                const int numCircles = model.size();
+                const int votePolicy = Parallelism::choose(count, numCircles, 1);
+
+                auto start = Clock::now();
+                Utils::withDimension(model.numAttributes, [&](auto dim) {
+                    distanceTile<decltype(dim)::value>(model, testData, first, last, tile.data());
+                });
+                tileSeconds[g] += secondsSince(start);
+
+                // every submode's vote, off the same row of the tile
+                fill(uncovered.begin(), uncovered.end(), 0);
+                for (int s = 0; s < S; ++s) {
+                    start = Clock::now();
+                    #pragma omp parallel if(votePolicy == Parallelism::INTER_QUERY)
+                    {
+                        vector<float> votes(numClasses);
+                        #pragma omp for schedule(static)
+                        for (long long r = 0; r < count; ++r) {
+                            const int vote = model.voteFromDistances(tile.data() + (size_t) r * numCircles, grid.subModes[s], votes.data());
+                            circleVotes[r * S + s] = vote;
+                            if (vote == -1)
+                                uncovered[r] = 1;
+                        }
+                    }
+                    voteSeconds[g * S + s] += secondsSince(start);
+                }
+
+                // nearest circles and ratios, only for the points the circles left to a fallback
+                auto nearestCircles = [&](vector<Entry> &lists, bool ratios) {
+                    #pragma omp parallel for schedule(dynamic, 8) if(votePolicy == Parallelism::INTER_QUERY)
+                    for (long long r = 0; r < count; ++r) {
+                        if (!uncovered[r])
+                            continue;
+                        const float *distances = tile.data() + (size_t) r * numCircles;
+                        TopK nearest(maxK);
+                        for (int c = 0; c < numCircles; ++c)
+                            nearest.push(ratios ? distances[c] / model.radii[c] : distances[c], model.labels[c]);
+                        sortInto(nearest, lists.data() + r * maxK, maxK);
+                    }
+                };
+                if (needCircles) {
+                    start = Clock::now();
+                    nearestCircles(circleLists, false);
+                    circleListSeconds[g] += secondsSince(start);
+                }
+                if (needRatios) {
+                    start = Clock::now();
+                    nearestCircles(ratioLists, true);
+                    ratioListSeconds[g] += secondsSince(start);
+                }
+
+                // and now each setting is just a lookup, or a vote among the front of a list. they don't share
+                // anything from here on, so the threads split up the settings.
+                const int perGenerator = S * F * K;
+                #pragma omp parallel for schedule(dynamic, 1) if(Parallelism::choose(perGenerator, count, 1) == Parallelism::INTER_QUERY)
+                for (int at = 0; at < perGenerator; ++at) {
+                    const int s = at / (F * K), f = at / K % F, k = at % K;
+                    const int fallback = grid.fallbacks[f];
+                    const vector<Entry> &lists = fallback == HyperCircle::REGULAR_KNN ? knnLists
+                                               : fallback == HyperCircle::K_NEAREST_CIRCLES ? circleLists
+                                               : fallback == HyperCircle::K_NEAREST_RATIOS ? ratioLists : noLists;
+                    const int setting = settingOf(g, s, f, k);
+                    auto settingStart = Clock::now();
+                    long long correct = 0;
+                    for (long long r = 0; r < count; ++r) {
+                        int prediction = circleVotes[r * S + s];
+                        if (prediction == -1 && !lists.empty())
+                            prediction = voteFirst(lists.data() + r * maxK, grid.kValues[k], numClasses);
+                        correct += prediction == testData[first + r].classification;
+                    }
+                    right[setting] += correct;
+                    ownSeconds[setting] += secondsSince(settingStart);
+                }
+            }
+        }
+
+        for (int setting = 0; setting < numSettings; ++setting)
+            accuracySum[setting] += (double) right[setting] / (double) testData.size();
+    }
+
+    vector<Result> results;
+    for (int g = 0; g < G; ++g) {
+        for (int s = 0; s < S; ++s) {
+            for (int f = 0; f < F; ++f) {
+                const int fallback = grid.fallbacks[f];
+                const double fallbackSeconds = fallback == HyperCircle::REGULAR_KNN ? knnSeconds
+                                             : fallback == HyperCircle::K_NEAREST_CIRCLES ? circleListSeconds[g]
+                                             : fallback == HyperCircle::K_NEAREST_RATIOS ? ratioListSeconds[g] : 0.0;
+                for (int k = 0; k < K; ++k) {
+                    const int setting = settingOf(g, s, f, k);
+                    results.push_back({grid.generators[g], grid.subModes[s], fallback, grid.kValues[k],
+                                       (float) (accuracySum[setting] / numFolds), (float) (circleSum[g] / numFolds),
+                                       generateSeconds[g], tileSeconds[g] + voteSeconds[g * S + s] + fallbackSeconds + ownSeconds[setting]});
+                }
+            }
+        }
+    }
+
+    stable_sort(results.begin(), results.end(), [](const Result &a, const Result &b) {
+        if (a.accuracy != b.accuracy)
+            return a.accuracy > b.accuracy;
+        if (a.circles != b.circles)
+            return a.circles < b.circles;
+        return a.classifySeconds < b.classifySeconds;
+    });
+    return results;
+}
+
+void Sweep::printResults(const vector<Result> &results, ostream &out, size_t top) {
+    const size_t rows = top == 0 ? results.size() : min(top, results.size());
+
+    out << "=== SWEEP RESULTS (NORM " << NORM << ", best first) ===" << endl;
+    out << left << setw(6) << "rank" << setw(18) << "generator" << setw(17) << "voting" << setw(19) << "fallback"
+        << setw(5) << "k" << setw(11) << "accuracy" << setw(10) << "circles" << setw(14) << "generate s" << "classify ms" << endl;
+    for (size_t i = 0; i < rows; ++i) {
+        const Result &r = results[i];
+        out << left << setw(6) << i + 1 << setw(18) << generatorName(r.generator) << setw(17) << subModeName(r.subMode)
+            << setw(19) << fallbackName(r.fallback) << setw(5) << r.k << setw(11) << fixed << setprecision(4) << r.accuracy
+            << setw(10) << setprecision(1) << r.circles << setw(14) << setprecision(3) << r.generateSeconds
+            << setprecision(3) << r.classifySeconds * 1000 << defaultfloat << endl;
+    }
+    if (rows < results.size())
+        out << "(" << results.size() - rows << " more)" << endl;
+}
+
+const char *Sweep::generatorName(int generator) {
+    switch (generator) {
+        case NEAREST_NEIGHBOR: return "NEAREST_NEIGHBOR";
+        case MAX_DISTANCE: return "MAX_DISTANCE";
+        default: return "?";
+    }
+}
+
+const char *Sweep::subModeName(int subMode) {
+    switch (subMode) {
+        case HyperCircle::SIMPLE_MAJORITY: return "SIMPLE_MAJORITY";
+        case HyperCircle::COUNT_VOTE: return "COUNT_VOTE";
+        case HyperCircle::DENSITY_VOTE: return "DENSITY_VOTE";
+        case HyperCircle::DISTANCE_VOTE: return "DISTANCE_VOTE";
+        case HyperCircle::PER_CLASS_VOTE: return "PER_CLASS_VOTE";
+        case HyperCircle::SMALLEST_CIRCLE: return "SMALLEST_CIRCLE";
+        default: return "?";
+    }
+}
+
+const char *Sweep::fallbackName(int fallback) {
+    switch (fallback) {
+        case HyperCircle::USE_CIRCLES: return "NONE";
+        case HyperCircle::REGULAR_KNN: return "REGULAR_KNN";
+        case HyperCircle::K_NEAREST_CIRCLES: return "K_NEAREST_CIRCLES";
+        case HyperCircle::K_NEAREST_RATIOS: return "K_NEAREST_RATIOS";
+        default: return "?";
+    }
+}
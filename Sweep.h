@@ -0,0 +1,84 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <vector>
+#include <cstddef>
+#include <iostream>
+
+#include "Dataset.h"
+#include "HyperCircle.h"
+
+// cross validates a whole grid of settings (generator x voting submode x fallback x k) in one go, instead of one menu
+// option at a time. most of what each setting needs is the same as what its neighbors in the grid need, so the run is
+// planned around those shared pieces, and each one gets worked out once:
+//   fold split -> circle sets, one per generator, shared by every submode, fallback and k
+//   fold split -> each test point's k nearest training rows (for the biggest k), shared by every generator and submode
+//   circle set -> distance tile (every test point against every circle), which gives
+//       -> each point's circle vote under every submode (the circles it's inside and how far from their centers)
+//       -> each point's nearest circles and nearest ratios (for the biggest k), for the points no circle covered
+//   then every setting is a lookup into those, plus a vote among its first k neighbors.
+// the test points go through in blocks, sized so the tiles and everything made from them fit in memoryBudget. each
+// step splits its block across the threads.
+// the metric is NORM, which is fixed when we're compiled, so it can't be part of the grid. the table says which one.
+class Sweep {
+public:
+
+    // the generators we can sweep over
+    enum {
+        NEAREST_NEIGHBOR = 0, // generateHyperCircles
+        MAX_DISTANCE = 1      // generateMaxDistanceBasedHyperCircles
+    };
+
+    struct Grid {
+        std::vector<int> generators {NEAREST_NEIGHBOR, MAX_DISTANCE};
+
+        std::vector<int> subModes {HyperCircle::SIMPLE_MAJORITY, HyperCircle::COUNT_VOTE, HyperCircle::DENSITY_VOTE,
+                                   HyperCircle::DISTANCE_VOTE, HyperCircle::PER_CLASS_VOTE, HyperCircle::SMALLEST_CIRCLE};
+
+        // for the points no circle covers
+        std::vector<int> fallbacks {HyperCircle::REGULAR_KNN, HyperCircle::K_NEAREST_CIRCLES, HyperCircle::K_NEAREST_RATIOS};
+
+        std::vector<int> kValues {1, 3, 5, 7, 9};
+
+        int numFolds = 5;
+
+        // bytes the per block intermediates (distance tiles, votes, neighbor lists) can take up at once. the training
+        // data and circle sets are extra, they're about the size of the dataset.
+        size_t memoryBudget = (size_t) 256 << 20;
+    };
+
+    struct Result {
+        int generator;
+        int subMode;
+        int fallback;
+        int k;
+
+        // averaged over the folds, like kFoldValidation
+        float accuracy;
+        float circles;
+
+        // seconds making this generator's circle sets, over every fold. every setting with that generator shares them.
+        double generateSeconds;
+
+        // seconds it took to classify every fold's test points this way: the shared steps this setting needs, plus
+        // its own votes. about what running just this setting would take, without the generation.
+        double classifySeconds;
+    };
+
+    // runs the whole grid on data, and returns one result per setting, best first (accuracy, then fewer circles, then
+    // quicker to classify).
+    static std::vector<Result> run(Dataset &data, const Grid &grid);
+
+    // prints results as a table. top limits it to the first that many rows, 0 prints all of them.
+    static void printResults(const std::vector<Result> &results, std::ostream &out, size_t top = 0);
+
+    static const char *generatorName(int generator);
+    static const char *subModeName(int subMode);
+    static const char *fallbackName(int fallback);
+};
+
+#endif //SWEEP_H
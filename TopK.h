@@ -0,0 +1,120 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <vector>
+#include <utility>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+
+#include "Parallelism.h"
+
+// streaming k nearest selector. instead of writing out a distance for every single candidate and then nth_element-ing
+// it, we keep just the k best we have seen in a bounded max heap. the top of the heap is the current kth distance, so
+// anything further than that gets thrown away right away, and the callers can use bound() to stop a distance early.
+class TopK {
+public:
+
+    // pair is distance, label
+    using Entry = std::pair<float, int>;
+
+    explicit TopK(int k) : k(std::max(k, 0)) {
+        heap.reserve(this->k);
+    }
+
+    // the distance a candidate has to beat to get in. infinite until we have k of them.
+    float bound() const {
+        if (k == 0)
+            return -std::numeric_limits<float>::infinity();
+        if (heap.size() < k)
+            return std::numeric_limits<float>::max();
+        return heap.front().first;
+    }
+
+    bool full() const {
+        return heap.size() == k;
+    }
+
+    // offer a candidate. returns whether we kept it.
+    bool push(float dist, int label) {
+        if (k == 0)
+            return false;
+
+        if (heap.size() < k) {
+            heap.emplace_back(dist, label);
+            std::push_heap(heap.begin(), heap.end());
+            return true;
+        }
+
+        // not better than our current worst, so it can't be in the k nearest
+        if (!(Entry{dist, label} < heap.front()))
+            return false;
+
+        // swap out our worst guy for the new one
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = {dist, label};
+        std::push_heap(heap.begin(), heap.end());
+        return true;
+    }
+
+    // fold another selector in. used to combine each thread's local top k.
+    void merge(const TopK &other) {
+        for (const auto &e : other.heap)
+            push(e.first, e.second);
+    }
+
+    // the k (or fewer) nearest we kept. not in any particular order.
+    const std::vector<Entry> &items() const {
+        return heap;
+    }
+
+    // vote with our nearest guys, weighting each one by 1 / distance. returns our best class, or -1 if we have nobody
+    // to vote (k was 0, or there were no candidates).
+    int vote(int numClasses) const {
+        if (heap.empty() || numClasses <= 0)
+            return -1;
+
+        std::vector<float> votes(numClasses, 0.0f);
+        for (const auto &neighbor : heap)
+            votes[neighbor.second] += (1 / neighbor.first);
+
+        // return our best class by finding max element
+        return std::distance(votes.begin(), std::max_element(votes.begin(), votes.end()));
+    }
+
+    // runs the fused distance + selection over n candidates. each thread keeps its own bounded top k, and we fold them
+    // together at the end, so we only ever write k entries instead of one for every candidate.
+    // distanceTo(c, bound) only has to be exact when it is <= bound, which lets it stop early.
+    template <typename DistanceFunction, typename LabelFunction>
+    static TopK select(size_t n, int k, int numAttributes, DistanceFunction distanceTo, LabelFunction labelOf) {
+
+        TopK nearest(k);
+        if (k <= 0)
+            return nearest;
+
+        #pragma omp parallel if(Parallelism::intraQuery(n, numAttributes))
+        {
+            TopK local(k);
+
+            // once we have k guys, a candidate only matters if it beats our kth distance, so it can stop early
+            #pragma omp for nowait
+            for (int c = 0; c < n; ++c)
+                local.push(distanceTo(c, local.bound()), labelOf(c));
+
+            #pragma omp critical
+            nearest.merge(local);
+        }
+
+        return nearest;
+    }
+
+private:
+    size_t k;
+    std::vector<Entry> heap;
+};
+
+#endif //TOPK_H
@@ -4,204 +4,97 @@
 #include <string>
 #include <vector>
 #include "Point.h"
+#include "Dataset.h"
 #include "HyperCircle.h"
+#include "HyperCircleModel.h"
+#include "SparseDataset.h"
+#include "Sweep.h"
+#include "Compaction.h"
+#include "Numa.h"
+#include "Streaming.h"
 #include "Utils.h"
+#include "Parallelism.h"
 #include <map>
+#include <thread>
+#include <iomanip>
+#include <chrono>
+#include <tuple>
 
 
 using namespace std;
 
-// used so that we can easily get the number of classes, names and whatnot
-// very similar to github.com/austinsnyd3r/hyperblocks
-map<string, int> CLASS_MAP;
-map<int, string> REVERSED_MAP;
-int NUM_CLASSES = 0;
-int Point::numAttributes = 0;
-bool PRINTING = true;
-
-vector<Point> readFile(const string &fileName) {
-
-    vector<Point> data;
-#ifdef _WIN32
-    const string realName = "datasets\\" + fileName;
-#else
-    const string realName = "datasets/" + fileName;
-#endif
-
-    ifstream file(realName);
-    if (!file.is_open()) {
-        cerr << "Failed to open file: " << fileName << endl;
-        return data;
-    }
-
-    string line;
-
-    // Read header to determine number of attributes
-    if (!getline(file, line))
-        return data;
-
-    stringstream headerSS(line);
-    int columnCount = 0;
-    string headerToken;
-    while (getline(headerSS, headerToken, ',')) {
-        ++columnCount;
-    }
-
-    Point::numAttributes = columnCount - 1;
-
-    // Parse each data line
-    while (getline(file, line)) {
-        stringstream ss(line);
-        vector<string> tokens;
-        string token;
-
-        while (getline(ss, token, ',')) {
-            tokens.push_back(token);
-        }
-
-        if (tokens.size() != columnCount) {
-            cerr << "Skipping malformed row: " << line << endl;
-            continue; // malformed row
-        }
-
-        float* attrs = new float[Point::numAttributes];
-        try {
-            for (int i = 0; i < Point::numAttributes; ++i) {
-                attrs[i] = stof(tokens[i]);
-            }
-        } catch (...) {
-            cerr << "Failed to parse floats on line: " << line << endl;
-            delete[] attrs;
-            continue; // skip row with invalid numeric data
-        }
-
-        // Handle class label
-        // Handle class label (strip any '\r')
-        string label = tokens.back();
-        if (!label.empty() && label.back() == '\r')
-            label.pop_back();
-
-        if (!CLASS_MAP.count(label)) {
-            CLASS_MAP[label]           = NUM_CLASSES;
-            REVERSED_MAP[NUM_CLASSES++] = label;
-        }
-        int cls = CLASS_MAP[label];
-
-        // throw our data into the vector
-        data.emplace_back(attrs, cls);
-    }
-
-    return data;
-}
-
-// quick GPT made functions to load and save circles to and from a file.
-static void saveCircles(const vector<HyperCircle>& circles, const string& filename) {
-    ofstream out(filename, ios::binary);
-    int32_t n = static_cast<int32_t>(circles.size());
-    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
-
-    for (const auto& hc : circles) {
-        // radius
-        out.write(reinterpret_cast<const char*>(&hc.radius), sizeof(hc.radius));
-        // classification
-        out.write(reinterpret_cast<const char*>(&hc.classification), sizeof(hc.classification));
-        // numPoints
-        out.write(reinterpret_cast<const char*>(&hc.numPoints), sizeof(hc.numPoints));
-        // centerPoint coordinates (Point::numAttributes floats)
-        for (int d = 0; d < Point::numAttributes; ++d) {
-            out.write(reinterpret_cast<const char*>(&hc.centerPoint[d]), sizeof(float));
+// prints a confusion matrix (actual class by predicted class) with our class labels, and each class's accuracy
+void printConfusionMatrix(const vector<vector<long long>> &confusionMatrix, const ClassMap &classes, long long unclassifiedCount) {
+    const int numClasses = (int) confusionMatrix.size();
+
+    cout << "CONFUSION MATRIX:" << endl;
+    // print confusion matrix with class labels
+    for (int cls = 0; cls < numClasses; ++cls) {
+        // print the actual class label
+        cout << "Class " << classes.nameOf(cls) << ":\t";
+        for (int row = 0; row < numClasses; ++row) {
+            cout << confusionMatrix[cls][row] << "\t|| ";
         }
+        cout << endl;
     }
-    out.close();
-}
 
-// loads circles from a file in binary
-static vector<HyperCircle> loadCircles(const string& filename) {
-    ifstream in(filename, ios::binary);
-    int32_t n;
-    in.read(reinterpret_cast<char*>(&n), sizeof(n));
+    cout << "UNCLASSIFIED BY THE HCs:\t" << unclassifiedCount << endl << endl;
 
-    vector<HyperCircle> circles;
-    circles.reserve(n);
-    for (int32_t i = 0; i < n; ++i) {
-        float   radius;
-        int32_t cls;
-        int32_t count;
-        in.read(reinterpret_cast<char*>(&radius),    sizeof(radius));
-        in.read(reinterpret_cast<char*>(&cls),       sizeof(cls));
-        in.read(reinterpret_cast<char*>(&count),     sizeof(count));
-
-        // allocate and read centerPoint array
-        float* center = new float[Point::numAttributes];
-        for (int d = 0; d < Point::numAttributes; ++d) {
-            in.read(reinterpret_cast<char*>(&center[d]), sizeof(float));
+    // Print accuracy per class
+    cout << "CLASS-BY-CLASS ACCURACY:" << endl;
+    for (int cls = 0; cls < numClasses; ++cls) {
+        long long truePositive = confusionMatrix[cls][cls];
+        long long totalInClass = 0;
+        for (int row = 0; row < numClasses; ++row) {
+            totalInClass += confusionMatrix[cls][row];
         }
-
-        HyperCircle hc(radius, center, cls);
-        hc.numPoints = count;
-        circles.push_back(hc);
-    }
-    in.close();
-
-    // now we rebuild the count of circles per class.
-    HyperCircle::numCirclesPerClass.resize(NUM_CLASSES);
-    for (HyperCircle & circle : circles) {
-        HyperCircle::numCirclesPerClass[circle.classification]++;
+        float classAccuracy = (totalInClass > 0) ? (float)truePositive / (float)totalInClass : 0;
+        cout << "Class " << classes.nameOf(cls) << " Accuracy: " << classAccuracy * 100 << "%" << endl;
     }
-
-    return circles;
 }
 
 // tests the accuracy with our test set.
-float testAccuracy(vector<HyperCircle> &circles, vector<Point> &train, vector<Point> &testData, int k) {
+float testAccuracy(HyperCircleModel &model, Dataset &train, Dataset &testData, int k, bool printing = true) {
 
-    vector<vector<int>> confusionMatrix(CLASS_MAP.size(), vector<int>(CLASS_MAP.size()));
+    // a loaded model can know classes the test file never uses
+    const int numClasses = max(testData.numClasses(), model.numClasses);
+    vector<vector<long long>> confusionMatrix(numClasses, vector<long long>(numClasses));
     int unclassifiedCount = 0;
-    for (int p = 0; p < testData.size(); ++p) {
-        const auto &point = testData[p];
 
-        // predict the point using our circles
-        int predictedClass = HyperCircle::classifyPoint(circles, train, point.location, HyperCircle::USE_CIRCLES, HyperCircle::SIMPLE_MAJORITY, NUM_CLASSES, -1);
+    // predict all the points using our circles
+    vector<int> predictions = model.classifyPoints(train, testData, HyperCircle::USE_CIRCLES, HyperCircle::SIMPLE_MAJORITY, -1);
 
-        // if it remains -1, send it to a fallback
-        if (predictedClass == -1) {
-            // re‐classify with KNN and assign to predictedClass
-            predictedClass = HyperCircle::classifyPoint(circles,train, point.location,HyperCircle::REGULAR_KNN, -1, NUM_CLASSES, k);
+    // if any remain -1, send them to a fallback together
+    Dataset missed = testData.emptyLike();
+    vector<int> missedIndexes;
+    for (int p = 0; p < testData.size(); ++p) {
+        if (predictions[p] == -1) {
+            missed.push_back(testData[p]);
+            missedIndexes.push_back(p);
             unclassifiedCount++;
         }
+    }
 
+    // re‐classify with KNN and assign to predictions. a loaded model doesn't need the training data, and without it
+    // we use the nearest circles instead.
+    const int fallback = train.empty() ? HyperCircle::K_NEAREST_CIRCLES : HyperCircle::REGULAR_KNN;
+    vector<int> fallbackPredictions = model.classifyPoints(train, missed, fallback, -1, k);
+    for (int m = 0; m < missed.size(); ++m)
+        predictions[missedIndexes[m]] = fallbackPredictions[m];
+
+    for (int p = 0; p < testData.size(); ++p) {
+        // the fallback can come up empty too (no circles, no training rows). that counts as wrong, not as a class.
+        if (predictions[p] == -1)
+            continue;
         // increment of the appropriate cell in confusionMatrix
-        confusionMatrix[point.classification][predictedClass]++;
+        confusionMatrix[testData[p].classification][predictions[p]]++;
     }
 
-    if (PRINTING) {
-        cout << "CONFUSION MATRIX:" << endl;
-        // print confusion matrix with class labels
-        for (int cls = 0; cls < CLASS_MAP.size(); ++cls) {
-            // print the actual class label
-            cout << "Class " << REVERSED_MAP[cls] << ":\t";
-            for (int row = 0; row < CLASS_MAP.size(); ++row) {
-                cout << confusionMatrix[cls][row] << "\t|| ";
-            }
-            cout << endl;
-        }
-
-        cout << "UNCLASSIFIED BY THE HCs:\t" << unclassifiedCount << endl << endl;
+    if (printing)
+        printConfusionMatrix(confusionMatrix, *testData.classes, unclassifiedCount);
 
-        // Print accuracy per class
-        cout << "CLASS-BY-CLASS ACCURACY:" << endl;
-        for (int cls = 0; cls < CLASS_MAP.size(); ++cls) {
-            int truePositive = confusionMatrix[cls][cls];
-            int totalInClass = 0;
-            for (int row = 0; row < CLASS_MAP.size(); ++row) {
-                totalInClass += confusionMatrix[cls][row];
-            }
-            float classAccuracy = (totalInClass > 0) ? (float)truePositive / (float)totalInClass : 0;
-            cout << "Class " << REVERSED_MAP[cls] << " Accuracy: " << classAccuracy * 100 << "%" << endl;
-        }
-    }
     // count how many we got right
-    int totalRight = 0;
+    long long totalRight = 0;
     for (int cls = 0; cls < confusionMatrix.size(); cls++) {
         totalRight += confusionMatrix[cls][cls];
     }
@@ -211,7 +104,9 @@ float testAccuracy(vector<HyperCircle> &circles, vector<Point> &train, vector<Po
 }
 
 // finds best HC voting style
-void findBestHCVoting (vector<HyperCircle> &circles, vector<Point> &train, vector<Point> &testData) {
+void findBestHCVoting (HyperCircleModel &model, Dataset &train, Dataset &testData, bool printing = true) {
+
+    const int numClasses = max(testData.numClasses(), model.numClasses);
 
     // We'll store accuracy for each submode in this array (indices correspond to enum values 0–4).
     float accuracies[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
@@ -219,27 +114,37 @@ void findBestHCVoting (vector<HyperCircle> &circles, vector<Point> &train, vecto
     // Loop over each HC voting submode
     for (int subMode = HyperCircle::SIMPLE_MAJORITY; subMode <= HyperCircle::SMALLEST_CIRCLE; ++subMode) {
 
-        vector<vector<int>> confusionMatrix(CLASS_MAP.size(), vector<int>(CLASS_MAP.size()));
+        vector<vector<int>> confusionMatrix(numClasses, vector<int>(numClasses));
         int unclassifiedCount = 0;
 
         int k = 5;
 
-        for (int p = 0; p < testData.size(); ++p) {
-            const auto &point = testData[p];
-
-            int predictedClass = HyperCircle::classifyPoint(circles,train,point.location, HyperCircle::USE_CIRCLES, subMode, NUM_CLASSES, k);
+        vector<int> predictions = model.classifyPoints(train, testData, HyperCircle::USE_CIRCLES, subMode, k);
 
-            // if not covered by our circle, use KNN.
-            if (predictedClass == -1) {
-                predictedClass = HyperCircle::classifyPoint(circles,train,point.location,HyperCircle::REGULAR_KNN, -1, NUM_CLASSES, k);
+        // if not covered by our circle, use KNN.
+        Dataset missed = testData.emptyLike();
+        vector<int> missedIndexes;
+        for (int p = 0; p < testData.size(); ++p) {
+            if (predictions[p] == -1) {
+                missed.push_back(testData[p]);
+                missedIndexes.push_back(p);
                 unclassifiedCount++;
             }
+        }
+        const int fallback = train.empty() ? HyperCircle::K_NEAREST_CIRCLES : HyperCircle::REGULAR_KNN;
+        vector<int> fallbackPredictions = model.classifyPoints(train, missed, fallback, -1, k);
+        for (int m = 0; m < missed.size(); ++m)
+            predictions[missedIndexes[m]] = fallbackPredictions[m];
 
+        for (int p = 0; p < testData.size(); ++p) {
+            // nothing to vote even in the fallback, so it's just wrong
+            if (predictions[p] == -1)
+                continue;
             // increment of the appropriate cell in confusionMatrix
-            confusionMatrix[point.classification][predictedClass]++;
+            confusionMatrix[testData[p].classification][predictions[p]]++;
         }
 
-        if (PRINTING) {
+        if (printing) {
             // Print header for this submode
             switch (subMode) {
                 case HyperCircle::SIMPLE_MAJORITY:
@@ -262,8 +167,8 @@ void findBestHCVoting (vector<HyperCircle> &circles, vector<Point> &train, vecto
                     break;
             }
 
-            for (int cls = 0; cls < CLASS_MAP.size(); ++cls) {
-                for (int row = 0; row < CLASS_MAP.size(); ++row) {
+            for (int cls = 0; cls < numClasses; ++cls) {
+                for (int row = 0; row < numClasses; ++row) {
                     cout << confusionMatrix[cls][row] << "\t|| ";
                 }
                 cout << endl;
@@ -282,7 +187,7 @@ void findBestHCVoting (vector<HyperCircle> &circles, vector<Point> &train, vecto
     }
 
     // After testing all submodes, print out each accuracy
-    if (PRINTING) {
+    if (printing) {
         cout << "=== HC Voting Submode Accuracies ===" << endl;
         cout << "SIMPLE_MAJORITY: " << accuracies[HyperCircle::SIMPLE_MAJORITY] << endl;
         cout << "COUNT_VOTE:      " << accuracies[HyperCircle::COUNT_VOTE] << endl;
@@ -294,33 +199,36 @@ void findBestHCVoting (vector<HyperCircle> &circles, vector<Point> &train, vecto
     }
 }
 
-void findBestKNNStyle(vector<HyperCircle> &circles, vector<Point> &train, vector<Point> &testData) {
+void findBestKNNStyle(HyperCircleModel &model, Dataset &train, Dataset &testData, bool printing = true) {
+
+    const int numClasses = max(testData.numClasses(), model.numClasses);
 
     // different k values to test
     vector<float> kVals {1, 3, 5, 7, 9, 13, 15, 21, 25};
 
-    vector<vector<int>> confusionMatrix(CLASS_MAP.size(), vector<int>(CLASS_MAP.size()));
+    vector<vector<int>> confusionMatrix(numClasses, vector<int>(numClasses));
     int unclassifiedCount = 0;
 
-    vector<Point> pointsNotClassified;
+    Dataset pointsNotClassified = testData.emptyLike();
 
     // classify all points with HC's as normal
+    vector<int> predictions = model.classifyPoints(train, testData, HyperCircle::USE_CIRCLES, HyperCircle::SIMPLE_MAJORITY, -1);
     for (int p = 0; p < testData.size(); ++p) {
         const auto &point = testData[p];
 
-        int predictedClass = HyperCircle::classifyPoint(circles,train,point.location, HyperCircle::USE_CIRCLES, HyperCircle::SIMPLE_MAJORITY, NUM_CLASSES, -1);
-
         // if not covered by our circle, use KNN.
-        if (predictedClass == -1) {
+        if (predictions[p] == -1) {
             unclassifiedCount++;
-            // push back this point so that we know we have to run KNN on it.
+            // push back this point so that we know we have to run KNN on it. it gets counted once the fallback votes.
             pointsNotClassified.push_back(point);
+            continue;
         }
 
-        // Atomic increment of the appropriate cell in confusionMatrix
-        confusionMatrix[point.classification][predictedClass]++;
+        // increment of the appropriate cell in confusionMatrix
+        confusionMatrix[point.classification][predictions[p]]++;
     }
-    cout << "HC's Missed: " << unclassifiedCount << " of the test points!" << endl;
+    if (printing)
+        cout << "HC's Missed: " << unclassifiedCount << " of the test points!" << endl;
 
     for (int k = 0; k < kVals.size(); ++k) {
 
@@ -332,21 +240,23 @@ void findBestKNNStyle(vector<HyperCircle> &circles, vector<Point> &train, vector
             // copy the confusion matrix which was generated by the HC's
             auto thisConfigConfusionMatrix = confusionMatrix;
 
+            vector<int> fallbackPredictions = model.classifyPoints(train, pointsNotClassified, subMode, -1, kVals[k]);
             for (int p = 0; p < pointsNotClassified.size(); ++p) {
                 const auto &point = pointsNotClassified[p];
 
-                int predictedClass = HyperCircle::classifyPoint(circles,train,point.location, subMode, -1, NUM_CLASSES, kVals[k]);
+                int predictedClass = fallbackPredictions[p];
 
                 // if not covered by our circle, use KNN.
                 if (predictedClass == -1) {
                     cout << "KNN RETURNED -1!" << endl;
+                    continue;
                 }
 
                 // increment of the appropriate cell in confusionMatrix
                 thisConfigConfusionMatrix[point.classification][predictedClass]++;
             }
 
-            if (PRINTING) {
+            if (printing) {
                 cout << "K = " << kVals[k] << endl;
                 // Print header for this submode
                 switch (subMode) {
@@ -361,8 +271,8 @@ void findBestKNNStyle(vector<HyperCircle> &circles, vector<Point> &train, vector
                     break;
                 }
 
-                for (int cls = 0; cls < CLASS_MAP.size(); ++cls) {
-                    for (int row = 0; row < CLASS_MAP.size(); ++row) {
+                for (int cls = 0; cls < numClasses; ++cls) {
+                    for (int row = 0; row < numClasses; ++row) {
                         cout << thisConfigConfusionMatrix[cls][row] << "\t|| ";
                     }
                     cout << endl;
@@ -381,7 +291,7 @@ void findBestKNNStyle(vector<HyperCircle> &circles, vector<Point> &train, vector
         } // end submode
 
         // After testing all submodes, print out each accuracy
-        if (PRINTING) {
+        if (printing) {
             cout << "=== KNN Voting Submode Accuracies with K value: " << kVals[k] << "===" << endl;
             cout << "REGULAR_KNN: " << accuracies[0] << endl;
             cout << "K_NEAREST_CIRCLES: " << accuracies[1] << endl;
@@ -393,10 +303,10 @@ void findBestKNNStyle(vector<HyperCircle> &circles, vector<Point> &train, vector
 }
 
 // return is accuracy, then average circle count
-pair<float, float> kFoldValidation(int numFolds, vector<Point> &allData) {
+pair<float, float> kFoldValidation(int numFolds, Dataset &allData, bool printing = true) {
 
     // first we use our util function to split up all our data into different training and testing folds.
-    vector<vector<Point>> kBuckets = Utils::stratifiedKFolds(numFolds, allData);
+    vector<Dataset> kBuckets = Utils::stratifiedKFolds(numFolds, allData);
 
     // now, we run our loop numFolds times. gathering info each time.
     float totalAcc = 0.0f;
@@ -404,30 +314,31 @@ pair<float, float> kFoldValidation(int numFolds, vector<Point> &allData) {
     for (int fold = 0; fold < numFolds; ++fold) {
 
         // setting up train and test split for this iteration
-        vector<Point> trainingData;
-        vector<Point> testData;
+        Dataset trainingData = allData.emptyLike();
+        Dataset testData = allData.emptyLike();
         for (int trainFold = 0; trainFold < numFolds; ++trainFold) {
             if (trainFold == fold) {
                 testData = kBuckets[fold];
             }
             else
-                trainingData.insert(trainingData.end(), kBuckets[trainFold].begin(), kBuckets[trainFold].end());
+                trainingData.points.insert(trainingData.end(), kBuckets[trainFold].begin(), kBuckets[trainFold].end());
         }
 
-        // vector<HyperCircle> circles = HyperCircle::generateHyperCircles(trainingData, NUM_CLASSES);
-    	vector<HyperCircle> circles = HyperCircle::generateMaxDistanceBasedHyperCircles(trainingData, NUM_CLASSES);
+        // vector<HyperCircle> circles = HyperCircle::generateHyperCircles(trainingData);
+    	vector<HyperCircle> circles = HyperCircle::generateMaxDistanceBasedHyperCircles(trainingData);
+        HyperCircleModel model(circles, trainingData.numAttributes, trainingData.numClasses());
         // get our accuracy on the test portion.
         int k = 3;
-        totalAcc += testAccuracy(circles, trainingData, testData, k);
+        totalAcc += testAccuracy(model, trainingData, testData, k, printing);
 
         // add our count so we can track how many circles we needed.
-        totalCircles += circles.size();
+        totalCircles += model.size();
     }
 
     float avgAcc = totalAcc / (float) numFolds;
     float avgCircles = totalCircles / (float) numFolds;
 
-    if (PRINTING) {
+    if (printing) {
         printf("%d FOLD CROSS VALIDATION ACCURACY: %.3f", numFolds, avgAcc);
         printf("AVERAGE NUMBER OF HYPERCIRCLES NEEDED:\t%.2f", avgCircles);
     }
@@ -435,18 +346,103 @@ pair<float, float> kFoldValidation(int numFolds, vector<Point> &allData) {
     return {avgAcc, avgCircles};
 }
 
-// frees all the points
-void cleanupPoints(vector<Point> &data) {
-    for (int i = 0; i < data.size(); ++i) {
-        delete[] data[i].location;
+// runs the circles and the knn fallback both exactly and through LSH indexes with a few different settings, and reports
+// how often the approximate answers agree with the exact ones, the accuracy of each, and how much faster it was.
+void compareApproximate(HyperCircleModel &model, Dataset &train, Dataset &testData, int k) {
+
+    using clock = chrono::steady_clock;
+    auto seconds = [](clock::time_point since) { return chrono::duration<double>(clock::now() - since).count(); };
+    auto accuracy = [&](const vector<int> &predictions) {
+        int right = 0;
+        for (int p = 0; p < testData.size(); ++p)
+            right += predictions[p] == testData[p].classification;
+        return (float) right / (float) testData.size();
+    };
+
+    // the exact answers everything gets compared to
+    auto start = clock::now();
+    vector<int> exactCircles = model.classifyPoints(train, testData, HyperCircle::USE_CIRCLES, HyperCircle::SIMPLE_MAJORITY, k);
+    const double exactCircleTime = seconds(start);
+    start = clock::now();
+    vector<int> exactKNN = model.classifyPoints(train, testData, HyperCircle::REGULAR_KNN, -1, k);
+    const double exactKNNTime = seconds(start);
+
+    cout << "EXACT:	circles accuracy " << accuracy(exactCircles) << " in " << exactCircleTime * 1000 << "ms"
+         << "	knn accuracy " << accuracy(exactKNN) << " in " << exactKNNTime * 1000 << "ms" << endl << endl;
+
+    // width (as a multiple of the typical spacing), tables, hashes per table. wider buckets and more tables find more
+    // of the real answers but look at more rows, so the speedup goes the other way. where it pays off depends a lot on
+    // the dataset, so we just show a spread of them.
+    const vector<tuple<float, int, int>> settings {{1.0f, 8, 4}, {2.0f, 8, 4}, {2.0f, 8, 8}, {2.0f, 16, 8}, {4.0f, 8, 8}, {4.0f, 16, 12}};
+
+    cout << "width\ttables\thashes\t|| circles: agree\taccuracy\tspeedup\t|| knn: agree\taccuracy\tspeedup" << endl;
+    for (const auto &[widthFactor, tables, hashes] : settings) {
+        model.buildIndex(tables, hashes, widthFactor);
+        train.buildIndex(tables, hashes, widthFactor);
+
+        start = clock::now();
+        vector<int> approxCircles = model.classifyPoints(train, testData, HyperCircle::APPROX_CIRCLES, HyperCircle::SIMPLE_MAJORITY, k);
+        const double circleTime = seconds(start);
+        start = clock::now();
+        vector<int> approxKNN = model.classifyPoints(train, testData, HyperCircle::APPROX_KNN, -1, k);
+        const double knnTime = seconds(start);
+
+        int circlesAgree = 0, knnAgree = 0;
+        for (int p = 0; p < testData.size(); ++p) {
+            circlesAgree += approxCircles[p] == exactCircles[p];
+            knnAgree += approxKNN[p] == exactKNN[p];
+        }
+
+        cout << widthFactor << "\t" << tables << "\t" << hashes << "\t|| " << (float) circlesAgree / testData.size() << "\t\t" << accuracy(approxCircles)
+             << "\t\t" << exactCircleTime / circleTime << "x\t|| " << (float) knnAgree / testData.size() << "\t\t"
+             << accuracy(approxKNN) << "\t\t" << exactKNNTime / knnTime << "x" << endl;
+    }
+    cout << "(circles accuracy counts the points no circle covered as wrong, for both)" << endl;
+
+    // don't leave the last settings lying around
+    model.circleIndex.reset();
+    train.index.reset();
+}
+
+// runs k fold validation on a bunch of datasets at once, one thread each. nothing is shared between the jobs, so they
+// can't step on each other. the output of each job would be interleaved, so we only print a summary once they all finish.
+void batchKFoldValidation(int numFolds, const vector<string> &fileNames) {
+
+    vector<pair<float, float>> results(fileNames.size(), {0.0f, 0.0f});
+    vector<size_t> sizes(fileNames.size(), 0);
+
+    vector<thread> jobs;
+    for (int f = 0; f < fileNames.size(); ++f) {
+        jobs.emplace_back([&, f]() {
+            Dataset data = Dataset::readFile(fileNames[f]);
+            sizes[f] = data.size();
+            if (!data.empty())
+                results[f] = kFoldValidation(numFolds, data, false);
+        });
+    }
+    for (auto &job : jobs)
+        job.join();
+
+    cout << "=== " << numFolds << " FOLD CROSS VALIDATION ===" << endl;
+    for (int f = 0; f < fileNames.size(); ++f) {
+        cout << left << setw(24) << fileNames[f] << "points: " << setw(8) << sizes[f]
+             << "accuracy: " << setw(10) << results[f].first << "circles: " << results[f].second << endl;
     }
 }
 
 int main() {
 
+    // measure what a parallel region costs on this machine, so we know when splitting work up is worth it
+    Parallelism::calibrate();
+
     int choice;
-    vector<Point> trainData;
-    vector<Point> testData;
+    Dataset trainData;
+    Dataset testData;
+    HyperCircleModel model;
+
+    // how we lay out memory, set with option 19. applies to datasets read and models made after it's set.
+    Numa::Config numa;
+    // the circles model was generated from, which point into trainData. kept so we can update them with more data.
     vector<HyperCircle> circles;
     bool running = true;
     while (running) {
@@ -472,12 +468,9 @@ int main() {
                 string fileName;
                 getline(cin >> ws, fileName); // eat leading whitespace
 
-                // reset our global variables
-                CLASS_MAP.clear();
-                NUM_CLASSES = 0;
-
-                // get our Points
-                trainData = readFile(fileName);
+                // get our Points. this starts a fresh set of labels.
+                trainData = Dataset::readFile(fileName, nullptr, numa);
+                circles.clear();
 
                 cout << "FOUND: " << trainData.size() << " points in that file." << endl;
                 Utils::waitForEnter();
@@ -495,7 +488,18 @@ int main() {
                 #endif
 
                 getline(cin, fileName);
-                testData = readFile(fileName);
+
+                // read against the training labels, so the class ids match up
+                testData = Dataset::readFile(fileName, trainData.classes, numa);
+
+                // rows of the wrong width would get read past their ends, so we don't keep them. a loaded model knows
+                // its own width even without the training file.
+                const int width = !trainData.empty() ? trainData.numAttributes : model.numAttributes;
+                if (width > 0 && testData.numAttributes != width) {
+                    cerr << "Test file has " << testData.numAttributes << " attributes, but the " << (!trainData.empty() ? "training file" : "model")
+                         << " has " << width << ". Not using it." << endl;
+                    testData = Dataset();
+                }
 
                 Utils::waitForEnter();
                 break;
@@ -503,16 +507,20 @@ int main() {
 
             // generates HC's from the training file
             case 3: {
-                circles = HyperCircle::generateHyperCircles(trainData, NUM_CLASSES);
-                cout << "Generated: " << circles.size() << " HyperCircles." << endl;
+                circles = HyperCircle::generateHyperCircles(trainData);
+                model = HyperCircleModel(circles, trainData.numAttributes, trainData.numClasses(), trainData.classes->labels());
+                model.replicateCenters(numa);
+                cout << "Generated: " << model.size() << " HyperCircles." << endl;
                 Utils::waitForEnter();
                 break;
             }
 
             // generates HC's using max radius based creation instead of merging.
             case 4: {
-                circles = HyperCircle::generateMaxDistanceBasedHyperCircles(trainData, NUM_CLASSES);
-                cout << "Generated: " << circles.size() << " HyperCircles." << endl;
+                circles = HyperCircle::generateMaxDistanceBasedHyperCircles(trainData);
+                model = HyperCircleModel(circles, trainData.numAttributes, trainData.numClasses(), trainData.classes->labels());
+                model.replicateCenters(numa);
+                cout << "Generated: " << model.size() << " HyperCircles." << endl;
                 Utils::waitForEnter();
                 break;
             }
@@ -520,7 +528,7 @@ int main() {
             // tests against a given test set
             case 5: {
                 int k = 3;
-                float acc = testAccuracy(circles, trainData,testData, k);
+                float acc = testAccuracy(model, trainData,testData, k);
                 cout << "Accuracy: " << acc << endl;
                 Utils::waitForEnter();
                 break;
@@ -546,7 +554,7 @@ int main() {
                 string fileName;
                 getline(cin, fileName);
 
-                saveCircles(circles, fileName);
+                model.save(fileName);
 
                 Utils::waitForEnter();
                 break;
@@ -557,21 +565,330 @@ int main() {
                 string fileName;
                 getline(cin, fileName);
 
-                circles = loadCircles(fileName);
-                cout << "Loaded: " << circles.size() << " points in that file." << endl;
+                // old files without a header still need the training data imported, so they know how wide they are
+                try {
+                    model = HyperCircleModel::load(fileName, trainData.numAttributes, trainData.numClasses());
+                    model.replicateCenters(numa);
+                    circles.clear();
+                    cout << "Loaded: " << model.size() << " circles from that file." << endl;
+
+                    // without the training file, test files get read against the model's own labels so the ids match.
+                    // a test file read before this was numbered its own way, so it has to be read again.
+                    if (trainData.empty() && !model.classNames.empty()) {
+                        trainData.classes = ClassMap::withLabels(model.classNames);
+                        if (!testData.empty()) {
+                            testData = Dataset();
+                            cout << "Read the test file again (option 2), so its labels line up with the model's." << endl;
+                        }
+                    }
+                } catch (const runtime_error &e) {
+                    cerr << e.what() << endl;
+                }
 
                 Utils::waitForEnter();
                 break;
             }
 
             case 9: {
-                findBestHCVoting(circles, trainData, testData);
+                findBestHCVoting(model, trainData, testData);
                 Utils::waitForEnter();
                 break;
             }
 
             case 10: {
-                findBestKNNStyle(circles, trainData, testData);
+                findBestKNNStyle(model, trainData, testData);
+                Utils::waitForEnter();
+                break;
+            }
+
+            case 11: {
+                cout << "Enter dataset file names to run at once, separated by spaces: " << endl;
+                string line;
+                getline(cin, line);
+
+                stringstream ss(line);
+                vector<string> fileNames;
+                string fileName;
+                while (ss >> fileName)
+                    fileNames.push_back(fileName);
+
+                int numFolds;
+                cout << "How many folds of cross validation (K value) ?" << endl;
+                cin >> numFolds;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+                batchKFoldValidation(numFolds, fileNames);
+
+                Utils::waitForEnter();
+                break;
+            }
+
+            case 12: {
+                compareApproximate(model, trainData, testData, 5);
+                Utils::waitForEnter();
+                break;
+            }
+
+            // adds a file of new points onto the training data, and updates the circles instead of generating again
+            case 13: {
+                if (circles.empty()) {
+                    cout << "Generate HyperCircles from the training data first (3 or 4). Loaded models can't be updated." << endl;
+                    Utils::waitForEnter();
+                    break;
+                }
+
+                cout << "Enter new training data filename: " << endl;
+                #ifdef _WIN32
+                system("dir datasets/");
+                #else
+                system("ls datasets/");
+                #endif
+
+                string fileName;
+                getline(cin >> ws, fileName);
+
+                Dataset newData = Dataset::readFile(fileName, trainData.classes, numa);
+                if (newData.numAttributes != trainData.numAttributes) {
+                    cerr << "New file has " << newData.numAttributes << " attributes, but the training file has " << trainData.numAttributes << endl;
+                    Utils::waitForEnter();
+                    break;
+                }
+
+                auto start = chrono::steady_clock::now();
+                HyperCircle::updateHyperCircles(circles, trainData, newData);
+                model = HyperCircleModel(circles, trainData.numAttributes, trainData.numClasses(), trainData.classes->labels());
+                model.replicateCenters(numa);
+                cout << "Updated to: " << model.size() << " HyperCircles over " << trainData.size() << " points in "
+                     << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << "ms." << endl;
+                Utils::waitForEnter();
+                break;
+            }
+
+            // keeps only as many circles as it takes to cover the same training points, or fewer to fit a budget
+            case 14: {
+                if (circles.empty()) {
+                    cout << "Generate HyperCircles from the training data first (3 or 4). Loaded models can't be compacted." << endl;
+                    Utils::waitForEnter();
+                    break;
+                }
+
+                cout << "Enter a circle budget, or a p99 latency budget per row ending in us (like 50us). Blank keeps every point covered." << endl;
+                string line;
+                getline(cin, line);
+                stringstream ss(line);
+                double budget = 0.0;
+                string unit;
+                ss >> budget >> unit;
+                const bool latency = unit == "us";
+
+                // the curve goes over the test data if there is some, otherwise what we lose on the training data
+                vector<Compaction::Step> steps;
+                if (budget > 0.0) {
+                    steps = Compaction::curve(circles, trainData, testData.empty() ? trainData : testData, Compaction::Settings());
+                    Compaction::printCurve(steps, cout);
+                }
+
+                int maxCircles = numeric_limits<int>::max();
+                if (latency && budget > 0.0) {
+                    const int fit = Compaction::fitLatency(steps, budget);
+                    if (fit < 0) {
+                        cout << "Nothing fits in " << budget << "us. Leaving the circles as they are." << endl;
+                        Utils::waitForEnter();
+                        break;
+                    }
+                    // the first step is the circles as they are
+                    if (fit == 0) {
+                        cout << "The circles as they are fit in " << budget << "us." << endl;
+                        Utils::waitForEnter();
+                        break;
+                    }
+                    maxCircles = steps[fit].budget;
+                } else if (budget >= 1.0)
+                    maxCircles = (int) budget;
+
+                const size_t before = circles.size();
+                auto start = chrono::steady_clock::now();
+                HyperCircle::coverCircles(circles, trainData, maxCircles);
+                model = HyperCircleModel(circles, trainData.numAttributes, trainData.numClasses(), trainData.classes->labels());
+                model.replicateCenters(numa);
+                cout << "Compacted: " << before << " -> " << model.size() << " HyperCircles in "
+                     << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << "ms." << endl;
+                Utils::waitForEnter();
+                break;
+            }
+
+            // builds circles from rounds of samples, checked against the whole training set
+            case 15: {
+                size_t sampleSize;
+                cout << "How many points per sample?" << endl;
+                cin >> sampleSize;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+                circles = HyperCircle::generateSampledHyperCircles(trainData, sampleSize);
+                model = HyperCircleModel(circles, trainData.numAttributes, trainData.numClasses(), trainData.classes->labels());
+                model.replicateCenters(numa);
+                cout << "Generated: " << model.size() << " HyperCircles." << endl;
+                Utils::waitForEnter();
+                break;
+            }
+
+            // sparse training and test files (libsvm, or csv kept sparse), for feature sets that are mostly zeros
+            case 16: {
+                cout << "Enter sparse training data filename: " << endl;
+                #ifdef _WIN32
+                system("dir datasets/");
+                #else
+                system("ls datasets/");
+                #endif
+
+                string trainName, testName;
+                getline(cin >> ws, trainName);
+                cout << "Enter sparse testing data filename: " << endl;
+                getline(cin >> ws, testName);
+
+                SparseDataset sparseTrain = SparseDataset::readFile(trainName);
+                SparseDataset sparseTest = SparseDataset::readFile(testName, sparseTrain.classes, sparseTrain.numAttributes);
+                cout << "FOUND: " << sparseTrain.size() << " training and " << sparseTest.size() << " testing points, "
+                     << sparseTrain.numAttributes << " attributes, " << sparseTrain.columns.size() << " nonzeros in training." << endl;
+
+                // the model copies the centers out, so the sparse rows can go when we're done here. they can't be updated.
+                model = HyperCircleModel(HyperCircle::generateHyperCircles(sparseTrain), sparseTrain.numAttributes, sparseTrain.numClasses(), sparseTrain.classes->labels());
+                model.replicateCenters(numa);
+                circles.clear();
+                cout << "Generated: " << model.size() << " HyperCircles." << endl;
+
+                vector<int> predictions(sparseTest.size());
+                model.classifySparse(sparseTest, predictions.data(), HyperCircle::SIMPLE_MAJORITY, HyperCircle::K_NEAREST_CIRCLES, 3);
+                int correct = 0;
+                for (size_t i = 0; i < sparseTest.size(); ++i)
+                    correct += predictions[i] == sparseTest.labels[i];
+                cout << "Accuracy: " << (sparseTest.empty() ? 0.0f : (float) correct / sparseTest.size()) << endl;
+                Utils::waitForEnter();
+                break;
+            }
+
+            // generation that stops when time is up, with whatever it has so far. run it again with the same checkpoint
+            // file to pick up where it left off.
+            case 17: {
+                HyperCircle::Budget budget;
+                cout << "How many seconds can it take? (0 for no limit)" << endl;
+                cin >> budget.seconds;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Enter checkpoint filename: " << endl;
+                getline(cin >> ws, budget.checkpointFile);
+
+                circles = HyperCircle::generateHyperCircles(trainData, budget);
+                model = HyperCircleModel(circles, trainData.numAttributes, trainData.numClasses(), trainData.classes->labels());
+                model.replicateCenters(numa);
+                cout << "Generated: " << model.size() << " HyperCircles." << endl;
+                Utils::waitForEnter();
+                break;
+            }
+
+            // cross validates every generator, voting submode, fallback and k together, sharing what they have in common
+            case 18: {
+                Sweep::Grid grid;
+                cout << "How many folds of cross validation (K value) ?" << endl;
+                cin >> grid.numFolds;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+                cout << "Enter the k values to try for the fallbacks, separated by spaces (blank for 1 3 5 7 9): " << endl;
+                string line;
+                getline(cin, line);
+                stringstream ss(line);
+                vector<int> kValues;
+                int k;
+                while (ss >> k)
+                    if (k > 0)
+                        kValues.push_back(k);
+                if (!kValues.empty())
+                    grid.kValues = kValues;
+
+                cout << "How many MB can the sweep hold at once? (0 for 256)" << endl;
+                size_t megabytes = 0;
+                cin >> megabytes;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                if (megabytes > 0)
+                    grid.memoryBudget = megabytes << 20;
+
+                auto start = chrono::steady_clock::now();
+                vector<Sweep::Result> results = Sweep::run(trainData, grid);
+                Sweep::printResults(results, cout, 25);
+                cout << "Swept in " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << "s." << endl;
+                Utils::waitForEnter();
+                break;
+            }
+
+            // memory placement for multi socket machines. only changes how fast things go, never the answers.
+            case 19: {
+                auto readInt = [](const string &prompt) {
+                    cout << prompt << endl;
+                    int value = 0;
+                    cin >> value;
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    return value;
+                };
+
+                numa.simulatedNodes = max(0, readInt("How many memory nodes to simulate? (0 for the real topology)"));
+                const auto nodes = Numa::topology(numa.simulatedNodes);
+                cout << nodes->size() << (numa.simulatedNodes > 0 ? " simulated" : "") << " node(s):" << endl;
+                for (int node = 0; node < nodes->size(); ++node) {
+                    cout << "  node " << node << ": cpus";
+                    for (int cpu : nodes->cpus[node])
+                        cout << " " << cpu;
+                    cout << endl;
+                }
+
+                const int how = readInt("Place datasets read from now on, and distance tiles, how? (0 off, 1 first touch, 2 interleaved)");
+                numa.placement = how == Numa::FIRST_TOUCH || how == Numa::INTERLEAVE ? how : Numa::OFF;
+                numa.replicate = readInt("Keep a copy of the model's centers on every node? (1 yes, 0 no)") == 1;
+                const bool pin = readInt("Pin each thread to a node? (1 yes, 0 no)") == 1;
+
+                model.replicateCenters(numa);
+                if (pin)
+                    cout << "Pinned " << Numa::pinThreads(numa.simulatedNodes) << " of " << Parallelism::numThreads() << " threads." << endl;
+
+                cout << "Placement " << Numa::placementName(numa.placement) << ", " << (numa.replicate ? "replicated" : "one copy of the")
+                     << " centers." << endl;
+                Utils::waitForEnter();
+                break;
+            }
+
+            // tests against a test file read a chunk at a time, classifying while it's read. for files too big to load.
+            case 20: {
+                cout << "Enter testing data filename: " << endl;
+                #ifdef _WIN32
+                system("dir datasets/");
+                #else
+                system("ls datasets/");
+                #endif
+                string fileName;
+                getline(cin, fileName);
+
+                Streaming::Settings settings;
+                cout << "How many rows per chunk? (0 for " << settings.chunkRows << ")" << endl;
+                size_t chunkRows = 0;
+                cin >> chunkRows;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                if (chunkRows > 0)
+                    settings.chunkRows = chunkRows;
+
+                Streaming::Result result = Streaming::evaluate(model, trainData, fileName, trainData.classes, settings);
+                if (result.rows > 0) {
+                    printConfusionMatrix(result.confusionMatrix, *trainData.classes, result.unclassified);
+                    cout << "Accuracy: " << result.accuracy() << endl;
+                    cout << "Streamed " << result.rows << " rows in " << result.chunks << " chunks in " << result.seconds
+                         << "s (" << result.parseSeconds << "s parsing, " << result.classifySeconds << "s classifying over "
+                         << Parallelism::numThreads() << " threads, " << result.readerChunks << " chunks classified by the reader)." << endl;
+                } else
+                    cout << "Nothing to test." << endl;
                 Utils::waitForEnter();
                 break;
             }
@@ -587,9 +904,5 @@ int main() {
         }
     }
 
-    // delete our dynamically allocated memory
-    cleanupPoints(trainData);
-    cleanupPoints(testData);
-
     return 0;
 }
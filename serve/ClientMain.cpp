@@ -0,0 +1,109 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "ServeProtocol.h"
+#include "HyperCircle.h"
+#include "Dataset.h"
+
+using namespace std;
+
+// sends every row of a csv to the server in batches of --rows rows (always small enough to fit in one message), and
+// reports what came back.
+// class ids only line up with the csv's labels if the model was trained on a file with its labels in the same order.
+
+static void usage() {
+    cerr << "usage: HyperCircleClient <socket path> <csv in datasets/> [--model M] [--vote V] [--k K] [--rows R] [--scores]" << endl;
+}
+
+int main(int argc, char **argv) {
+
+    string socketPath;
+    string fileName;
+    size_t rowsPerRequest = 4096;
+    ServeProtocol::RequestHeader header {ServeProtocol::REQUEST_MAGIC, 0, 0, 0, 0, HyperCircle::SIMPLE_MAJORITY, HyperCircle::K_NEAREST_CIRCLES, 3};
+
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--model" && a + 1 < argc)
+            header.model = stoul(argv[++a]);
+        else if (arg == "--vote" && a + 1 < argc)
+            header.vote = stoi(argv[++a]);
+        else if (arg == "--k" && a + 1 < argc)
+            header.k = stoi(argv[++a]);
+        else if (arg == "--rows" && a + 1 < argc)
+            rowsPerRequest = stoul(argv[++a]);
+        else if (arg == "--scores")
+            header.flags |= ServeProtocol::WANT_SCORES;
+        else if (socketPath.empty())
+            socketPath = arg;
+        else
+            fileName = arg;
+    }
+    if (socketPath.empty() || fileName.empty() || rowsPerRequest == 0) {
+        usage();
+        return 1;
+    }
+
+    Dataset data = Dataset::readFile(fileName);
+    if (data.empty())
+        return 1;
+
+    header.numAttributes = data.numAttributes;
+    rowsPerRequest = min(rowsPerRequest, ServeProtocol::maxRowsPerRequest(header.numAttributes));
+
+    int fd = ServeProtocol::connectTo(socketPath);
+    if (fd < 0) {
+        cerr << "Failed to connect to " << socketPath << endl;
+        return 1;
+    }
+
+    // every batch's labels and scores get tacked onto the end, so they line up with the csv's rows
+    ServeProtocol::ResponseHeader response;
+    vector<int32_t> labels, batchLabels;
+    vector<float> scores, batchScores;
+    vector<float> rows;
+    for (size_t first = 0; first < data.size(); first += rowsPerRequest) {
+        const size_t last = min(data.size(), first + rowsPerRequest);
+        rows.clear();
+        for (size_t p = first; p < last; ++p)
+            rows.insert(rows.end(), data[p].location, data[p].location + data.numAttributes);
+        header.numRows = last - first;
+
+        if (!ServeProtocol::sendRequest(fd, header, rows.data()) || !ServeProtocol::receiveResponse(fd, response, batchLabels, batchScores)) {
+            cerr << "Lost the connection" << endl;
+            close(fd);
+            return 1;
+        }
+        if (response.status != ServeProtocol::OK) {
+            cerr << "Server said no, status " << response.status << endl;
+            close(fd);
+            return 1;
+        }
+        labels.insert(labels.end(), batchLabels.begin(), batchLabels.end());
+        scores.insert(scores.end(), batchScores.begin(), batchScores.end());
+    }
+    close(fd);
+
+    int right = 0;
+    int uncovered = 0;
+    for (int p = 0; p < labels.size(); ++p) {
+        right += labels[p] == data[p].classification;
+        uncovered += labels[p] == -1;
+    }
+    cout << "Classified: " << labels.size() << " rows" << endl;
+    cout << "Accuracy: " << (float) right / (float) labels.size() << endl;
+    if (header.fallback == HyperCircle::USE_CIRCLES)
+        cout << "UNCLASSIFIED BY THE HCs:\t" << uncovered << endl;
+
+    // show the votes for the first few rows
+    if (response.numClasses > 0) {
+        for (int p = 0; p < min<size_t>(labels.size(), 5); ++p) {
+            cout << "row " << p << " -> " << labels[p] << "\tvotes:";
+            for (int c = 0; c < response.numClasses; ++c)
+                cout << " " << scores[(size_t) p * response.numClasses + c];
+            cout << endl;
+        }
+    }
+    return 0;
+}
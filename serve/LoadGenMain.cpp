@@ -0,0 +1,123 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <iomanip>
+#include "ServeProtocol.h"
+#include "HyperCircle.h"
+#include "Dataset.h"
+
+using namespace std;
+
+// hammers a running server from a bunch of connections at once with small batches of rows from a csv, and reports
+// latency percentiles and throughput. each connection waits for its answer before sending the next request.
+
+static void usage() {
+    cerr << "usage: HyperCircleLoadGen <socket path> <csv in datasets/> [--connections C] [--rows R] [--seconds S] [--model M]" << endl;
+}
+
+int main(int argc, char **argv) {
+
+    string socketPath;
+    string fileName;
+    int connections = 8;
+    int rowsPerRequest = 16;
+    double seconds = 5.0;
+    uint32_t model = 0;
+
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--connections" && a + 1 < argc)
+            connections = stoi(argv[++a]);
+        else if (arg == "--rows" && a + 1 < argc)
+            rowsPerRequest = stoi(argv[++a]);
+        else if (arg == "--seconds" && a + 1 < argc)
+            seconds = stod(argv[++a]);
+        else if (arg == "--model" && a + 1 < argc)
+            model = stoul(argv[++a]);
+        else if (socketPath.empty())
+            socketPath = arg;
+        else
+            fileName = arg;
+    }
+    if (socketPath.empty() || fileName.empty() || connections <= 0 || rowsPerRequest <= 0) {
+        usage();
+        return 1;
+    }
+
+    Dataset data = Dataset::readFile(fileName);
+    if (data.empty())
+        return 1;
+
+    // each connection keeps its own latencies, in microseconds
+    vector<vector<double>> latencies(connections);
+    vector<int> failures(connections, 0);
+    const auto end = chrono::steady_clock::now() + chrono::duration<double>(seconds);
+    const auto start = chrono::steady_clock::now();
+
+    vector<thread> clients;
+    for (int c = 0; c < connections; ++c) {
+        clients.emplace_back([&, c]() {
+            int fd = ServeProtocol::connectTo(socketPath);
+            if (fd < 0) {
+                failures[c]++;
+                return;
+            }
+
+            mt19937 rng(c);
+            uniform_int_distribution<size_t> pick(0, data.size() - 1);
+            ServeProtocol::RequestHeader header {ServeProtocol::REQUEST_MAGIC, model, (uint32_t) rowsPerRequest, (uint32_t) data.numAttributes, 0,
+                                                 HyperCircle::SIMPLE_MAJORITY, HyperCircle::K_NEAREST_CIRCLES, 3};
+            vector<float> rows((size_t) rowsPerRequest * data.numAttributes);
+            ServeProtocol::ResponseHeader response;
+            vector<int32_t> labels;
+            vector<float> scores;
+
+            while (chrono::steady_clock::now() < end) {
+                for (int r = 0; r < rowsPerRequest; ++r) {
+                    const float *row = data[pick(rng)].location;
+                    copy(row, row + data.numAttributes, rows.begin() + (size_t) r * data.numAttributes);
+                }
+
+                auto sent = chrono::steady_clock::now();
+                if (!ServeProtocol::sendRequest(fd, header, rows.data()) || !ServeProtocol::receiveResponse(fd, response, labels, scores)) {
+                    failures[c]++;
+                    break;
+                }
+                if (response.status != ServeProtocol::OK) {
+                    failures[c]++;
+                    continue;
+                }
+                latencies[c].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+            }
+            close(fd);
+        });
+    }
+    for (auto &client : clients)
+        client.join();
+    const double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> all;
+    int totalFailures = 0;
+    for (int c = 0; c < connections; ++c) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        totalFailures += failures[c];
+    }
+    if (all.empty()) {
+        cerr << "No requests made it through. Is the server running?" << endl;
+        return 1;
+    }
+    sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all[min(all.size() - 1, (size_t) (p * all.size()))]; };
+
+    cout << fixed << setprecision(1);
+    cout << "connections: " << connections << "\trows per request: " << rowsPerRequest << endl;
+    cout << "requests: " << all.size() << "\tfailures: " << totalFailures << endl;
+    cout << "QPS: " << all.size() / elapsed << "\trows/s: " << all.size() * rowsPerRequest / elapsed << endl;
+    cout << "latency us  p50: " << percentile(0.50) << "\tp90: " << percentile(0.90) << "\tp99: " << percentile(0.99)
+         << "\tmax: " << all.back() << endl;
+    return 0;
+}
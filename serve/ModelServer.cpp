@@ -0,0 +1,291 @@
+#include "ModelServer.h"
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+ModelServer::ModelServer(vector<HyperCircleModel> models, size_t maxBatchRows, int maxDelayMicros) {
+    this->models = std::move(models);
+    this->maxBatchRows = max<size_t>(maxBatchRows, 1);
+    this->maxDelayMicros = max(maxDelayMicros, 0);
+}
+
+HyperCircleModel ModelServer::mapModel(const string &fileName) {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("Failed to open model file: " + fileName);
+
+    struct stat info;
+    if (::fstat(fd, &info) < 0 || info.st_size == 0) {
+        ::close(fd);
+        throw runtime_error("Failed to read model file: " + fileName);
+    }
+
+    // map it and build straight out of the page cache, no read buffer in between
+    void *mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        throw runtime_error("Failed to map model file: " + fileName);
+    ::madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+
+    try {
+        HyperCircleModel model = HyperCircleModel::fromBytes(static_cast<const char *>(mapped), info.st_size);
+        ::munmap(mapped, info.st_size);
+        return model;
+    } catch (...) {
+        ::munmap(mapped, info.st_size);
+        throw;
+    }
+}
+
+void ModelServer::serve(const string &socketPath) {
+
+    sockaddr_un address;
+    if (!ServeProtocol::fillAddress(socketPath, address))
+        throw runtime_error("Socket path is too long: " + socketPath);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw runtime_error("Failed to make a socket");
+
+    // a server that died without cleaning up leaves its socket file behind
+    ::unlink(socketPath.c_str());
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listener, 128) < 0) {
+        ::close(listener);
+        throw runtime_error("Failed to listen on " + socketPath);
+    }
+
+    thread batcher(&ModelServer::batchLoop, this);
+
+    // accept until someone stops us. we poll so that we notice stop() even if nobody connects.
+    while (!stopping) {
+        pollfd waiting {listener, POLLIN, 0};
+        int ready = ::poll(&waiting, 1, 100);
+        if (ready <= 0)
+            continue;
+
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+
+        {
+            lock_guard<mutex> guard(connectionLock);
+            connections.insert(fd);
+            openConnections = connections.size();
+        }
+        // connections take themselves off the list when they finish, so we don't have to hold on to their threads
+        thread(&ModelServer::handleConnection, this, fd).detach();
+    }
+
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+
+    // kick every connection out of its read, then let the batcher finish what it has
+    {
+        unique_lock<mutex> guard(connectionLock);
+        for (int fd : connections)
+            ::shutdown(fd, SHUT_RDWR);
+        allClosed.wait(guard, [&]() { return connections.empty(); });
+    }
+
+    {
+        lock_guard<mutex> guard(queueLock);
+    }
+    queueReady.notify_all();
+    batcher.join();
+}
+
+int ModelServer::validate(const ServeProtocol::RequestHeader &header, uint32_t length) const {
+    if (header.magic != ServeProtocol::REQUEST_MAGIC)
+        return ServeProtocol::BAD_REQUEST;
+    if (header.model >= models.size())
+        return ServeProtocol::UNKNOWN_MODEL;
+    if (header.numAttributes != (uint32_t) models[header.model].numAttributes)
+        return ServeProtocol::WRONG_WIDTH;
+    if (length != sizeof(header) + (uint64_t) header.numRows * header.numAttributes * sizeof(float))
+        return ServeProtocol::BAD_REQUEST;
+    if (header.vote < HyperCircle::SIMPLE_MAJORITY || header.vote > HyperCircle::SMALLEST_CIRCLE)
+        return ServeProtocol::BAD_REQUEST;
+
+    // no training data in here, so regular knn is out
+    if (header.fallback != HyperCircle::USE_CIRCLES && header.fallback != HyperCircle::K_NEAREST_CIRCLES && header.fallback != HyperCircle::K_NEAREST_RATIOS)
+        return ServeProtocol::BAD_REQUEST;
+    if (header.fallback != HyperCircle::USE_CIRCLES && header.k <= 0)
+        return ServeProtocol::BAD_REQUEST;
+    return ServeProtocol::OK;
+}
+
+void ModelServer::handleConnection(int fd) {
+
+    while (!stopping) {
+        uint32_t length;
+        if (!ServeProtocol::readFully(fd, &length, sizeof(length)))
+            break;
+
+        // too short to be a request, or too big to bother with. we can't find the next message after this, so hang up.
+        ServeProtocol::ResponseHeader response {ServeProtocol::RESPONSE_MAGIC, ServeProtocol::OK, 0, 0};
+        Pending pending;
+        if (length < sizeof(pending.header) || length > ServeProtocol::MAX_MESSAGE)
+            break;
+        if (!ServeProtocol::readFully(fd, &pending.header, sizeof(pending.header)))
+            break;
+
+        // a request we don't like still has its rows coming, so read past them before answering
+        response.status = validate(pending.header, length);
+        if (response.status != ServeProtocol::OK) {
+            vector<char> skip(length - sizeof(pending.header));
+            const uint32_t responseLength = sizeof(response);
+            if (!ServeProtocol::readFully(fd, skip.data(), skip.size())
+                || !ServeProtocol::writeFully(fd, &responseLength, sizeof(responseLength))
+                || !ServeProtocol::writeFully(fd, &response, sizeof(response)))
+                break;
+            continue;
+        }
+
+        pending.rows.resize((size_t) pending.header.numRows * pending.header.numAttributes);
+        if (!ServeProtocol::readFully(fd, pending.rows.data(), pending.rows.size() * sizeof(float)))
+            break;
+
+        // hand it to the batcher and wait for our answer
+        {
+            unique_lock<mutex> guard(queueLock);
+            queue.push_back(&pending);
+            queuedRows += pending.header.numRows;
+        }
+        queueReady.notify_one();
+        {
+            unique_lock<mutex> guard(queueLock);
+            answered.wait(guard, [&]() { return pending.done; });
+        }
+
+        const bool wantScores = pending.header.flags & ServeProtocol::WANT_SCORES;
+        response.numRows = pending.header.numRows;
+        response.numClasses = wantScores ? models[pending.header.model].numClasses : 0;
+        const uint32_t responseLength = (uint32_t) (sizeof(response) + pending.labels.size() * sizeof(int32_t) + pending.scores.size() * sizeof(float));
+        if (!ServeProtocol::writeFully(fd, &responseLength, sizeof(responseLength))
+            || !ServeProtocol::writeFully(fd, &response, sizeof(response))
+            || !ServeProtocol::writeFully(fd, pending.labels.data(), pending.labels.size() * sizeof(int32_t))
+            || !ServeProtocol::writeFully(fd, pending.scores.data(), pending.scores.size() * sizeof(float)))
+            break;
+    }
+
+    // closed under the lock, so stop() never shuts down an fd number that already got handed to someone else
+    {
+        lock_guard<mutex> guard(connectionLock);
+        connections.erase(fd);
+        openConnections = connections.size();
+        ::close(fd);
+    }
+    // through queueLock, so the batcher can't miss that we're gone between checking openConnections and waiting
+    {
+        lock_guard<mutex> guard(queueLock);
+    }
+    queueReady.notify_one();
+    allClosed.notify_all();
+}
+
+bool ModelServer::sameSettings(const ServeProtocol::RequestHeader &a, const ServeProtocol::RequestHeader &b) {
+    return a.model == b.model && a.vote == b.vote && a.fallback == b.fallback && a.k == b.k
+        && (a.flags & ServeProtocol::WANT_SCORES) == (b.flags & ServeProtocol::WANT_SCORES);
+}
+
+void ModelServer::batchLoop() {
+
+    while (true) {
+        vector<Pending *> taken;
+        {
+            unique_lock<mutex> guard(queueLock);
+            // a connection can still be handing us a request it read before it noticed stopping, and it would wait on
+            // its answer forever. so we only finish once every connection has closed and the queue is empty.
+            queueReady.wait(guard, [&]() { return !queue.empty() || (stopping && openConnections == 0); });
+            if (queue.empty())
+                return;
+
+            // give other requests a moment to join this batch, unless we already have plenty. if every open connection
+            // is already waiting on us nobody else can show up, so there is no point waiting either.
+            const auto deadline = chrono::steady_clock::now() + chrono::microseconds(maxDelayMicros);
+            queueReady.wait_until(guard, deadline, [&]() {
+                return queuedRows >= maxBatchRows || queue.size() >= openConnections || stopping;
+            });
+
+            taken.assign(queue.begin(), queue.end());
+            queue.clear();
+            queuedRows = 0;
+        }
+
+        // group up everything with the same settings, keeping arrival order within each group
+        vector<bool> grouped(taken.size(), false);
+        for (size_t i = 0; i < taken.size(); ++i) {
+            if (grouped[i])
+                continue;
+
+            vector<Pending *> group;
+            for (size_t j = i; j < taken.size(); ++j) {
+                if (!grouped[j] && sameSettings(taken[i]->header, taken[j]->header)) {
+                    group.push_back(taken[j]);
+                    grouped[j] = true;
+                }
+            }
+            runBatch(group);
+        }
+
+        {
+            lock_guard<mutex> guard(queueLock);
+            for (Pending *p : taken)
+                p->done = true;
+        }
+        answered.notify_all();
+    }
+}
+
+void ModelServer::runBatch(vector<Pending *> &group) {
+
+    const ServeProtocol::RequestHeader &settings = group.front()->header;
+    const HyperCircleModel &model = models[settings.model];
+    const bool wantScores = settings.flags & ServeProtocol::WANT_SCORES;
+
+    size_t total = 0;
+    for (Pending *p : group)
+        total += p->header.numRows;
+
+    for (Pending *p : group) {
+        p->labels.resize(p->header.numRows);
+        if (wantScores)
+            p->scores.resize((size_t) p->header.numRows * model.numClasses);
+    }
+
+    // just one request, so classify its rows right where they are
+    if (group.size() == 1) {
+        Pending *p = group.front();
+        model.classifyRows(p->rows.data(), p->header.numRows, p->labels.data(), settings.vote, settings.fallback, settings.k,
+                           wantScores ? p->scores.data() : nullptr);
+    }
+    else {
+        // pack the rows together, classify them as one batch, then hand the answers back out
+        vector<float> packed;
+        packed.reserve(total * model.numAttributes);
+        for (Pending *p : group)
+            packed.insert(packed.end(), p->rows.begin(), p->rows.end());
+
+        vector<int> labels(total);
+        vector<float> scores(wantScores ? total * model.numClasses : 0);
+        model.classifyRows(packed.data(), total, labels.data(), settings.vote, settings.fallback, settings.k,
+                           wantScores ? scores.data() : nullptr);
+
+        size_t at = 0;
+        for (Pending *p : group) {
+            copy(labels.begin() + at, labels.begin() + at + p->header.numRows, p->labels.begin());
+            if (wantScores)
+                copy(scores.begin() + at * model.numClasses, scores.begin() + (at + p->header.numRows) * model.numClasses, p->scores.begin());
+            at += p->header.numRows;
+        }
+    }
+
+    requests += group.size();
+    rows += total;
+    batches++;
+}
@@ -0,0 +1,94 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef MODELSERVER_H
+#define MODELSERVER_H
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+#include "HyperCircleModel.h"
+#include "ServeProtocol.h"
+
+// long running server which keeps models loaded and classifies batches of rows sent over a unix socket.
+// each connection gets a thread which just reads requests and writes responses. the actual classifying happens on one
+// batcher thread, which waits a little bit for requests to pile up and then runs all the ones for the same model and
+// settings as one classifyRows call. one big batch lets the parallelism policy spread the rows over every core, where
+// lots of tiny requests would each be too small to bother.
+class ModelServer {
+public:
+
+    // maxBatchRows: stop collecting once this many rows are waiting.
+    // maxDelayMicros: how long the first request in a batch can wait for others to show up.
+    ModelServer(std::vector<HyperCircleModel> models, size_t maxBatchRows = 8192, int maxDelayMicros = 200);
+
+    // memory maps a saved model file and builds a model from it. throws runtime_error.
+    static HyperCircleModel mapModel(const std::string &fileName);
+
+    // listens on socketPath until stop() is called. replaces any stale socket file at that path.
+    void serve(const std::string &socketPath);
+
+    // can be called from any thread, or a signal handler
+    void stop() {
+        stopping = true;
+    }
+
+    // how many requests and rows we have classified
+    size_t requestsServed() const { return requests; }
+    size_t rowsServed() const { return rows; }
+    size_t batchesRun() const { return batches; }
+
+private:
+
+    // one request, from the time its connection reads it until the batcher fills in the answer
+    struct Pending {
+        ServeProtocol::RequestHeader header;
+        std::vector<float> rows;
+        std::vector<int> labels;
+        std::vector<float> scores;
+        bool done = false;
+    };
+
+    std::vector<HyperCircleModel> models;
+    size_t maxBatchRows;
+    int maxDelayMicros;
+
+    std::atomic<bool> stopping {false};
+    std::atomic<size_t> requests {0};
+    std::atomic<size_t> rows {0};
+    std::atomic<size_t> batches {0};
+
+    // requests waiting on the batcher
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::condition_variable answered;
+    std::deque<Pending *> queue;
+    size_t queuedRows = 0;
+
+    // open connections, so stop() can kick them out of their reads
+    std::mutex connectionLock;
+    std::set<int> connections;
+    std::condition_variable allClosed;
+    std::atomic<size_t> openConnections {0};
+
+    void handleConnection(int fd);
+
+    // checks a request against our models. returns a ServeProtocol status.
+    int validate(const ServeProtocol::RequestHeader &header, uint32_t length) const;
+
+    void batchLoop();
+
+    // classifies a group of requests which all use the same model and settings
+    void runBatch(std::vector<Pending *> &group);
+
+    static bool sameSettings(const ServeProtocol::RequestHeader &a, const ServeProtocol::RequestHeader &b);
+};
+
+#endif //MODELSERVER_H
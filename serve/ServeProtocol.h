@@ -0,0 +1,157 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef SERVEPROTOCOL_H
+#define SERVEPROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// macs don't have this. the server ignores SIGPIPE there instead.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// the wire format the server, client and load generator share. everything is in host byte order, since it only ever
+// goes over a unix socket on one machine.
+//
+// every message is a uint32 length, then that many bytes.
+//   request:  RequestHeader, then numRows * numAttributes floats, back to back.
+//   response: ResponseHeader, then numRows int32 labels, then if WANT_SCORES was set numRows * numClasses float votes.
+class ServeProtocol {
+public:
+
+    static constexpr uint32_t REQUEST_MAGIC = 0x31514348;  // "HCQ1"
+    static constexpr uint32_t RESPONSE_MAGIC = 0x31524348; // "HCR1"
+
+    // biggest message we will take. stops a bad length from making us allocate the whole machine.
+    static constexpr uint32_t MAX_MESSAGE = 256u << 20;
+
+    // request flags
+    enum {
+        WANT_SCORES = 1
+    };
+
+    // response status
+    enum {
+        OK = 0,
+        BAD_REQUEST = -1,
+        UNKNOWN_MODEL = -2,
+        WRONG_WIDTH = -3,
+        SHUTTING_DOWN = -4
+    };
+
+    struct RequestHeader {
+        uint32_t magic;
+        uint32_t model;         // index of the model, in the order the server loaded them
+        uint32_t numRows;
+        uint32_t numAttributes; // has to match the model
+        uint32_t flags;
+        int32_t vote;           // HyperCircle::SIMPLE_MAJORITY ... SMALLEST_CIRCLE
+        int32_t fallback;       // HyperCircle::USE_CIRCLES (none), K_NEAREST_CIRCLES or K_NEAREST_RATIOS
+        int32_t k;
+    };
+
+    struct ResponseHeader {
+        uint32_t magic;
+        int32_t status;
+        uint32_t numRows;
+        uint32_t numClasses;    // 0 unless scores follow the labels
+    };
+
+    // read and write exactly size bytes, retrying short reads. false if the other side went away.
+    static bool readFully(int fd, void *buffer, size_t size) {
+        char *at = static_cast<char *>(buffer);
+        while (size > 0) {
+            ssize_t got = ::read(fd, at, size);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                return false;
+            at += got;
+            size -= got;
+        }
+        return true;
+    }
+
+    static bool writeFully(int fd, const void *buffer, size_t size) {
+        const char *at = static_cast<const char *>(buffer);
+        while (size > 0) {
+            ssize_t put = ::send(fd, at, size, MSG_NOSIGNAL);
+            if (put < 0 && errno == EINTR)
+                continue;
+            if (put <= 0)
+                return false;
+            at += put;
+            size -= put;
+        }
+        return true;
+    }
+
+    static bool fillAddress(const std::string &path, sockaddr_un &address) {
+        if (path.size() >= sizeof(address.sun_path))
+            return false;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    // connects to a server. -1 if we can't.
+    static int connectTo(const std::string &path) {
+        sockaddr_un address;
+        if (!fillAddress(path, address))
+            return -1;
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // most rows of numAttributes floats one request can carry and still fit in MAX_MESSAGE
+    static size_t maxRowsPerRequest(uint32_t numAttributes) {
+        return (MAX_MESSAGE - sizeof(RequestHeader)) / sizeof(float) / std::max<uint32_t>(numAttributes, 1);
+    }
+
+    // sends one request. rows is numRows * numAttributes floats. false without sending anything if it wouldn't fit in
+    // MAX_MESSAGE, since the server would only hang up on it. callers with more rows than that send them in batches.
+    static bool sendRequest(int fd, const RequestHeader &header, const float *rows) {
+        if (header.numRows > maxRowsPerRequest(header.numAttributes))
+            return false;
+        const size_t payload = (size_t) header.numRows * header.numAttributes * sizeof(float);
+        const uint32_t length = (uint32_t) (sizeof(header) + payload);
+        return writeFully(fd, &length, sizeof(length)) && writeFully(fd, &header, sizeof(header)) && writeFully(fd, rows, payload);
+    }
+
+    // reads one response into labels (and scores, if the server sent any). false if the connection broke, otherwise
+    // check response.status.
+    static bool receiveResponse(int fd, ResponseHeader &response, std::vector<int32_t> &labels, std::vector<float> &scores) {
+        uint32_t length;
+        if (!readFully(fd, &length, sizeof(length)) || length < sizeof(response) || length > MAX_MESSAGE)
+            return false;
+        if (!readFully(fd, &response, sizeof(response)) || response.magic != RESPONSE_MAGIC)
+            return false;
+
+        labels.resize(response.status == OK ? response.numRows : 0);
+        scores.resize(response.status == OK ? (size_t) response.numRows * response.numClasses : 0);
+        if (length != sizeof(response) + labels.size() * sizeof(int32_t) + scores.size() * sizeof(float))
+            return false;
+        return readFully(fd, labels.data(), labels.size() * sizeof(int32_t)) && readFully(fd, scores.data(), scores.size() * sizeof(float));
+    }
+};
+
+#endif //SERVEPROTOCOL_H
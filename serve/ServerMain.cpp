@@ -0,0 +1,109 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include "ModelServer.h"
+#include "Parallelism.h"
+#include "Numa.h"
+
+using namespace std;
+
+// the server we stop when we get ctrl c'd
+static ModelServer *running = nullptr;
+
+static void handleSignal(int) {
+    if (running)
+        running->stop();
+}
+
+static void usage() {
+    cerr << "usage: HyperCircleServer <socket path> <model file>... [--batch-rows N] [--delay-us N] [--precision fp32|fp16|int8] [--pivots N]" << endl;
+    cerr << "                         [--replicate] [--pin] [--simulate-nodes N]" << endl;
+    cerr << "models are numbered in the order they are given, starting at 0." << endl;
+    cerr << "--replicate keeps a copy of every model's centers on each memory node, --pin keeps each thread on one node." << endl;
+}
+
+int main(int argc, char **argv) {
+
+    string socketPath;
+    vector<string> modelFiles;
+    size_t maxBatchRows = 8192;
+    int maxDelayMicros = 200;
+    int precision = HyperCircleModel::FP32;
+    int numPivots = 0;
+    bool pin = false;
+    Numa::Config numa;
+
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--batch-rows" && a + 1 < argc)
+            maxBatchRows = stoul(argv[++a]);
+        else if (arg == "--delay-us" && a + 1 < argc)
+            maxDelayMicros = stoi(argv[++a]);
+        else if (arg == "--precision" && a + 1 < argc) {
+            string name = argv[++a];
+            if (name == "fp16")
+                precision = HyperCircleModel::FP16;
+            else if (name == "int8")
+                precision = HyperCircleModel::INT8;
+            else if (name != "fp32") {
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--pivots" && a + 1 < argc)
+            numPivots = stoi(argv[++a]);
+        else if (arg == "--replicate")
+            numa.replicate = true;
+        else if (arg == "--pin")
+            pin = true;
+        else if (arg == "--simulate-nodes" && a + 1 < argc)
+            numa.simulatedNodes = stoi(argv[++a]);
+        else if (socketPath.empty())
+            socketPath = arg;
+        else
+            modelFiles.push_back(arg);
+    }
+
+    if (socketPath.empty() || modelFiles.empty()) {
+        usage();
+        return 1;
+    }
+
+    Parallelism::calibrate();
+    if (pin)
+        cout << "pinned " << Numa::pinThreads(numa.simulatedNodes) << " threads over " << Numa::topology(numa.simulatedNodes)->size() << " memory node(s)" << endl;
+
+    vector<HyperCircleModel> models;
+    for (int m = 0; m < modelFiles.size(); ++m) {
+        try {
+            models.push_back(ModelServer::mapModel(modelFiles[m]));
+            models.back().setPrecision(precision);
+            models.back().buildPivots(numPivots);
+            models.back().replicateCenters(numa);
+        } catch (const exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        cout << "model " << m << ": " << modelFiles[m] << "\t" << models.back().size() << " circles, "
+             << models.back().numAttributes << " attributes, " << models.back().numClasses << " classes" << endl;
+    }
+
+    ModelServer server(std::move(models), maxBatchRows, maxDelayMicros);
+    running = &server;
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    cout << "listening on " << socketPath << endl;
+    try {
+        server.serve(socketPath);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    cout << "served " << server.requestsServed() << " requests, " << server.rowsServed() << " rows in "
+         << server.batchesRun() << " batches." << endl;
+    return 0;
+}
@@ -0,0 +1,243 @@
+#include "ShardCoordinator.h"
+#include "NeighborGraph.h"
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <csignal>
+using namespace std;
+
+ShardCoordinator::ShardCoordinator(const vector<string> &workerSockets, double timeoutSeconds) {
+    signal(SIGPIPE, SIG_IGN);
+
+    // workers we just started might not be listening yet, so keep trying for a bit
+    const auto giveUp = chrono::steady_clock::now() + chrono::duration<double>(timeoutSeconds);
+    for (const string &path : workerSockets) {
+        int fd = ServeProtocol::connectTo(path);
+        while (fd < 0 && chrono::steady_clock::now() < giveUp) {
+            this_thread::sleep_for(chrono::milliseconds(20));
+            fd = ServeProtocol::connectTo(path);
+        }
+        if (fd < 0) {
+            for (int worker : workers)
+                ::close(worker);
+            throw runtime_error("Failed to reach shard worker at " + path);
+        }
+        workers.push_back(fd);
+    }
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    for (int fd : workers) {
+        ShardProtocol::send(fd, ShardProtocol::QUIT);
+        ::close(fd);
+    }
+}
+
+void ShardCoordinator::forEachWorker(const function<void(int)> &job) {
+    mutex lock;
+    string failure;
+
+    vector<thread> threads;
+    for (int w = 0; w < workers.size(); ++w) {
+        threads.emplace_back([&, w]() {
+            try {
+                job(w);
+            } catch (const exception &e) {
+                lock_guard<mutex> guard(lock);
+                if (failure.empty())
+                    failure = e.what();
+            }
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+
+    if (!failure.empty())
+        throw runtime_error(failure);
+}
+
+vector<char> ShardCoordinator::request(int fd, uint32_t type, const ShardProtocol::Writer &payload) {
+    post(fd, type, payload);
+    uint32_t replyType;
+    vector<char> reply;
+    if (!ShardProtocol::receive(fd, replyType, reply))
+        throw runtime_error("Lost a shard worker");
+    if (replyType != ShardProtocol::REPLY)
+        throw runtime_error("A shard worker couldn't make sense of what we sent it");
+    return reply;
+}
+
+void ShardCoordinator::post(int fd, uint32_t type, const ShardProtocol::Writer &payload) {
+    if (!ShardProtocol::send(fd, type, payload))
+        throw runtime_error("Lost a shard worker");
+}
+
+vector<HyperCircle> ShardCoordinator::generate(Dataset &dataSet) {
+
+    if (workers.empty())
+        throw runtime_error("Sharded generation needs at least one worker");
+
+    // the same collapsed rows generateHyperCircles works on
+    int conflicts = 0;
+    Dataset unique = dataSet.collapsed(&conflicts);
+    if (unique.size() < dataSet.size())
+        cout << "Collapsed " << dataSet.size() - unique.size() << " duplicate rows." << endl;
+    if (conflicts > 0)
+        cout << conflicts << " rows show up with more than one class. No circle can cover those." << endl;
+
+    const size_t n = unique.size();
+    const int width = unique.numAttributes;
+    const int numShards = numWorkers();
+
+    // the rows back to back, so a shard or a block is one slice
+    vector<float> rows(n * width);
+    vector<int32_t> labels(n), weights(n);
+    for (size_t r = 0; r < n; ++r) {
+        copy(unique[r].location, unique[r].location + width, rows.begin() + r * width);
+        labels[r] = unique[r].classification;
+        weights[r] = unique[r].weight;
+    }
+
+    // shard w is rows [shardStart[w], shardStart[w + 1])
+    vector<size_t> shardStart(numShards + 1);
+    for (int w = 0; w <= numShards; ++w)
+        shardStart[w] = n * w / numShards;
+
+    // every worker gets its shard, and searches its rows against each of the other shards as they stream past
+    vector<float> radii(n), enemies(n);
+    forEachWorker([&](int w) {
+        const size_t first = shardStart[w], count = shardStart[w + 1] - first;
+
+        ShardProtocol::Writer load;
+        load.put((int32_t) width);
+        load.put((uint64_t) count);
+        load.put(rows.data() + first * width, count * width);
+        load.put(labels.data() + first, count);
+        load.put(weights.data() + first, count);
+        request(workers[w], ShardProtocol::LOAD, load);
+
+        post(workers[w], ShardProtocol::NEAREST_BEGIN, ShardProtocol::Writer());
+        for (int other = 0; other < numShards; ++other) {
+            if (other == w)
+                continue;
+            for (size_t start = shardStart[other]; start < shardStart[other + 1]; start += BLOCK_ROWS) {
+                const size_t blockRows = min(BLOCK_ROWS, shardStart[other + 1] - start);
+                ShardProtocol::Writer block;
+                block.put((uint64_t) blockRows);
+                block.put(rows.data() + start * width, blockRows * width);
+                block.put(labels.data() + start, blockRows);
+                post(workers[w], ShardProtocol::NEAREST_BLOCK, block);
+            }
+        }
+
+        const vector<char> found = request(workers[w], ShardProtocol::NEAREST_END, ShardProtocol::Writer());
+        ShardProtocol::Reader reply(found);
+        reply.get(radii.data() + first, count);
+        reply.get(enemies.data() + first, count);
+        if (!reply.done())
+            throw runtime_error("A shard worker sent back the wrong amount of radii");
+    });
+
+    // the circles are the rows with a radius, in row order, same as createCircles leaves them
+    vector<HyperCircle> circles;
+    vector<int> firstCircle(numShards + 1, 0);
+    for (int w = 0; w < numShards; ++w) {
+        firstCircle[w] = (int) circles.size();
+        for (size_t r = shardStart[w]; r < shardStart[w + 1]; ++r) {
+            if (radii[r] > 0.0f) {
+                circles.emplace_back(radii[r], unique[r].location, unique[r].classification);
+                circles.back().nearestEnemy = enemies[r];
+            }
+        }
+    }
+    firstCircle[numShards] = (int) circles.size();
+    cout << "Circles created...\nBeginning Merging." << endl;
+
+    // each worker finds its circles' cheapest later circles. only circles in later shards can be later circles.
+    vector<vector<NeighborGraph::Neighbor>> lists(circles.size());
+    forEachWorker([&](int w) {
+        ShardProtocol::Writer begin;
+        begin.put((int32_t) HyperCircle::MERGE_NEIGHBORS);
+        begin.put((int32_t) firstCircle[w]);
+        post(workers[w], ShardProtocol::GRAPH_BEGIN, begin);
+
+        for (int start = firstCircle[w + 1]; start < firstCircle[numShards]; start += (int) BLOCK_ROWS) {
+            const int blockCircles = min((int) BLOCK_ROWS, firstCircle[numShards] - start);
+            ShardProtocol::Writer block;
+            block.put((uint64_t) blockCircles);
+            for (int c = start; c < start + blockCircles; ++c)
+                block.put((int32_t) c);
+            for (int c = start; c < start + blockCircles; ++c)
+                block.put((int32_t) circles[c].classification);
+            for (int c = start; c < start + blockCircles; ++c)
+                block.put(circles[c].radius);
+            for (int c = start; c < start + blockCircles; ++c)
+                block.put(circles[c].centerPoint, width);
+            post(workers[w], ShardProtocol::GRAPH_BLOCK, block);
+        }
+
+        const vector<char> found = request(workers[w], ShardProtocol::GRAPH_END, ShardProtocol::Writer());
+        ShardProtocol::Reader reply(found);
+        for (int c = firstCircle[w]; c < firstCircle[w + 1]; ++c) {
+            const int length = reply.get<int32_t>();
+            if (length < 0 || length > HyperCircle::MERGE_NEIGHBORS)
+                throw runtime_error("A shard worker sent back a bad neighbor list");
+            for (int i = 0; i < length; ++i) {
+                const float cost = reply.get<float>();
+                lists[c].push_back({cost, reply.get<int32_t>()});
+            }
+        }
+        if (!reply.done())
+            throw runtime_error("A shard worker sent back the wrong amount of neighbor lists");
+    });
+
+    // the merge goes one circle after another, so it happens here. the nearest enemies let it skip the scans over
+    // the data, except when a circle would grow to right about its nearest enemy.
+    const NeighborGraph graph = NeighborGraph::fromLists(lists, HyperCircle::MERGE_NEIGHBORS);
+    HyperCircle::mergeCircles(circles, unique, graph);
+    cout << "Circles merged...\nRemoving Circles" << endl;
+
+    HyperCircle::pruneDominatedCircles(circles, unique);
+
+    // every worker counts its points in each circle, and which circle is each point's best. both just add up.
+    ShardProtocol::Writer finished;
+    finished.put((uint64_t) circles.size());
+    for (const HyperCircle &c : circles)
+        finished.put((int32_t) c.classification);
+    for (const HyperCircle &c : circles)
+        finished.put(c.radius);
+    for (const HyperCircle &c : circles)
+        finished.put(c.centerPoint, width);
+
+    vector<int> counts(circles.size(), 0), best(circles.size(), 0);
+    mutex lock;
+    forEachWorker([&](int w) {
+        const vector<char> found = request(workers[w], ShardProtocol::COVER, finished);
+        ShardProtocol::Reader reply(found);
+        vector<int32_t> shardCounts, shardBest;
+        reply.get(shardCounts, circles.size());
+        reply.get(shardBest, circles.size());
+        if (!reply.done())
+            throw runtime_error("A shard worker sent back the wrong amount of counts");
+
+        lock_guard<mutex> guard(lock);
+        for (size_t c = 0; c < circles.size(); ++c) {
+            counts[c] += shardCounts[c];
+            best[c] += shardBest[c];
+        }
+    });
+
+    // same as removeUselessCircles: keep the circles which are some point's best
+    vector<HyperCircle> kept;
+    for (size_t c = 0; c < circles.size(); ++c) {
+        circles[c].numPoints = counts[c];
+        if (best[c] != 0)
+            kept.push_back(circles[c]);
+    }
+
+    cout << "Useless Circles Removed...\nWe generated:\t" << kept.size() << " circles." << endl;
+    return kept;
+}
@@ -0,0 +1,59 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef SHARDCOORDINATOR_H
+#define SHARDCOORDINATOR_H
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "Dataset.h"
+#include "HyperCircle.h"
+#include "ShardProtocol.h"
+
+// runs generateHyperCircles with the training rows split across worker processes (see ShardWorker). each worker gets
+// a contiguous shard of the collapsed rows, and the other shards stream past it a block at a time, so every O(n^2) part
+// happens on the workers: the nearest neighbor radii, each circle's nearest enemy, the merge graph, and the point counts
+// for the end. we only do what has to happen in order: the merge itself (which with every nearest enemy known hardly
+// ever has to look at the data), and dropping dominated circles.
+// the circles come out exactly the same as generateHyperCircles on one machine, bit for bit: every distance is worked
+// out by the same function, and none of the answers depend on which order the rows come in.
+class ShardCoordinator {
+public:
+
+    // rows per block we stream to a worker
+    static constexpr size_t BLOCK_ROWS = 8192;
+
+    // connects to a worker at each socket path, waiting up to timeoutSeconds for them to start listening. throws if
+    // one never does.
+    explicit ShardCoordinator(const std::vector<std::string> &workerSockets, double timeoutSeconds = 10.0);
+
+    // tells the workers we're done
+    ~ShardCoordinator();
+
+    ShardCoordinator(const ShardCoordinator &) = delete;
+    ShardCoordinator &operator=(const ShardCoordinator &) = delete;
+
+    int numWorkers() const { return (int) workers.size(); }
+
+    // generateHyperCircles(dataSet), spread over the workers. the circles point into dataSet's rows. throws if a
+    // worker goes away partway.
+    std::vector<HyperCircle> generate(Dataset &dataSet);
+
+private:
+
+    std::vector<int> workers;
+
+    // runs job(worker) for every worker at once, one thread each, and throws the first failure once they're all done
+    void forEachWorker(const std::function<void(int)> &job);
+
+    // sends a message which gets a reply, and returns the reply. throws if the worker failed or went away.
+    static std::vector<char> request(int fd, uint32_t type, const ShardProtocol::Writer &payload);
+
+    // sends a message which doesn't get a reply. throws if the worker went away.
+    static void post(int fd, uint32_t type, const ShardProtocol::Writer &payload);
+};
+
+#endif //SHARDCOORDINATOR_H
@@ -0,0 +1,178 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <bit>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ShardCoordinator.h"
+#include "ShardWorker.h"
+#include "HyperCircleModel.h"
+#include "Parallelism.h"
+
+using namespace std;
+
+static void usage() {
+    cerr << "usage: HyperCircleShard worker <socket path> [--once]" << endl;
+    cerr << "       HyperCircleShard generate <training file> (<worker socket>... | --spawn N) [--save model file] [--verify]" << endl;
+    cerr << "--spawn starts N workers on this machine. --verify checks the circles against generating them in one process." << endl;
+}
+
+static int runWorker(int argc, char **argv) {
+    string socketPath;
+    bool once = false;
+    for (int a = 2; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--once")
+            once = true;
+        else if (socketPath.empty())
+            socketPath = arg;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (socketPath.empty()) {
+        usage();
+        return 1;
+    }
+
+    Parallelism::calibrate();
+    try {
+        int listener = ShardWorker::listenOn(socketPath);
+        cout << "shard worker listening on " << socketPath << endl;
+        ShardWorker::run(listener, once);
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// same circles, bit for bit, in the same order
+static bool sameCircles(const vector<HyperCircle> &sharded, const vector<HyperCircle> &single) {
+    if (sharded.size() != single.size()) {
+        cerr << "sharded run made " << sharded.size() << " circles, one process made " << single.size() << endl;
+        return false;
+    }
+    for (size_t c = 0; c < single.size(); ++c) {
+        const HyperCircle &a = sharded[c], &b = single[c];
+        if (a.centerPoint != b.centerPoint || bit_cast<uint32_t>(a.radius) != bit_cast<uint32_t>(b.radius)
+            || a.classification != b.classification || a.numPoints != b.numPoints) {
+            cerr << "circle " << c << " differs: radius " << a.radius << " vs " << b.radius << ", "
+                 << a.numPoints << " vs " << b.numPoints << " points" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static int runGenerate(int argc, char **argv) {
+    string trainingFile, modelFile;
+    vector<string> sockets;
+    int spawn = 0;
+    bool verify = false;
+
+    for (int a = 2; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--spawn" && a + 1 < argc)
+            spawn = stoi(argv[++a]);
+        else if (arg == "--save" && a + 1 < argc)
+            modelFile = argv[++a];
+        else if (arg == "--verify")
+            verify = true;
+        else if (trainingFile.empty())
+            trainingFile = arg;
+        else
+            sockets.push_back(arg);
+    }
+    if (trainingFile.empty() || (spawn <= 0) == sockets.empty()) {
+        usage();
+        return 1;
+    }
+
+    // the workers get forked before we start any threads of our own, OpenMP's included
+    vector<pid_t> children;
+    if (spawn > 0) {
+        const string prefix = "/tmp/hcshard-" + to_string(getpid()) + "-";
+        for (int w = 0; w < spawn; ++w) {
+            sockets.push_back(prefix + to_string(w));
+            int listener;
+            try {
+                listener = ShardWorker::listenOn(sockets.back());
+            } catch (const exception &e) {
+                cerr << e.what() << endl;
+                return 1;
+            }
+
+            const pid_t child = fork();
+            if (child == 0) {
+                Parallelism::calibrate();
+                ShardWorker::run(listener, true);
+                _exit(0);
+            }
+            ::close(listener);
+            if (child < 0) {
+                cerr << "Failed to start a shard worker" << endl;
+                return 1;
+            }
+            children.push_back(child);
+        }
+    }
+
+    Parallelism::calibrate();
+
+    int status = 0;
+    try {
+        Dataset trainData = Dataset::readFile(trainingFile);
+        if (trainData.empty())
+            throw runtime_error("Failed to read " + trainingFile);
+
+        vector<HyperCircle> circles;
+        double shardedSeconds;
+        {
+            ShardCoordinator coordinator(sockets);
+            const auto start = chrono::steady_clock::now();
+            circles = coordinator.generate(trainData);
+            shardedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        cout << "sharded over " << sockets.size() << " workers in " << shardedSeconds << " seconds." << endl;
+
+        if (verify) {
+            const auto start = chrono::steady_clock::now();
+            vector<HyperCircle> single = HyperCircle::generateHyperCircles(trainData);
+            cout << "one process took " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " seconds." << endl;
+            if (sameCircles(circles, single))
+                cout << "circles match." << endl;
+            else
+                status = 1;
+        }
+
+        if (!modelFile.empty()) {
+            HyperCircleModel(circles, trainData.numAttributes, trainData.numClasses(), trainData.classes->labels()).save(modelFile);
+            cout << "saved " << modelFile << endl;
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        status = 1;
+    }
+
+    for (pid_t child : children)
+        waitpid(child, nullptr, 0);
+    for (int w = 0; w < spawn; ++w)
+        ::unlink(sockets[w].c_str());
+    return status;
+}
+
+int main(int argc, char **argv) {
+    const string mode = argc > 1 ? argv[1] : "";
+    if (mode == "worker")
+        return runWorker(argc, argv);
+    if (mode == "generate")
+        return runGenerate(argc, argv);
+    usage();
+    return 1;
+}
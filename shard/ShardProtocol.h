@@ -0,0 +1,148 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef SHARDPROTOCOL_H
+#define SHARDPROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "serve/ServeProtocol.h"
+
+// what the coordinator of a sharded generation run and its workers say to each other. same idea as ServeProtocol (whose
+// socket helpers we borrow): host byte order over unix sockets on one machine.
+//
+// every message is a Header, then header.bytes of payload. the coordinator sends, and the worker only answers the
+// messages ending in _END, COVER and LOAD (with a REPLY). a run goes:
+//   LOAD           numAttributes, numRows, then the worker's rows (floats), labels and weights (int32s)
+//   NEAREST_BEGIN  worker searches its rows against each other
+//   NEAREST_BLOCK  numRows, then rows and labels of another shard, searched against ours. as many as it takes.
+//   NEAREST_END    reply: a radius and a nearest enemy distance (floats) for each of our rows
+//   GRAPH_BEGIN    k, and the id our first circle has in the whole list. our circles' lists against each other.
+//   GRAPH_BLOCK    numCircles, then their ids, labels, radii (int32, int32, float) and centers, from a later shard
+//   GRAPH_END      reply: for each of our circles, how long its list is (int32), then its (cost, id) pairs
+//   COVER          numCircles, then labels, radii and centers of the finished circles.
+//                  reply: how many of our points are in each (int32), then how many have it as their best circle
+//   QUIT
+class ShardProtocol {
+public:
+
+    static constexpr uint32_t MAGIC = 0x31534348; // "HCS1"
+
+    // biggest payload we will take. a shard of a big dataset is big, but this still stops a bad length from asking
+    // for the whole machine.
+    static constexpr uint64_t MAX_MESSAGE = (uint64_t) 64 << 30;
+
+    enum : uint32_t {
+        LOAD = 1,
+        NEAREST_BEGIN = 2,
+        NEAREST_BLOCK = 3,
+        NEAREST_END = 4,
+        GRAPH_BEGIN = 5,
+        GRAPH_BLOCK = 6,
+        GRAPH_END = 7,
+        COVER = 8,
+        QUIT = 9,
+        REPLY = 10,
+        FAILED = 11  // the worker couldn't make sense of a message
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t type;
+        uint64_t bytes;
+    };
+
+    // builds up a payload
+    class Writer {
+    public:
+        std::vector<char> bytes;
+
+        template <typename T>
+        void put(const T &value) {
+            put(&value, 1);
+        }
+
+        template <typename T>
+        void put(const T *values, size_t count) {
+            const size_t at = bytes.size();
+            bytes.resize(at + count * sizeof(T));
+            if (count > 0)
+                memcpy(bytes.data() + at, values, count * sizeof(T));
+        }
+    };
+
+    // reads a payload back in the order it was written. once anything runs past the end, ok goes false, and everything
+    // after reads as zeros.
+    class Reader {
+    public:
+        explicit Reader(const std::vector<char> &bytes) : at(bytes.data()), end(bytes.data() + bytes.size()) {}
+
+        // we only point into the payload, so it has to outlive us
+        explicit Reader(std::vector<char> &&) = delete;
+
+        bool ok = true;
+
+        template <typename T>
+        T get() {
+            T value {};
+            get(&value, 1);
+            return value;
+        }
+
+        template <typename T>
+        void get(T *values, size_t count) {
+            const size_t size = count * sizeof(T);
+            if (!ok || (size_t) (end - at) < size) {
+                ok = false;
+                memset(static_cast<void *>(values), 0, size);
+                return;
+            }
+            if (size > 0)
+                memcpy(static_cast<void *>(values), at, size);
+            at += size;
+        }
+
+        // count values into a vector, resizing it. copied, since the payload doesn't keep them aligned.
+        template <typename T>
+        void get(std::vector<T> &values, size_t count) {
+            if ((size_t) (end - at) / sizeof(T) < count) {
+                ok = false;
+                values.clear();
+                return;
+            }
+            values.resize(count);
+            get(values.data(), count);
+        }
+
+        bool done() const { return ok && at == end; }
+
+    private:
+        const char *at;
+        const char *end;
+    };
+
+    static bool send(int fd, uint32_t type, const Writer &payload) {
+        const Header header {MAGIC, type, payload.bytes.size()};
+        return ServeProtocol::writeFully(fd, &header, sizeof(header)) && ServeProtocol::writeFully(fd, payload.bytes.data(), payload.bytes.size());
+    }
+
+    static bool send(int fd, uint32_t type) {
+        return send(fd, type, Writer());
+    }
+
+    // false if the connection broke or the header was bad
+    static bool receive(int fd, uint32_t &type, std::vector<char> &payload) {
+        Header header;
+        if (!ServeProtocol::readFully(fd, &header, sizeof(header)) || header.magic != MAGIC || header.bytes > MAX_MESSAGE)
+            return false;
+        type = header.type;
+        payload.resize(header.bytes);
+        return ServeProtocol::readFully(fd, payload.data(), payload.size());
+    }
+};
+
+#endif //SHARDPROTOCOL_H
@@ -0,0 +1,278 @@
+#include "ShardWorker.h"
+#include "ShardProtocol.h"
+#include "NeighborGraph.h"
+#include "Parallelism.h"
+#include "TopK.h"
+#include <iostream>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+#include <csignal>
+using namespace std;
+
+int ShardWorker::listenOn(const string &path) {
+    sockaddr_un address;
+    if (!ServeProtocol::fillAddress(path, address))
+        throw runtime_error("Socket path is too long: " + path);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw runtime_error("Failed to make a socket");
+
+    // a worker that died without cleaning up leaves its socket file behind
+    ::unlink(path.c_str());
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listener, 4) < 0) {
+        ::close(listener);
+        throw runtime_error("Failed to listen on " + path);
+    }
+    return listener;
+}
+
+void ShardWorker::run(int listener, bool once) {
+    signal(SIGPIPE, SIG_IGN);
+    while (true) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+
+        // a fresh worker for every coordinator, so nothing from the last run hangs around
+        ShardWorker worker;
+        if (!worker.serve(fd))
+            cerr << "shard worker: lost the coordinator" << endl;
+        ::close(fd);
+
+        if (once)
+            return;
+    }
+}
+
+bool ShardWorker::serve(int fd) {
+    vector<char> payload;
+    uint32_t type;
+    while (ShardProtocol::receive(fd, type, payload)) {
+        vector<char> reply;
+        bool ok = true;
+        bool replies = false;
+
+        switch (type) {
+            case ShardProtocol::LOAD:
+                ok = load(payload);
+                replies = true;
+                break;
+            case ShardProtocol::NEAREST_BEGIN:
+                beginNearest();
+                break;
+            case ShardProtocol::NEAREST_BLOCK:
+                ok = nearestBlock(payload);
+                break;
+            case ShardProtocol::NEAREST_END:
+                endNearest(reply);
+                replies = true;
+                break;
+            case ShardProtocol::GRAPH_BEGIN:
+                ok = beginGraph(payload);
+                break;
+            case ShardProtocol::GRAPH_BLOCK:
+                ok = graphBlock(payload);
+                break;
+            case ShardProtocol::GRAPH_END:
+                endGraph(reply);
+                replies = true;
+                break;
+            case ShardProtocol::COVER:
+                ok = cover(payload, reply);
+                replies = true;
+                break;
+            case ShardProtocol::QUIT:
+                return true;
+            default:
+                ok = false;
+                break;
+        }
+
+        // the coordinator only waits on the messages which get a reply, so a bad message in between shows up at the
+        // next one that does. either way we hang up, since we can't be in step with it anymore.
+        if (!ok) {
+            ShardProtocol::send(fd, ShardProtocol::FAILED);
+            return false;
+        }
+        if (replies) {
+            ShardProtocol::Writer writer;
+            writer.bytes = std::move(reply);
+            if (!ShardProtocol::send(fd, ShardProtocol::REPLY, writer))
+                return false;
+        }
+    }
+    return false;
+}
+
+Dataset ShardWorker::datasetOf(const float *blockRows, const int32_t *blockLabels, const int32_t *blockWeights, size_t numRows) const {
+    Dataset block;
+    block.numAttributes = numAttributes;
+    block.points.reserve(numRows);
+    for (size_t r = 0; r < numRows; ++r)
+        block.push_back(Point(const_cast<float *>(blockRows) + r * numAttributes, blockLabels[r], blockWeights ? blockWeights[r] : 1));
+    return block;
+}
+
+bool ShardWorker::load(const vector<char> &payload) {
+    ShardProtocol::Reader reader(payload);
+    numAttributes = reader.get<int32_t>();
+    const uint64_t numRows = reader.get<uint64_t>();
+    if (!reader.ok || numAttributes <= 0)
+        return false;
+    reader.get(rows, numRows * numAttributes);
+    reader.get(labels, numRows);
+    reader.get(weights, numRows);
+    if (!reader.done())
+        return false;
+
+    shard = datasetOf(rows.data(), labels.data(), weights.data(), numRows);
+    return true;
+}
+
+void ShardWorker::beginNearest() {
+    centers.clear();
+    for (const Point &p : shard)
+        centers.emplace_back(0.0f, p.location, p.classification);
+    minDist.assign(centers.size(), numeric_limits<float>::max());
+    minClass.assign(centers.size(), -1);
+
+    // our own rows first. a center skips its own row, since it's the same pointer.
+    nearestBlock({});
+}
+
+bool ShardWorker::nearestBlock(const vector<char> &payload) {
+    // an empty payload means our own shard
+    vector<float> blockRows;
+    vector<int32_t> blockLabels;
+    Dataset block;
+    if (payload.empty()) {
+        block = shard;
+    } else {
+        ShardProtocol::Reader reader(payload);
+        const uint64_t numRows = reader.get<uint64_t>();
+        reader.get(blockRows, numRows * numAttributes);
+        reader.get(blockLabels, numRows);
+        if (!reader.done())
+            return false;
+        block = datasetOf(blockRows.data(), blockLabels.data(), nullptr, numRows);
+    }
+
+    // every center carries its searches on over the block. the same functions generateHyperCircles uses, so the
+    // distances (and the radii) come out exactly the same.
+    #pragma omp parallel for schedule(dynamic, 16) if(Parallelism::choose(centers.size(), block.size(), numAttributes) != Parallelism::SERIAL)
+    for (long long c = 0; c < (long long) centers.size(); ++c) {
+        centers[c].findNearestNeighbor(block, minDist[c], minClass[c]);
+        centers[c].findNearestEnemy(block);
+    }
+    return true;
+}
+
+void ShardWorker::endNearest(vector<char> &reply) {
+    ShardProtocol::Writer writer;
+    for (size_t c = 0; c < centers.size(); ++c) {
+        centers[c].radius = minClass[c] == centers[c].classification ? minDist[c] : 0.0f;
+        writer.put(centers[c].radius);
+    }
+    for (const HyperCircle &c : centers)
+        writer.put(c.nearestEnemy);
+    reply = std::move(writer.bytes);
+}
+
+bool ShardWorker::beginGraph(const vector<char> &payload) {
+    ShardProtocol::Reader reader(payload);
+    k = reader.get<int32_t>();
+    const int32_t firstCircle = reader.get<int32_t>();
+    if (!reader.done() || k <= 0)
+        return false;
+
+    // our circles, numbered in row order from where the coordinator says ours start
+    circles.clear();
+    circleIds.clear();
+    for (const HyperCircle &c : centers) {
+        if (c.radius > 0.0f) {
+            circleIds.push_back(firstCircle + (int) circleIds.size());
+            circles.push_back(c);
+        }
+    }
+    cheapest.assign(circles.size(), {});
+    return graphBlock({});
+}
+
+bool ShardWorker::graphBlock(const vector<char> &payload) {
+    // an empty payload means our own circles
+    vector<HyperCircle> blockCircles;
+    vector<int32_t> blockIds, blockLabels;
+    vector<float> blockRadii, blockCenters;
+    if (payload.empty()) {
+        blockCircles = circles;
+        blockIds = circleIds;
+    } else {
+        ShardProtocol::Reader reader(payload);
+        const uint64_t numCircles = reader.get<uint64_t>();
+        reader.get(blockIds, numCircles);
+        reader.get(blockLabels, numCircles);
+        reader.get(blockRadii, numCircles);
+        reader.get(blockCenters, numCircles * numAttributes);
+        if (!reader.done())
+            return false;
+        for (size_t c = 0; c < numCircles; ++c)
+            blockCircles.emplace_back(blockRadii[c], blockCenters.data() + c * numAttributes, blockLabels[c]);
+    }
+    const vector<int> ids(blockIds.begin(), blockIds.end());
+
+    #pragma omp parallel for schedule(dynamic, 16) if(Parallelism::choose(circles.size(), blockCircles.size(), numAttributes) != Parallelism::SERIAL)
+    for (long long c = 0; c < (long long) circles.size(); ++c) {
+        // pick up where the blocks before left off
+        TopK list(k);
+        for (const auto &[cost, id] : cheapest[c])
+            list.push(cost, id);
+        NeighborGraph::findCheapest(circles[c], circleIds[c], blockCircles, ids, numAttributes, list);
+        cheapest[c] = list.items();
+    }
+    return true;
+}
+
+void ShardWorker::endGraph(vector<char> &reply) {
+    ShardProtocol::Writer writer;
+    for (auto &list : cheapest) {
+        // cheapest first, ties to the lower id, like NeighborGraph::exact
+        sort(list.begin(), list.end());
+        writer.put((int32_t) list.size());
+        for (const auto &[cost, id] : list) {
+            writer.put(cost);
+            writer.put((int32_t) id);
+        }
+    }
+    reply = std::move(writer.bytes);
+}
+
+bool ShardWorker::cover(const vector<char> &payload, vector<char> &reply) {
+    ShardProtocol::Reader reader(payload);
+    const uint64_t numCircles = reader.get<uint64_t>();
+    vector<int32_t> circleLabels;
+    vector<float> circleRadii, circleCenters;
+    reader.get(circleLabels, numCircles);
+    reader.get(circleRadii, numCircles);
+    reader.get(circleCenters, numCircles * numAttributes);
+    if (!reader.done())
+        return false;
+
+    vector<HyperCircle> finished;
+    finished.reserve(numCircles);
+    for (size_t c = 0; c < numCircles; ++c)
+        finished.emplace_back(circleRadii[c], circleCenters.data() + c * numAttributes, circleLabels[c]);
+
+    // both add up over the shards, so the coordinator just sums them
+    HyperCircle::countPointsInCircles(finished, shard);
+    const vector<int> best = HyperCircle::countBestCircles(finished, shard);
+
+    ShardProtocol::Writer writer;
+    for (const HyperCircle &c : finished)
+        writer.put((int32_t) c.numPoints);
+    for (int count : best)
+        writer.put((int32_t) count);
+    reply = std::move(writer.bytes);
+    return true;
+}
@@ -0,0 +1,65 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef SHARDWORKER_H
+#define SHARDWORKER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "Dataset.h"
+#include "HyperCircle.h"
+
+// one worker of a sharded generation run. it holds its shard of the (collapsed) training rows, and does the O(n^2)
+// parts for them: each row's nearest neighbor and nearest enemy, each of its circles' cheapest later circles for the
+// merge graph, and the point counts for the finished circles. the rest of the data only ever comes through a block at
+// a time, so a worker needs about as much memory as its shard. see ShardProtocol for the conversation.
+class ShardWorker {
+public:
+
+    // makes a unix socket at path and listens on it. throws if it can't.
+    static int listenOn(const std::string &path);
+
+    // takes coordinators off listener one after another and works for each until it quits. with once, only the first.
+    static void run(int listener, bool once);
+
+    // works for the coordinator on fd until it says QUIT (true) or something goes wrong (false)
+    bool serve(int fd);
+
+private:
+
+    int numAttributes = 0;
+
+    // our rows, back to back, and the dataset of them everything runs on
+    std::vector<float> rows;
+    std::vector<int32_t> labels;
+    std::vector<int32_t> weights;
+    Dataset shard;
+
+    // a circle for each of our rows, and where its nearest neighbor search has gotten to
+    std::vector<HyperCircle> centers;
+    std::vector<float> minDist;
+    std::vector<int> minClass;
+
+    // our rows which got a circle, and their ids in the whole list
+    std::vector<HyperCircle> circles;
+    std::vector<int> circleIds;
+    int k = 0;
+    std::vector<std::vector<std::pair<float, int>>> cheapest;
+
+    bool load(const std::vector<char> &payload);
+    void beginNearest();
+    bool nearestBlock(const std::vector<char> &payload);
+    void endNearest(std::vector<char> &reply);
+    bool beginGraph(const std::vector<char> &payload);
+    bool graphBlock(const std::vector<char> &payload);
+    void endGraph(std::vector<char> &reply);
+    bool cover(const std::vector<char> &payload, std::vector<char> &reply);
+
+    // a dataset over rows which someone else keeps
+    Dataset datasetOf(const float *blockRows, const int32_t *blockLabels, const int32_t *blockWeights, size_t numRows) const;
+};
+
+#endif //SHARDWORKER_H
@@ -0,0 +1,415 @@
+// runs random and bundled datasets through every fast path we have, and through ReferenceHyperCircles, and checks they
+// agree: the same circles (radii up to rounding, since the kernels add up in different orders), and the same label for
+// every query under every voting submode and fallback. returns non zero if anything disagrees. run it from the repo
+// root so datasets/ is where it expects.
+#include "ReferenceHyperCircles.h"
+#include "HyperCircle.h"
+#include "HyperCircleModel.h"
+#include "SparseDataset.h"
+#include "Numa.h"
+#include "Streaming.h"
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <cmath>
+#include <map>
+#include <cstdio>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const string &what) {
+    if (!ok) {
+        failures++;
+        cerr << "FAIL: " << what << endl;
+    }
+}
+
+// a dataset along with the rows its points point into
+struct TestSet {
+    string name;
+    Dataset train;
+    Dataset test;
+    vector<shared_ptr<vector<float>>> rows;
+};
+
+static float *newRow(TestSet &set, const vector<float> &values) {
+    set.rows.push_back(make_shared<vector<float>>(values));
+    return set.rows.back()->data();
+}
+
+// a few gaussian blobs per class. some rows show up twice, and a few twice with different classes, since collapsing
+// those is one of the things being checked. the test set is fresh draws plus some training rows, which sit right on
+// the edges of circles.
+static TestSet randomSet(int numAttributes, int numClasses, int numRows, unsigned seed) {
+    TestSet set;
+    set.name = "random " + to_string(numAttributes) + "d " + to_string(numClasses) + " classes";
+    set.train.numAttributes = numAttributes;
+    set.test = set.train.emptyLike();
+
+    mt19937 rng(seed);
+    normal_distribution<float> noise(0.0f, 0.6f);
+    uniform_real_distribution<float> anywhere(-3.0f, 3.0f);
+
+    vector<vector<float>> blobs;
+    for (int b = 0; b < numClasses * 3; ++b) {
+        blobs.emplace_back(numAttributes);
+        for (float &v : blobs.back())
+            v = anywhere(rng);
+    }
+
+    auto draw = [&](int &cls) {
+        const int b = (int) (rng() % blobs.size());
+        cls = b % numClasses;
+        vector<float> row(numAttributes);
+        for (int a = 0; a < numAttributes; ++a)
+            row[a] = blobs[b][a] + noise(rng);
+        return row;
+    };
+
+    for (int r = 0; r < numRows; ++r) {
+        int cls;
+        const vector<float> row = draw(cls);
+        set.train.push_back(Point(newRow(set, row), set.train.classes->idFor(to_string(cls))));
+
+        if (rng() % 20 == 0)
+            set.train.push_back(Point(newRow(set, row), set.train.classes->idFor(to_string(cls))));
+        if (rng() % 100 == 0)
+            set.train.push_back(Point(newRow(set, row), set.train.classes->idFor(to_string((cls + 1) % numClasses))));
+    }
+
+    for (int r = 0; r < numRows / 2; ++r) {
+        int cls;
+        const vector<float> row = draw(cls);
+        set.test.push_back(Point(newRow(set, row), set.train.classes->idFor(to_string(cls))));
+    }
+    for (size_t r = 0; r < set.train.size(); r += 7)
+        set.test.push_back(set.train[r]);
+    return set;
+}
+
+static TestSet bundledSet(const string &fileName) {
+    TestSet set;
+    set.name = fileName;
+    set.train = Dataset::readFile(fileName);
+    set.test = set.train.emptyLike();
+    for (size_t r = 0; r < set.train.size(); r += 3)
+        set.test.push_back(set.train[r]);
+    return set;
+}
+
+// every circle has to be pure: nothing of another class inside it, past the edge
+static void checkPure(const Dataset &train, const vector<HyperCircle> &circles, double edge, const string &what) {
+    int impure = 0;
+    for (const HyperCircle &c : circles) {
+        for (const Point &p : train) {
+            if (p.classification != c.classification && ReferenceHyperCircles::distance(p.location, c.centerPoint, train.numAttributes) < c.radius * (1.0 - edge)) {
+                impure++;
+                break;
+            }
+        }
+    }
+    check(impure == 0, what + ": " + to_string(impure) + " circles have a point of another class inside");
+}
+
+// circles matched up by their center's values and class, since the sparse generator's centers are copies. every circle
+// has to be one the reference has, about the same size and holding the same points, and every circle the reference
+// is sure about has to be there. if the reference hit a near tie making them, any pure set of circles will do.
+static void compareCircles(const ReferenceHyperCircles::Result &expected, const vector<HyperCircle> &actual,
+                           const Dataset &train, double edge, const string &what) {
+    const int n = train.numAttributes;
+    checkPure(train, actual, edge, what);
+    if (expected.nearTies > 0)
+        return;
+
+    using Key = pair<int, vector<float>>;
+    map<Key, const ReferenceHyperCircles::Circle *> byCenter;
+    for (const auto &c : expected.circles)
+        byCenter[{c.classification, vector<float>(c.center, c.center + n)}] = &c;
+
+    int wrong = 0, sureOnes = 0, missing = 0;
+    for (const HyperCircle &c : actual) {
+        auto found = byCenter.find({c.classification, vector<float>(c.centerPoint, c.centerPoint + n)});
+        if (found == byCenter.end()) {
+            wrong++;
+            continue;
+        }
+        const ReferenceHyperCircles::Circle &r = *found->second;
+        wrong += fabs(r.radius - c.radius) > edge * r.radius || c.numPoints < r.fewestPoints || c.numPoints > r.mostPoints;
+        sureOnes += r.surelyUseful;
+    }
+    for (const auto &c : expected.circles)
+        missing += c.surelyUseful;
+    missing -= sureOnes;
+
+    check(wrong == 0, what + ": " + to_string(wrong) + " of " + to_string(actual.size()) + " circles don't match the reference");
+    check(missing == 0, what + ": " + to_string(missing) + " circles the reference has are missing");
+}
+
+// the reference's answers for every query
+static vector<int> expectedLabels(const vector<ReferenceHyperCircles::Circle> &circles, const TestSet &set, int subMode, int fallbackMode, int k) {
+    vector<int> labels(set.test.size());
+    for (size_t q = 0; q < set.test.size(); ++q)
+        labels[q] = ReferenceHyperCircles::classify(circles, set.train, set.test[q].location, subMode, fallbackMode, k);
+    return labels;
+}
+
+// queries on a circle's edge could honestly go either way, so they don't count
+static void compareLabels(const vector<int> &expected, const vector<int> &actual, const vector<char> &onEdge, const string &what) {
+    int wrong = 0;
+    for (size_t q = 0; q < expected.size(); ++q)
+        wrong += !onEdge[q] && expected[q] != actual[q];
+    check(wrong == 0, what + ": " + to_string(wrong) + " of " + to_string(expected.size()) + " labels don't match the reference");
+}
+
+// every submode and fallback, through each way a model can classify. edgeQueries gets how many queries we skipped.
+static void checkClassification(const vector<ReferenceHyperCircles::Circle> &reference, TestSet &set, int &edgeQueries) {
+    const int k = 3;
+    const int numClasses = set.train.numClasses();
+
+    // the model gets the reference's own circles, so any difference is down to classification
+    vector<HyperCircle> circles;
+    for (const auto &c : reference) {
+        circles.emplace_back(c.radius, const_cast<float *>(c.center), c.classification);
+        circles.back().numPoints = c.numPoints;
+    }
+
+    vector<float> rows;
+    SparseDataset sparseTest;
+    for (const Point &p : set.test) {
+        rows.insert(rows.end(), p.location, p.location + set.train.numAttributes);
+        vector<pair<int, float>> entries;
+        for (int a = 0; a < set.train.numAttributes; ++a)
+            entries.emplace_back(a, p.location[a]);
+        sparseTest.addRow(entries, p.classification);
+    }
+    sparseTest.numAttributes = set.train.numAttributes;
+
+    vector<char> onEdge(set.test.size());
+    for (size_t q = 0; q < set.test.size(); ++q)
+        onEdge[q] = ReferenceHyperCircles::onEdge(reference, set.train.numAttributes, set.test[q].location);
+    edgeQueries = count(onEdge.begin(), onEdge.end(), 1);
+
+    // replicated is a copy of the centers per node, over a simulated two node topology
+    struct Variant {
+        string name;
+        int precision;
+        int pivots;
+        bool replicated;
+    };
+    const Variant variants[] = {{"fp32", HyperCircleModel::FP32, 0, false}, {"fp16", HyperCircleModel::FP16, 0, false},
+                                {"int8", HyperCircleModel::INT8, 0, false}, {"pivots", HyperCircleModel::FP32, 8, false},
+                                {"int8 + pivots", HyperCircleModel::INT8, 8, false}, {"replicated", HyperCircleModel::FP32, 0, true}};
+    const int fallbacks[] = {HyperCircle::USE_CIRCLES, HyperCircle::REGULAR_KNN, HyperCircle::K_NEAREST_CIRCLES, HyperCircle::K_NEAREST_RATIOS};
+
+    for (const Variant &variant : variants) {
+        HyperCircleModel model(circles, set.train.numAttributes, numClasses);
+        model.setPrecision(variant.precision);
+        model.buildPivots(variant.pivots);
+        if (variant.replicated) {
+            model.replicateCenters({Numa::OFF, true, 2});
+            check(model.centerReplicas.size() == 2, set.name + ": expected a copy of the centers on each of 2 nodes");
+        }
+
+        // no neighbors to vote means no answer, not class 0
+        check(model.kNearestCircle(set.test[0].location, 0) == -1 && model.kNearestCircleRatio(set.test[0].location, 0) == -1,
+              set.name + ", " + variant.name + ": k nearest circles with k = 0 should vote -1");
+
+        for (int subMode = HyperCircle::SIMPLE_MAJORITY; subMode <= HyperCircle::SMALLEST_CIRCLE; ++subMode) {
+            for (int fallback : fallbacks) {
+                const string what = set.name + ", " + variant.name + ", submode " + to_string(subMode) + ", fallback " + to_string(fallback);
+                const vector<int> expected = expectedLabels(reference, set, subMode, fallback, k);
+
+                // the batch path, with the fallback run on whatever the circles missed
+                vector<int> labels = model.classifyPoints(set.train, set.test, HyperCircle::USE_CIRCLES, subMode, k);
+                for (size_t q = 0; q < labels.size(); ++q)
+                    if (labels[q] == -1 && fallback != HyperCircle::USE_CIRCLES)
+                        labels[q] = model.classifyPoint(set.train, set.test[q].location, fallback, subMode, k);
+                compareLabels(expected, labels, onEdge, what + ", classifyPoints");
+
+                // the library path only has the circle fallbacks
+                if (fallback == HyperCircle::REGULAR_KNN)
+                    continue;
+                model.classifyRows(rows.data(), set.test.size(), labels.data(), subMode, fallback, k);
+                compareLabels(expected, labels, onEdge, what + ", classifyRows");
+
+                if (variant.precision == HyperCircleModel::FP32 && variant.pivots == 0) {
+                    model.classifySparse(sparseTest, labels.data(), subMode, fallback, k);
+                    compareLabels(expected, labels, onEdge, what + ", classifySparse");
+                }
+            }
+        }
+    }
+}
+
+// every generator which is supposed to come out the same as the reference
+static void checkGeneration(const ReferenceHyperCircles::Result &reference, TestSet &set) {
+    const double edge = ReferenceHyperCircles::EDGE;
+
+    // the way the menu does it: collapsing, the neighbor graph merge, pruning dominated circles
+    compareCircles(reference, HyperCircle::generateHyperCircles(set.train), set.train, edge, set.name + ", generateHyperCircles");
+
+    // the merge that measures every later circle itself
+    Dataset unique = set.train.collapsed();
+    vector<HyperCircle> circles = HyperCircle::createCircles(unique);
+    HyperCircle::mergeCircles(circles, unique);
+    HyperCircle::countPointsInCircles(circles, unique);
+    HyperCircle::removeUselessCircles(circles, unique);
+    compareCircles(reference, circles, set.train, edge, set.name + ", full scan merge");
+
+    // cut off partway through by a budget, then resumed from the checkpoint
+    const string checkpoint = "differential_test.checkpoint";
+    remove(checkpoint.c_str());
+    HyperCircle::Budget cut;
+    cut.distances = (long long) (1.5 * unique.size() * unique.size());
+    cut.checkpointFile = checkpoint;
+    cut.checkpointEvery = 0;
+    HyperCircle::generateHyperCircles(set.train, cut);
+    HyperCircle::Budget resume;
+    resume.checkpointFile = checkpoint;
+    compareCircles(reference, HyperCircle::generateHyperCircles(set.train, resume), set.train, edge, set.name + ", resumed from a checkpoint");
+    remove(checkpoint.c_str());
+
+    // half the rows, then the other half added with updateHyperCircles. the circles have to stay pure against
+    // everything, and counts kept up incrementally have to match counting again from scratch. points right on an edge
+    // can honestly go either way, so a count just has to be between the sure ones and the sure ones plus those.
+    Dataset grown = set.train.emptyLike(), rest = set.train.emptyLike();
+    for (size_t r = 0; r < set.train.size(); ++r)
+        (r % 2 == 0 ? grown : rest).push_back(set.train[r]);
+    vector<HyperCircle> updated = HyperCircle::generateHyperCircles(grown);
+    HyperCircle::updateHyperCircles(updated, grown, rest);
+    checkPure(grown, updated, edge, set.name + ", updateHyperCircles");
+    int miscounted = 0;
+    for (const HyperCircle &c : updated) {
+        int fewest = 0, most = 0;
+        for (const Point &p : grown) {
+            const double d = ReferenceHyperCircles::distance(p.location, c.centerPoint, grown.numAttributes);
+            fewest += d < c.radius * (1.0 - edge) ? p.weight : 0;
+            most += d <= c.radius * (1.0 + edge) ? p.weight : 0;
+        }
+        miscounted += c.numPoints < fewest || c.numPoints > most;
+    }
+    check(miscounted == 0, set.name + ", updateHyperCircles: " + to_string(miscounted) + " of " + to_string(updated.size())
+          + " circles have the wrong point count");
+
+    // the rows copied into blocks placed over a simulated two node topology. where they live can't change anything.
+    for (int how : {Numa::FIRST_TOUCH, Numa::INTERLEAVE}) {
+        Dataset placed = set.train.placed({how, false, 2});
+        compareCircles(reference, HyperCircle::generateHyperCircles(placed), set.train, edge,
+                       set.name + ", rows placed " + Numa::placementName(how));
+    }
+
+    // sparse rows get their distances from norms fixed up at the nonzeros, which rounds a lot further off than adding
+    // up the differences, so they get a wider edge
+    SparseDataset sparse;
+    sparse.classes = set.train.classes;
+    for (const Point &p : set.train) {
+        vector<pair<int, float>> entries;
+        for (int a = 0; a < set.train.numAttributes; ++a)
+            entries.emplace_back(a, p.location[a]);
+        sparse.addRow(entries, p.classification);
+    }
+    sparse.numAttributes = set.train.numAttributes;
+    const double sparseEdge = 1e-3;
+    compareCircles(ReferenceHyperCircles::generate(set.train, sparseEdge), HyperCircle::generateHyperCircles(sparse),
+                   set.train, sparseEdge, set.name + ", sparse generateHyperCircles");
+}
+
+// streams a bundled file through a model made from two thirds of it, in tiny chunks with a tiny queue and more threads
+// than we have, and checks the confusion matrix against classifying the whole file at once like testAccuracy
+static void checkStreaming(TestSet &set) {
+    Dataset train = set.train.emptyLike();
+    for (size_t r = 0; r < set.train.size(); ++r)
+        if (r % 3 != 0)
+            train.push_back(set.train[r]);
+    const HyperCircleModel model(HyperCircle::generateHyperCircles(train), train.numAttributes, train.numClasses());
+
+#ifdef _OPENMP
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(3);
+#endif
+    Dataset noTrain;
+    for (Dataset *fallbackTrain : {&train, &noTrain}) {
+        const int fallback = fallbackTrain->empty() ? HyperCircle::K_NEAREST_CIRCLES : HyperCircle::REGULAR_KNN;
+        vector<vector<long long>> expected(set.train.numClasses(), vector<long long>(set.train.numClasses()));
+        long long uncovered = 0;
+        for (const Point &p : set.train) {
+            int label = model.classifyPoint(*fallbackTrain, p.location, HyperCircle::USE_CIRCLES, HyperCircle::SIMPLE_MAJORITY, -1);
+            if (label == -1) {
+                uncovered++;
+                label = model.classifyPoint(*fallbackTrain, p.location, fallback, -1, 3);
+            }
+            expected[p.classification][label]++;
+        }
+
+        Streaming::Settings settings;
+        settings.chunkRows = 7;
+        settings.queueChunks = 2;
+        const Streaming::Result streamed = Streaming::evaluate(model, *fallbackTrain, set.name, set.train.classes, settings);
+        const string what = set.name + " streamed with " + (fallbackTrain->empty() ? "no training data" : "training data");
+        check(streamed.rows == (long long) set.train.size(), what + ": rows");
+        check(streamed.unclassified == uncovered, what + ": uncovered rows");
+        check(streamed.confusionMatrix == expected, what + ": confusion matrix");
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+}
+
+// addRow on columns listed twice (the last one wins, even a zero) and a negative column (thrown out, row not added)
+static void checkSparseRows() {
+    SparseDataset sparse;
+    sparse.addRow({{3, 1.0f}, {0, 2.0f}, {3, 0.0f}, {5, 4.0f}, {5, 6.0f}, {1, 0.0f}}, 0);
+    check(vector<int>(sparse.columnsOf(0), sparse.columnsOf(0) + sparse.nonzeros(0)) == vector<int> {0, 5}, "sparse row: columns");
+    check(vector<float>(sparse.valuesOf(0), sparse.valuesOf(0) + sparse.nonzeros(0)) == vector<float> {2.0f, 6.0f}, "sparse row: values");
+    check(sparse.numAttributes == 6, "sparse row: numAttributes");
+
+    bool threw = false;
+    try {
+        sparse.addRow({{2, 1.0f}, {-1, 1.0f}}, 0);
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    check(threw && sparse.size() == 1 && sparse.columns.size() == 2, "sparse row: negative column");
+}
+
+int main() {
+
+    // the generators talk a lot. we only want to hear about failures.
+    ostringstream quiet;
+    auto *console = cout.rdbuf(quiet.rdbuf());
+
+    vector<TestSet> sets;
+    const int widths[] = {2, 3, 4, 7, 8, 16, 34, 50};
+    for (int i = 0; i < size(widths); ++i)
+        sets.push_back(randomSet(widths[i], 2 + i % 3, 500, 1000 + i));
+    for (const char *fileName : {"iris.csv", "ionosphere.csv", "file_1.csv", "file_14.csv"})
+        sets.push_back(bundledSet(fileName));
+
+    checkSparseRows();
+    for (TestSet &set : sets) {
+        const int before = failures;
+        if (set.train.empty()) {
+            check(false, set.name + ": couldn't read it");
+            continue;
+        }
+
+        const ReferenceHyperCircles::Result reference = ReferenceHyperCircles::generate(set.train);
+        checkGeneration(reference, set);
+        int edgeQueries = 0;
+        checkClassification(reference.circles, set, edgeQueries);
+        if (set.name.ends_with(".csv"))
+            checkStreaming(set);
+        quiet.str("");
+        cerr << (failures == before ? "ok   " : "FAIL ") << set.name << " (" << reference.circles.size() << " circles, "
+             << reference.nearTies << " near ties, " << edgeQueries << " of " << set.test.size() << " queries on an edge)" << endl;
+    }
+
+    cout.rdbuf(console);
+    cerr << (failures == 0 ? "all passed" : to_string(failures) + " failures") << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+//
+// Created by Ryan Gallagher on 10/18/26.
+//
+
+#ifndef REFERENCEHYPERCIRCLES_H
+#define REFERENCEHYPERCIRCLES_H
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <cmath>
+
+#include "Dataset.h"
+#include "HyperCircle.h"
+#include "Utils.h"
+
+// the algorithms the way they were written before any of the speedups, kept around as an oracle for the tests. no
+// early abandoning, no graphs, grids, indexes, pivots or quantized centers, no threads, and every loop goes over
+// everything. distances are plain double math. slow on purpose, so there's nothing clever in here that could be wrong
+// in the same way as the code it checks.
+// the fast kernels add up in other orders (and -ffast-math reorders them however it likes), so a decision which comes
+// down to the last few bits can honestly go either way. so we keep track of every decision that was within edge (of
+// the distances involved, relatively) of going the other way, instead of pretending there's only one right answer.
+class ReferenceHyperCircles {
+public:
+
+    struct Circle {
+        const float *center;
+        float radius;
+        int classification;
+
+        // weight of the points inside, and the fewest and most it could be with points on the edge going either way
+        int numPoints;
+        int fewestPoints;
+        int mostPoints;
+
+        // whether some point has this as its biggest circle for sure. the ones which aren't only made it because of a
+        // point on an edge, so the fast code can keep them or not.
+        bool surelyUseful;
+    };
+
+    struct Result {
+        std::vector<Circle> circles;
+
+        // decisions while making and merging circles which were too close to call. every one after could be different,
+        // so with any of these the circles can only be checked for being valid, not for being these exact ones.
+        int nearTies = 0;
+    };
+
+    // how close to a tie counts as too close to call, relative to the distances involved
+    static constexpr double EDGE = 1e-5;
+
+    // one point per distinct row and class, weighted by how many rows it stands for, in the order they first show up
+    static Dataset collapse(const Dataset &dataSet) {
+        Dataset unique = dataSet.emptyLike();
+        for (const Point &p : dataSet) {
+            bool found = false;
+            for (Point &u : unique) {
+                if (u.classification == p.classification && std::equal(p.location, p.location + dataSet.numAttributes, u.location)) {
+                    u.weight += p.weight;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                unique.push_back(p);
+        }
+        return unique;
+    }
+
+    // nearest neighbor circles, merging, counting, and dropping useless circles, like HyperCircle::generateHyperCircles
+    static Result generate(const Dataset &dataSet, double edge = EDGE) {
+        Dataset unique = collapse(dataSet);
+        const int n = unique.numAttributes;
+        Result result;
+        auto tooClose = [&](double a, double b) { return std::fabs(a - b) <= edge * std::max(a, b); };
+
+        // each point's circle reaches its nearest neighbor, if that's its own class. ties go to the other class.
+        std::vector<Circle> circles;
+        for (const Point &p : unique) {
+            double nearestFriend = std::numeric_limits<double>::max(), nearestEnemy = std::numeric_limits<double>::max();
+            const float *friendRow = nullptr, *enemyRow = nullptr;
+            for (const Point &q : unique) {
+                if (q.location == p.location)
+                    continue;
+                const double d = distance(p.location, q.location, n);
+                if (q.classification == p.classification && d < nearestFriend) {
+                    nearestFriend = d;
+                    friendRow = q.location;
+                } else if (q.classification != p.classification && d < nearestEnemy) {
+                    nearestEnemy = d;
+                    enemyRow = q.location;
+                }
+            }
+            if (friendRow == nullptr)
+                continue;
+
+            // the same row showing up under two classes is a tie every kernel gets exactly right
+            const bool sameRow = enemyRow != nullptr && std::equal(friendRow, friendRow + n, enemyRow);
+            if (tooClose(nearestFriend, nearestEnemy) && !sameRow)
+                result.nearTies++;
+            if (nearestFriend < nearestEnemy)
+                circles.push_back({p.location, (float) nearestFriend, p.classification, 0, 0, 0, false});
+        }
+
+        // each circle in turn eats the later circles of its class, cheapest first, for as long as nothing of another
+        // class ends up inside it. that's every candidate cheaper than the closest point of another class.
+        std::vector<char> alive(circles.size(), 1);
+        for (size_t c = 0; c < circles.size(); ++c) {
+            if (!alive[c])
+                continue;
+
+            double nearestEnemy = std::numeric_limits<double>::max();
+            for (const Point &p : unique)
+                if (p.classification != circles[c].classification)
+                    nearestEnemy = std::min(nearestEnemy, distance(p.location, circles[c].center, n));
+
+            std::vector<std::pair<double, int>> costs;
+            for (size_t other = c + 1; other < circles.size(); ++other)
+                if (alive[other] && circles[other].classification == circles[c].classification)
+                    costs.emplace_back(distance(circles[c].center, circles[other].center, n) + circles[other].radius, (int) other);
+            std::sort(costs.begin(), costs.end());
+
+            for (const auto &[cost, other] : costs) {
+                if (tooClose(cost, nearestEnemy))
+                    result.nearTies++;
+                if (cost >= nearestEnemy)
+                    break;
+                circles[c].radius = std::max(circles[c].radius, (float) cost);
+                alive[other] = 0;
+            }
+        }
+
+        std::vector<Circle> merged;
+        for (size_t c = 0; c < circles.size(); ++c)
+            if (alive[c])
+                merged.push_back(circles[c]);
+
+        // every point's weight counts toward each circle it's in
+        for (Circle &circle : merged) {
+            for (const Point &p : unique) {
+                const double d = distance(p.location, circle.center, n);
+                if (d <= circle.radius)
+                    circle.numPoints += p.weight;
+                if (d <= circle.radius && !tooClose(d, circle.radius))
+                    circle.fewestPoints += p.weight;
+                if (d <= circle.radius || tooClose(d, circle.radius))
+                    circle.mostPoints += p.weight;
+            }
+        }
+
+        // a circle is kept if it's the biggest circle of its own class (the first one, on ties) some point is in. if the
+        // point is right on the edge of a circle which could be its biggest, or two of them are about the same size,
+        // any of those might be kept.
+        std::vector<char> sure(merged.size(), 0), maybe(merged.size(), 0);
+        for (const Point &p : unique) {
+            // the circles of its class it's in, and whether it's only on their edge
+            std::vector<int> inside;
+            std::vector<char> edgeOf;
+            for (size_t c = 0; c < merged.size(); ++c) {
+                if (merged[c].classification != p.classification)
+                    continue;
+                const double d = distance(p.location, merged[c].center, n);
+                if (d < merged[c].radius || tooClose(d, merged[c].radius)) {
+                    inside.push_back((int) c);
+                    edgeOf.push_back(tooClose(d, merged[c].radius));
+                }
+            }
+            if (inside.empty())
+                continue;
+
+            // the biggest circle the point is in for sure. only circles about that big, or bigger ones it might be in,
+            // could be its biggest.
+            float biggest = 0.0f;
+            for (size_t i = 0; i < inside.size(); ++i)
+                if (!edgeOf[i])
+                    biggest = std::max(biggest, merged[inside[i]].radius);
+            std::vector<int> couldBe;
+            bool unclear = false;
+            for (size_t i = 0; i < inside.size(); ++i) {
+                if (merged[inside[i]].radius >= biggest || tooClose(merged[inside[i]].radius, biggest)) {
+                    couldBe.push_back(inside[i]);
+                    unclear |= edgeOf[i];
+                }
+            }
+
+            if (couldBe.size() == 1 && !unclear)
+                sure[couldBe[0]] = 1;
+            else
+                for (int c : couldBe)
+                    maybe[c] = 1;
+        }
+
+        for (size_t c = 0; c < merged.size(); ++c) {
+            if (sure[c] || maybe[c]) {
+                merged[c].surelyUseful = sure[c];
+                result.circles.push_back(merged[c]);
+            }
+        }
+        return result;
+    }
+
+    // the label circles give point under subMode, or -1 if none of them cover it. votes gets each class's votes.
+    static int circleVote(const std::vector<Circle> &circles, int numClasses, int numAttributes, const float *point, int subMode, std::vector<float> &votes) {
+        votes.assign(numClasses, 0.0f);
+        std::vector<int> perClass(numClasses, 0);
+        for (const Circle &c : circles)
+            perClass[c.classification]++;
+
+        double smallest = std::numeric_limits<double>::max();
+        int smallestClass = -1;
+        for (const Circle &c : circles) {
+            const double d = distance(point, c.center, numAttributes);
+            if (d > c.radius)
+                continue;
+
+            switch (subMode) {
+                case HyperCircle::SIMPLE_MAJORITY: votes[c.classification] += 1.0f; break;
+                case HyperCircle::COUNT_VOTE: votes[c.classification] += c.numPoints; break;
+                case HyperCircle::DENSITY_VOTE: votes[c.classification] += c.numPoints / std::max(c.radius, 1e-6f); break;
+                case HyperCircle::DISTANCE_VOTE: votes[c.classification] += c.numPoints / (d + 1e-4f); break;
+                case HyperCircle::PER_CLASS_VOTE: votes[c.classification] += 1.0f / perClass[c.classification]; break;
+                case HyperCircle::SMALLEST_CIRCLE:
+                    if (d < smallest) {
+                        smallest = d;
+                        smallestClass = c.classification;
+                    }
+                    break;
+                default: break;
+            }
+        }
+
+        if (subMode == HyperCircle::SMALLEST_CIRCLE)
+            return smallestClass;
+
+        int best = -1;
+        float bestVotes = 0.0f;
+        for (int cls = 0; cls < numClasses; ++cls) {
+            if (votes[cls] > bestVotes) {
+                bestVotes = votes[cls];
+                best = cls;
+            }
+        }
+        return best;
+    }
+
+    // the k smallest (distance, label) pairs vote with 1 / distance. the first class with the most votes wins.
+    static int knnVote(std::vector<std::pair<float, int>> candidates, int k, int numClasses) {
+        k = std::min<int>(k, (int) candidates.size());
+        std::sort(candidates.begin(), candidates.end());
+        std::vector<float> votes(numClasses, 0.0f);
+        for (int i = 0; i < k; ++i)
+            votes[candidates[i].second] += 1 / candidates[i].first;
+        return (int) (std::max_element(votes.begin(), votes.end()) - votes.begin());
+    }
+
+    // circles first, then fallbackMode (REGULAR_KNN, K_NEAREST_CIRCLES or K_NEAREST_RATIOS) for points they miss
+    static int classify(const std::vector<Circle> &circles, const Dataset &train, const float *point, int subMode, int fallbackMode, int k) {
+        const int numClasses = train.numClasses();
+        const int n = train.numAttributes;
+        std::vector<float> votes;
+        int prediction = circleVote(circles, numClasses, n, point, subMode, votes);
+        if (prediction != -1 || fallbackMode == HyperCircle::USE_CIRCLES)
+            return prediction;
+
+        std::vector<std::pair<float, int>> candidates;
+        if (fallbackMode == HyperCircle::REGULAR_KNN) {
+            for (const Point &p : train)
+                candidates.emplace_back(distance(p.location, point, n), p.classification);
+        } else {
+            for (const Circle &c : circles) {
+                const double d = distance(c.center, point, n);
+                candidates.emplace_back(fallbackMode == HyperCircle::K_NEAREST_RATIOS ? d / c.radius : d, c.classification);
+            }
+        }
+        return knnVote(candidates, k, numClasses);
+    }
+
+    // whether point sits right on the edge of some circle, where the fast code could put it either side. training points
+    // land on edges all the time, since that's where their neighbor's radius stops.
+    static bool onEdge(const std::vector<Circle> &circles, int numAttributes, const float *point) {
+        for (const Circle &c : circles)
+            if (std::fabs(distance(point, c.center, numAttributes) - c.radius) <= EDGE * c.radius)
+                return true;
+        return false;
+    }
+
+    // plain double math, one attribute after another
+    static double distance(const float *a, const float *b, int n) {
+        double sum = 0.0;
+        for (int i = 0; i < n; ++i)
+            sum += std::pow(std::fabs((double) a[i] - (double) b[i]), NORM);
+        return std::pow(sum, 1.0 / NORM);
+    }
+};
+
+#endif //REFERENCEHYPERCIRCLES_H